@@ -6,21 +6,36 @@
 #ifndef __SONATA_ASYNC_REQUEST_HPP
 #define __SONATA_ASYNC_REQUEST_HPP
 
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace sonata {
 
 class AsyncRequestImpl;
 class Collection;
+class Batch;
+class BufferedWriter;
+class BufferedWriterImpl;
 
 /**
  * @brief AsyncRequest objects are used to keep track of
  * on-going asynchronous operations.
+ *
+ * When an operation completes, its result is converted (e.g. the record
+ * id is written where the caller asked) and the callbacks registered
+ * with then() are called, by the first of the following calls that
+ * observes its completion: wait(), completed(), wait_all(), wait_any(),
+ * or AsyncRequestWindow::next(). There is no background thread calling
+ * them otherwise.
  */
 class AsyncRequest {
 
   friend Collection;
+  friend Batch;
+  friend BufferedWriter;
+  friend BufferedWriterImpl;
 
 public:
   /**
@@ -54,15 +69,53 @@ public:
   ~AsyncRequest();
 
   /**
-   * @brief Wait for the request to complete.
+   * @brief Wait for the request to complete. Throws an Exception
+   * if the operation failed (every time it is called).
    */
   void wait() const;
 
   /**
    * @brief Test if the request has completed, without blocking.
+   * If it has, its result is converted and its callbacks are called.
+   * Errors are not thrown by this function but by wait().
    */
   bool completed() const;
 
+  /**
+   * @brief Registers a callback to be called once the operation has
+   * completed successfully and its result has been converted (e.g. to
+   * use a fetched record). Callbacks are called in the order in which
+   * they were registered. If the request has already completed, the
+   * callback is called immediately (unless the operation failed). An
+   * exception thrown by a callback is rethrown by wait().
+   *
+   * @param callback Function to call.
+   *
+   * @return this request, so that calls can be chained.
+   */
+  const AsyncRequest &then(std::function<void()> callback) const;
+
+  /**
+   * @brief Waits for all the (valid) requests to complete. Throws the
+   * Exception of the first request that failed, once all have completed.
+   *
+   * @param requests Requests to wait on.
+   */
+  static void wait_all(const std::vector<AsyncRequest> &requests);
+
+  /**
+   * @brief Waits for one of the (valid) requests to complete and returns
+   * its index. Throws the Exception of this request if it failed, or an
+   * Exception if none of the requests is valid. The requests are polled,
+   * yielding to other ULTs in between, so requests that only complete once
+   * waited on (e.g. records still in a BufferedWriter) are never selected.
+   *
+   * @param requests Requests to wait on.
+   *
+   * @return the index of a completed request.
+   */
+  static size_t wait_any(const std::vector<AsyncRequest> &requests);
+
   /**
    * @brief Checks if the Collection object is valid.
    */
@@ -74,6 +127,62 @@ private:
   AsyncRequest(const std::shared_ptr<AsyncRequestImpl> &impl);
 };
 
+/**
+ * @brief An AsyncRequestWindow keeps up to a given number of asynchronous
+ * operations in flight, so that a client can issue many operations (e.g.
+ * to many providers) without waiting for each of them and without
+ * accumulating an unbounded number of pending requests:
+ *
+ * AsyncRequestWindow window(16);
+ * for(auto& record : records)
+ *     coll.store(record, nullptr, false, window.next());
+ * window.wait_all();
+ *
+ * The window should not be used concurrently by multiple threads.
+ */
+class AsyncRequestWindow {
+
+public:
+  /**
+   * @brief Constructor.
+   *
+   * @param max_in_flight Maximum number of requests in flight.
+   */
+  explicit AsyncRequestWindow(size_t max_in_flight);
+
+  AsyncRequestWindow(const AsyncRequestWindow &) = delete;
+
+  AsyncRequestWindow &operator=(const AsyncRequestWindow &) = delete;
+
+  /**
+   * @brief Destructor. Waits for the requests in flight,
+   * ignoring their errors.
+   */
+  ~AsyncRequestWindow();
+
+  /**
+   * @brief Returns a pointer to a request to pass to the next operation,
+   * waiting for one of the requests in flight to complete if the window
+   * is full. Throws the Exception of a request that failed, in which case
+   * the request is removed from the window.
+   */
+  AsyncRequest *next();
+
+  /**
+   * @brief Waits for all the requests in flight (see
+   * AsyncRequest::wait_all), leaving the window empty.
+   */
+  void wait_all();
+
+  /**
+   * @brief Number of requests in flight.
+   */
+  size_t size() const;
+
+private:
+  std::vector<AsyncRequest> m_requests;
+};
+
 } // namespace sonata
 
 #endif
@@ -176,6 +176,52 @@ public:
   storeMultiJson(const std::string &coll_name, const JsonWrapper &records,
                  bool commit) = 0;
 
+  /**
+   * @brief Reserves a range of consecutive record ids in the collection,
+   * so that records can later be stored with these ids by storeReserved
+   * (other stores will not use them). Until then, the reserved ids count
+   * in lastID but not in size, and fetching them fails. This allows a
+   * backend that delays writes (e.g. AggregatorBackend) to return the
+   * actual ids of the records. The default implementation returns an
+   * error, indicating that the backend does not support reservations.
+   *
+   * @param coll_name Name of the collection.
+   * @param count Number of ids to reserve.
+   *
+   * @return a RequestResult<uint64_t> instance containing
+   * the first reserved id if successful.
+   */
+  virtual RequestResult<uint64_t> reserveIds(const std::string &coll_name,
+                                             size_t count);
+
+  /**
+   * @brief Stores records with ids previously obtained from reserveIds.
+   * Each reserved id can be used only once: the call fails, without
+   * storing anything, if one of the ids was not reserved or has already
+   * been used (even if its record has since been erased).
+   *
+   * @param coll_name Name of the collection.
+   * @param record_ids Reserved ids of the records.
+   * @param records Records to store (JSON array).
+   * @param commit Whether to commit changes to storage.
+   *
+   * @return a RequestResult<bool> instance indicating
+   * whether the records were stored.
+   */
+  virtual RequestResult<bool>
+  storeReserved(const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const JsonWrapper &records, bool commit);
+
+  /**
+   * @brief Indicates whether the backend adds an "__id" field holding
+   * the id of a record to the content of the records that are objects.
+   * Backends that delay writes (e.g. AggregatorBackend) use it to return
+   * pending records the way the backend would return them once written.
+   * The default implementation returns false.
+   */
+  virtual bool addsRecordIds() const;
+
   /**
    * @brief Fetches a particular record by its id.
    *
@@ -226,6 +272,41 @@ public:
   fetchMultiJson(const std::string &coll_name,
                  const std::vector<uint64_t> &record_ids) = 0;
 
+  /**
+   * @brief Same as fetchJson but only returns the requested fields
+   * of the record (e.g. {"name", "address.city"}), along with its
+   * "__id" field. Fields that the record does not have are omitted.
+   * The default implementation projects the result of fetchJson();
+   * backends that can skip the other fields while reading the record
+   * should override it.
+   *
+   * @param coll_name Name of the collection.
+   * @param record_id Record id.
+   * @param fields Field paths to return (all of them if empty).
+   *
+   * @return a RequestResult<JsonWrapper> instance.
+   * containing the projected record if successful.
+   */
+  virtual RequestResult<JsonWrapper>
+  fetchJsonProjected(const std::string &coll_name, uint64_t record_id,
+                     const std::vector<std::string> &fields);
+
+  /**
+   * @brief Same as fetchMultiJson but only returns the requested
+   * fields of the records (see fetchJsonProjected).
+   *
+   * @param coll_name Name of the collection.
+   * @param record_ids Record ids.
+   * @param fields Field paths to return (all of them if empty).
+   *
+   * @return a RequestResult<JsonWrapper> instance.
+   * containing the projected records if successful.
+   */
+  virtual RequestResult<JsonWrapper>
+  fetchMultiJsonProjected(const std::string &coll_name,
+                          const std::vector<uint64_t> &record_ids,
+                          const std::vector<std::string> &fields);
+
   /**
    * @brief Returns an array of records matching a given
    * Jx9 filter. The filter should be expressed as a string
@@ -233,6 +314,10 @@ public:
    *
    * "function($user) { return $user.age > 30; }"
    *
+   * Filtering is a read-only operation and does not commit
+   * anything to storage; code that needs to modify the database
+   * should go through execute() instead.
+   *
    * @param coll_name Name of the collection.
    * @param filter_code Code of the Jx9 function.
    *
@@ -249,6 +334,10 @@ public:
    *
    * "function($user) { return $user.age > 30; }"
    *
+   * Filtering is a read-only operation and does not commit
+   * anything to storage; code that needs to modify the database
+   * should go through execute() instead.
+   *
    * @param coll_name Name of the collection.
    * @param filter_code Code of the Jx9 function.
    *
@@ -258,6 +347,96 @@ public:
   virtual RequestResult<JsonWrapper>
   filterJson(const std::string &coll_name, const std::string &filter_code) = 0;
 
+  /**
+   * @brief Same as filterJson but only returns the requested
+   * fields of the records (see fetchJsonProjected).
+   *
+   * @param coll_name Name of the collection.
+   * @param filter_code Code of the Jx9 function.
+   * @param fields Field paths to return (all of them if empty).
+   *
+   * @return a RequestResult<JsonWrapper>
+   * instance containing the result of the request.
+   */
+  virtual RequestResult<JsonWrapper>
+  filterJsonProjected(const std::string &coll_name,
+                      const std::string &filter_code,
+                      const std::vector<std::string> &fields);
+
+  /**
+   * @brief Returns an array of records matching a declarative
+   * JSON predicate, for example:
+   *
+   * {"and": [{"field": "age", "gt": 30},
+   *          {"field": "address.city", "in": ["Paris", "Rome"]}]}
+   *
+   * See src/JsonPredicate.hpp for the accepted forms. The predicate
+   * is compiled once and evaluated natively on the records, without
+   * going through Jx9. The default implementation evaluates it on
+   * the result of allJson().
+   *
+   * @param coll_name Name of the collection.
+   * @param predicate JSON predicate.
+   *
+   * @return a RequestResult<std::vector<std::string>>
+   * instance containing the result of the request.
+   */
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name, const JsonWrapper &predicate);
+
+  /**
+   * @brief Same as filterPredicate but returns the matching
+   * records as a JSON array.
+   *
+   * @param coll_name Name of the collection.
+   * @param predicate JSON predicate.
+   *
+   * @return a RequestResult<JsonWrapper>
+   * instance containing the result of the request.
+   */
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate);
+
+  /**
+   * @brief Same as filterPredicateJson but only returns the requested
+   * fields of the records (see fetchJsonProjected). The predicate is
+   * evaluated on the full records.
+   *
+   * @param coll_name Name of the collection.
+   * @param predicate JSON predicate.
+   * @param fields Field paths to return (all of them if empty).
+   *
+   * @return a RequestResult<JsonWrapper>
+   * instance containing the result of the request.
+   */
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJsonProjected(const std::string &coll_name,
+                               const JsonWrapper &predicate,
+                               const std::vector<std::string> &fields);
+
+  /**
+   * @brief Runs an aggregation pipeline (optional predicate, optional
+   * group-by field, and list of reductions such as count, sum, min, max
+   * and avg) over the records of a collection and returns the aggregated
+   * rows as a JSON array, for example:
+   *
+   * {"predicate": {"field": "age", "gt": 30},
+   *  "group_by": "address.city",
+   *  "reductions": [{"op": "count"}, {"op": "avg", "field": "age"}]}
+   *
+   * See src/JsonAggregation.hpp for the accepted forms. The default
+   * implementation runs it on the result of allJson().
+   *
+   * @param coll_name Name of the collection.
+   * @param pipeline JSON aggregation pipeline.
+   *
+   * @return a RequestResult<JsonWrapper>
+   * instance containing the result of the request.
+   */
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name, const JsonWrapper &pipeline);
+
   /**
    * @brief Updates an existing record with the new content.
    *
@@ -343,6 +522,20 @@ public:
    */
   virtual RequestResult<JsonWrapper> allJson(const std::string &coll_name) = 0;
 
+  /**
+   * @brief Same as allJson but only returns the requested
+   * fields of the records (see fetchJsonProjected).
+   *
+   * @param coll_name Name of the collection.
+   * @param fields Field paths to return (all of them if empty).
+   *
+   * @return a RequestResult<JsonWrapper> instance
+   * containing the projected records, if successful.
+   */
+  virtual RequestResult<JsonWrapper>
+  allJsonProjected(const std::string &coll_name,
+                   const std::vector<std::string> &fields);
+
   /**
    * @brief Returns the last record id stored in the collection.
    *
@@ -388,6 +581,89 @@ public:
   eraseMulti(const std::string &coll_name,
              const std::vector<uint64_t> &record_ids, bool commit) = 0;
 
+  /**
+   * @brief Creates a secondary index on a field of the records
+   * of a collection. The field is given as a path in which nested
+   * fields are separated by dots (e.g. "func.name").
+   *
+   * The default implementation reports that secondary indexes
+   * are not supported by the backend.
+   *
+   * @param coll_name Name of the collection.
+   * @param field Field path to index.
+   *
+   * @return a RequestResult<bool> instance.
+   */
+  virtual RequestResult<bool> createIndex(const std::string &coll_name,
+                                          const std::string &field) {
+    RequestResult<bool> result;
+    result.success() = false;
+    result.error() = "Secondary indexes are not supported by this backend";
+    return result;
+  }
+
+  /**
+   * @brief Removes a secondary index from a collection.
+   *
+   * @param coll_name Name of the collection.
+   * @param field Indexed field path.
+   *
+   * @return a RequestResult<bool> instance.
+   */
+  virtual RequestResult<bool> dropIndex(const std::string &coll_name,
+                                        const std::string &field) {
+    RequestResult<bool> result;
+    result.success() = false;
+    result.error() = "Secondary indexes are not supported by this backend";
+    return result;
+  }
+
+  /**
+   * @brief Returns the ids, in increasing order, of the records whose
+   * indexed field is within [lower, upper]. A null bound leaves the
+   * range open on that side, within the type of the other bound, and
+   * lower == upper is an equality lookup.
+   *
+   * @param coll_name Name of the collection.
+   * @param field Indexed field path.
+   * @param lower Lower bound (inclusive).
+   * @param upper Upper bound (inclusive).
+   *
+   * @return a RequestResult<std::vector<uint64_t>> instance.
+   */
+  virtual RequestResult<std::vector<uint64_t>>
+  queryIndex(const std::string &coll_name, const std::string &field,
+             const JsonWrapper &lower, const JsonWrapper &upper) {
+    RequestResult<std::vector<uint64_t>> result;
+    result.success() = false;
+    result.error() = "Secondary indexes are not supported by this backend";
+    return result;
+  }
+
+  /**
+   * @brief Same as queryIndex but returns a JSON array with the
+   * matching records instead of their ids.
+   *
+   * @param coll_name Name of the collection.
+   * @param field Indexed field path.
+   * @param lower Lower bound (inclusive).
+   * @param upper Upper bound (inclusive).
+   *
+   * @return a RequestResult<JsonWrapper> instance.
+   */
+  virtual RequestResult<JsonWrapper>
+  queryIndexJson(const std::string &coll_name, const std::string &field,
+                 const JsonWrapper &lower, const JsonWrapper &upper) {
+    RequestResult<JsonWrapper> result;
+    auto ids = queryIndex(coll_name, field, lower, upper);
+    if (!ids.success()) {
+      result.success() = false;
+      result.error() = std::move(ids.error());
+      return result;
+    }
+    return fetchMultiJson(coll_name, ids.value());
+  }
+
   /**
    * @brief Destroys the underlying database resources.
    *
@@ -0,0 +1,156 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BATCH_HPP
+#define __SONATA_BATCH_HPP
+
+#include <sonata/AsyncRequest.hpp>
+#include <sonata/Collection.hpp>
+#include <nlohmann/json.hpp>
+#include <memory>
+#include <string>
+
+namespace sonata {
+
+using nlohmann::json;
+
+class BatchImpl;
+
+/**
+ * @brief A Batch accumulates store, update, erase, and fetch operations
+ * on collections that may belong to different databases, as long as these
+ * databases are managed by the same provider, and sends them to this
+ * provider in a single RPC when execute() is called.
+ *
+ * The operations are executed in order by the provider. The outputs
+ * passed to the functions below (ids, records, etc.) are set once the
+ * batch has completed, and must remain valid until then. A failed
+ * operation does not prevent the next ones from executing; execute()
+ * (or AsyncRequest::wait()) throws an Exception with the error of the
+ * first operation that failed, after setting the outputs of the others.
+ *
+ * Copies of a Batch object refer to the same batch, which should not
+ * be modified concurrently by multiple threads.
+ */
+class Batch {
+
+public:
+  /**
+   * @brief Constructor. Creates an empty batch, which will be bound
+   * to the provider of the first collection an operation is added for.
+   */
+  Batch();
+
+  /**
+   * @brief Copy constructor.
+   */
+  Batch(const Batch &);
+
+  /**
+   * @brief Move constructor.
+   */
+  Batch(Batch &&);
+
+  /**
+   * @brief Copy-assignment operator.
+   */
+  Batch &operator=(const Batch &);
+
+  /**
+   * @brief Move-assignment operator.
+   */
+  Batch &operator=(Batch &&);
+
+  /**
+   * @brief Destructor.
+   */
+  ~Batch();
+
+  /**
+   * @brief Checks if the Batch object is valid.
+   */
+  operator bool() const;
+
+  /**
+   * @brief Number of operations added since the batch was
+   * created or last executed.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Adds a store operation. Throws an Exception if the collection
+   * is not managed by the same provider as the other operations.
+   *
+   * @param coll Collection to store the record in.
+   * @param record Record to store.
+   * @param id Resulting record id.
+   */
+  void store(const Collection &coll, const std::string &record,
+             uint64_t *id = nullptr) const;
+
+  /**
+   * @brief Same as above but takes a JSON object.
+   */
+  void store(const Collection &coll, const json &record,
+             uint64_t *id = nullptr) const;
+
+  /**
+   * @brief Adds an update operation.
+   *
+   * @param coll Collection of the record.
+   * @param id Id of the record to update.
+   * @param record New content of the record.
+   * @param updated Whether the record was updated.
+   */
+  void update(const Collection &coll, uint64_t id, const std::string &record,
+              bool *updated = nullptr) const;
+
+  /**
+   * @brief Same as above but takes a JSON object.
+   */
+  void update(const Collection &coll, uint64_t id, const json &record,
+              bool *updated = nullptr) const;
+
+  /**
+   * @brief Adds an erase operation.
+   *
+   * @param coll Collection of the record.
+   * @param id Id of the record to erase.
+   */
+  void erase(const Collection &coll, uint64_t id) const;
+
+  /**
+   * @brief Adds a fetch operation.
+   *
+   * @param coll Collection of the record.
+   * @param id Id of the record to fetch.
+   * @param record Resulting record.
+   */
+  void fetch(const Collection &coll, uint64_t id, std::string *record) const;
+
+  /**
+   * @brief Same as above but returns a JSON object.
+   */
+  void fetch(const Collection &coll, uint64_t id, json *record) const;
+
+  /**
+   * @brief Sends the operations to the provider. The batch is emptied
+   * (and no longer bound to a provider) so that it can be reused.
+   * Executing an empty batch does nothing (req, if provided, is then
+   * set to an invalid AsyncRequest).
+   *
+   * @param commit Whether to commit the databases that were written to
+   * once all the operations have been executed.
+   * @param req Pointer to a request to wait on.
+   */
+  void execute(bool commit = false, AsyncRequest *req = nullptr) const;
+
+private:
+  std::shared_ptr<BatchImpl> self;
+};
+
+} // namespace sonata
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BUFFERED_WRITER_HPP
+#define __SONATA_BUFFERED_WRITER_HPP
+
+#include <sonata/AsyncRequest.hpp>
+#include <nlohmann/json.hpp>
+#include <memory>
+#include <string>
+
+namespace sonata {
+
+using nlohmann::json;
+
+class BufferedWriterImpl;
+class Collection;
+
+/**
+ * @brief A BufferedWriter accumulates the records stored through it
+ * on the client side and sends them to the collection with a single
+ * store_multi operation once the buffer reaches a number of records,
+ * a size in bytes, or an age, or when flush() is called.
+ * BufferedWriter objects are created by Collection::buffered_writer.
+ *
+ * Records are sent in the order in which they were stored. The thresholds
+ * are checked when records are stored (there is no background thread), so
+ * the age threshold only applies if records keep being stored. When a
+ * threshold is reached, the buffer is sent asynchronously and store()
+ * returns without waiting for the provider. Errors of such sends are
+ * reported by the next call to flush() (or by waiting on the AsyncRequest
+ * of one of their records).
+ *
+ * The buffer is flushed when the last copy of the BufferedWriter object
+ * is destroyed. BufferedWriter objects can be used by multiple threads.
+ */
+class BufferedWriter {
+
+  friend class Collection;
+
+public:
+  /**
+   * @brief Default constructor. The resulting writer will be invalid.
+   */
+  BufferedWriter();
+
+  /**
+   * @brief Copy constructor.
+   */
+  BufferedWriter(const BufferedWriter &);
+
+  /**
+   * @brief Move constructor.
+   */
+  BufferedWriter(BufferedWriter &&);
+
+  /**
+   * @brief Copy-assignment operator.
+   */
+  BufferedWriter &operator=(const BufferedWriter &);
+
+  /**
+   * @brief Move-assignment operator.
+   */
+  BufferedWriter &operator=(BufferedWriter &&);
+
+  /**
+   * @brief Destructor.
+   */
+  ~BufferedWriter();
+
+  /**
+   * @brief Checks if the BufferedWriter object is valid.
+   */
+  operator bool() const;
+
+  /**
+   * @brief Adds a record to the buffer, sending the buffer if
+   * a threshold is reached.
+   *
+   * The record id is set once the buffer containing the record has been
+   * stored, that is, after a call to flush() or after req has completed.
+   * Waiting on req sends the buffer if it has not been sent yet.
+   * Since an AsyncRequest waits on destruction, req should be kept (e.g.
+   * in a vector) rather than overwritten by the next store, which would
+   * flush the buffer after each record.
+   *
+   * @param record Record to store.
+   * @param id Resulting record id.
+   * @param req Pointer to a request tracking the record.
+   */
+  void store(const std::string &record, uint64_t *id = nullptr,
+             AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Same as above but takes a JSON object.
+   */
+  void store(const json &record, uint64_t *id = nullptr,
+             AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Sends the buffered records and waits for all the records sent
+   * so far to be stored, throwing an Exception if any of them failed.
+   *
+   * @param req Pointer to a request to wait on instead.
+   */
+  void flush(AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Number of records that are buffered and not yet sent.
+   */
+  size_t pending() const;
+
+private:
+  std::shared_ptr<BufferedWriterImpl> self;
+
+  BufferedWriter(const std::shared_ptr<BufferedWriterImpl> &impl);
+};
+
+} // namespace sonata
+
+#endif
@@ -7,6 +7,7 @@
 #define __SONATA_CLIENT_HPP
 
 #include <memory>
+#include <sonata/Batch.hpp>
 #include <sonata/Database.hpp>
 #include <sonata/ProviderHandle.hpp>
 #include <thallium.hpp>
@@ -116,6 +117,23 @@ public:
   ProviderHandle createProviderHandle(hg_addr_t address,
                                       uint16_t provider_id) const;
 
+  /**
+   * @brief Sets the size (in bytes) above which the records sent by
+   * Collection::store_multi and returned by Collection::fetch_multi and
+   * Collection::all (as strings) are transferred using RDMA through
+   * a bulk handle instead of being serialized as RPC arguments.
+   * A value of 0 disables bulk transfers. The default is 1 MB.
+   *
+   * @param threshold Size threshold.
+   */
+  void setBulkThreshold(size_t threshold) const;
+
+  /**
+   * @brief Returns the size above which records are transferred
+   * using RDMA (see setBulkThreshold).
+   */
+  size_t getBulkThreshold() const;
+
   /**
    * @brief Checks that the Client instance is valid.
    */
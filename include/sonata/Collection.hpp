@@ -7,7 +7,10 @@
 #define __SONATA_COLLECTION_HPP
 
 #include <sonata/AsyncRequest.hpp>
+#include <sonata/BufferedWriter.hpp>
+#include <sonata/Cursor.hpp>
 #include <sonata/Database.hpp>
+#include <sonata/RecordView.hpp>
 #include <thallium.hpp>
 #include <nlohmann/json.hpp>
 #include <memory>
@@ -29,6 +32,7 @@ class Database;
 class Collection {
 
   friend class Database;
+  friend class Batch;
 
 public:
 
@@ -217,6 +221,24 @@ public:
     store_multi(vec, ids, commit, req);
   }
 
+  /**
+   * @brief Creates a BufferedWriter that accumulates the records stored
+   * through it and sends them to this collection with store_multi once
+   * the buffer holds max_records records, max_bytes bytes, or records
+   * that were added more than max_delay seconds ago, or when its flush()
+   * function is called. A threshold of 0 is ignored.
+   *
+   * @param max_records Maximum number of buffered records.
+   * @param max_bytes Maximum size of the buffered records.
+   * @param max_delay Maximum age of the buffer, in seconds.
+   * @param commit Whether to commit the changes to storage.
+   *
+   * @return a BufferedWriter.
+   */
+  BufferedWriter buffered_writer(size_t max_records, size_t max_bytes = 0,
+                                 double max_delay = 0.0,
+                                 bool commit = false) const;
+
   /**
    * @brief Asynchronously fetches a document by its record id.
    * If req is null, this function becomes synchronous.
@@ -239,6 +261,48 @@ public:
   void fetch(uint64_t id, json *result,
              AsyncRequest *req = nullptr) const;
 
+  /**
+   * @brief Asynchronously fetches a document by its record id,
+   * keeping only the requested fields (projection). Nested fields
+   * are specified using dots (e.g. "func.name"). The projection is
+   * applied by the server's backend, so other fields are not sent back
+   * (and are not even decoded by backends that support it, e.g. unqlite).
+   * The "__id" field is always included.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] id Record id.
+   * @param[in] fields Fields to return.
+   * @param[out] result Resulting JSON object.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch(uint64_t id, const std::vector<std::string> &fields,
+             json *result, AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously fetches a document by its record id, as a
+   * RecordView that only decodes the fields that are accessed.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] id Record id.
+   * @param[out] result Resulting view of the record.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch(uint64_t id, RecordView *result,
+             AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Same as the above function but only returns the
+   * requested fields of the document (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] id Record id.
+   * @param[in] fields Fields to return.
+   * @param[out] result Resulting view of the record.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch(uint64_t id, const std::vector<std::string> &fields,
+             RecordView *result, AsyncRequest *req = nullptr) const;
+
   /**
    * @brief Asynchronously fetches multiple documents by their record id.
    * If req is null, this function becomes synchronous.
@@ -264,6 +328,53 @@ public:
   void fetch_multi(const uint64_t *id, size_t count, json *result,
                    AsyncRequest *req = nullptr) const;
 
+  /**
+   * @brief Same as the above function but only returns the
+   * requested fields of each document (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] ids Record ids.
+   * @param[in] count Number of records to fetch.
+   * @param[in] fields Fields to return.
+   * @param[out] result Resulting JSON array.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch_multi(const uint64_t *id, size_t count,
+                   const std::vector<std::string> &fields, json *result,
+                   AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously fetches multiple documents by their record id,
+   * as RecordView objects that only decode the fields that are accessed.
+   * The views share the buffer received from the provider. Records that
+   * do not exist are returned as views of a null value.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] ids Record ids.
+   * @param[in] count Number of records to fetch.
+   * @param[out] result Resulting views of the records.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch_multi(const uint64_t *ids, size_t count,
+                   std::vector<RecordView> *result,
+                   AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Same as the above function but only returns the
+   * requested fields of each document (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param[in] ids Record ids.
+   * @param[in] count Number of records to fetch.
+   * @param[in] fields Fields to return.
+   * @param[out] result Resulting views of the records.
+   * @param req Pointer to a request to wait on.
+   */
+  void fetch_multi(const uint64_t *ids, size_t count,
+                   const std::vector<std::string> &fields,
+                   std::vector<RecordView> *result,
+                   AsyncRequest *req = nullptr) const;
+
   /**
    * @brief Asynchronously filters the collection and returns the
    * records that match the condition. This condition should
@@ -273,6 +384,10 @@ public:
    *
    * "function($record) { return $record.x < 4; }"
    *
+   * The filter is run as a read-only operation and nothing is
+   * committed to storage; code that modifies the database should
+   * be sent using Database::execute instead.
+   *
    * If req is null, this function becomes synchronous.
    *
    * @param filterCode A Jx9 filter code.
@@ -291,6 +406,10 @@ public:
    *
    * "function($record) { return $record.x < 4; }"
    *
+   * The filter is run as a read-only operation and nothing is
+   * committed to storage; code that modifies the database should
+   * be sent using Database::execute instead.
+   *
    * If req is null, this function becomes synchronous.
    *
    * @param filterCode A Jx9 filter code.
@@ -300,6 +419,97 @@ public:
   void filter(const std::string &filterCode, json *result,
               AsyncRequest *req = nullptr) const;
 
+  /**
+   * @brief Same as the above function but only returns the
+   * requested fields of each document (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param filterCode A Jx9 filter code.
+   * @param fields Fields to return.
+   * @param result Resuling JSON object containing the array of results.
+   * @param req Pointer to a request to wait on.
+   */
+  void filter(const std::string &filterCode,
+              const std::vector<std::string> &fields, json *result,
+              AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously filters the collection and returns the
+   * records that match a declarative JSON predicate. The predicate
+   * is evaluated natively by the server (and can use secondary
+   * indexes, see create_index), which is much faster than a Jx9
+   * filter and works with every backend. For example, the following
+   * predicate selects the records where 1 <= x < 4 and y is "a" or "b":
+   *
+   * {"and": [{"field": "x", "ge": 1, "lt": 4},
+   *          {"field": "y", "in": ["a", "b"]}]}
+   *
+   * Accepted operators are "eq", "ne", "lt", "le", "gt", "ge", "in"
+   * and "exists", combined with "and", "or" and "not". Nested fields
+   * are specified using dots (e.g. "func.name").
+   *
+   * If req is null, this function becomes synchronous.
+   *
+   * @param predicate JSON predicate.
+   * @param result Resuling vector of records as strings.
+   * @param req Pointer to a request to wait on.
+   */
+  void filter_predicate(const json &predicate,
+                        std::vector<std::string> *result,
+                        AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Same as the above function but returns the records
+   * as a JSON array.
+   *
+   * If req is null, this function becomes synchronous.
+   *
+   * @param predicate JSON predicate.
+   * @param result Resuling JSON object containing the array of results.
+   * @param req Pointer to a request to wait on.
+   */
+  void filter_predicate(const json &predicate, json *result,
+                        AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Same as the above function but only returns the
+   * requested fields of each document (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param predicate JSON predicate.
+   * @param fields Fields to return.
+   * @param result Resuling JSON object containing the array of results.
+   * @param req Pointer to a request to wait on.
+   */
+  void filter_predicate(const json &predicate,
+                        const std::vector<std::string> &fields, json *result,
+                        AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously runs an aggregation pipeline on the server
+   * and returns only the aggregated rows. For example the following
+   * pipeline counts the records with x >= 1 and computes the average
+   * of y for each distinct value of z:
+   *
+   * {"predicate": {"field": "x", "ge": 1},
+   *  "group_by": "z",
+   *  "reductions": [{"op": "count"},
+   *                 {"op": "avg", "field": "y", "as": "mean_y"}]}
+   *
+   * which gives rows such as {"z": "a", "count": 3, "mean_y": 4.5}.
+   * The predicate (see filter_predicate) and group_by are optional.
+   * Accepted reductions are "count", "sum", "min", "max" and "avg".
+   * Without group_by, a single row is returned.
+   *
+   * If req is null, this function becomes synchronous.
+   *
+   * @param pipeline JSON aggregation pipeline.
+   * @param result Resulting JSON array of rows.
+   * @param req Pointer to a request to wait on.
+   */
+  void aggregate(const json &pipeline, json *result,
+                 AsyncRequest *req = nullptr) const;
+
   /**
    * @brief Asynchronously updates the content of a document with a new content.
    * If req is null, this function becomes synchronous.
@@ -413,6 +623,34 @@ public:
    */
   void all(json *result, AsyncRequest *req = nullptr) const;
 
+  /**
+   * @brief Asynchronously returns the requested fields of all the
+   * documents from the collection as a JSON array (see fetch).
+   * If req is null, this function becomes synchronous.
+   *
+   * @param fields Fields to return.
+   * @param result All the documents from the collection.
+   * @param req Pointer to a request to wait on.
+   */
+  void all(const std::vector<std::string> &fields, json *result,
+           AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Opens a cursor to stream the documents of the collection
+   * page by page (see Cursor), instead of receiving all of them in a
+   * single response like all() and filter() do. If predicate is not
+   * null, only the documents matching it (see filter_predicate) are
+   * returned. If fields is not empty, the documents are projected
+   * (see fetch).
+   *
+   * @param predicate JSON predicate, or null.
+   * @param fields Fields to return.
+   *
+   * @return a Cursor.
+   */
+  Cursor open_cursor(const json &predicate = json(),
+                     const std::vector<std::string> &fields = {}) const;
+
   /**
    * @brief Returns the last record id used by the collection.
    *
@@ -451,6 +689,87 @@ public:
   void erase_multi(const uint64_t *ids, size_t size, bool commit = false,
                    AsyncRequest *req = nullptr) const;
 
+  /**
+   * @brief Creates a secondary index on a field of the documents
+   * of the collection, so that this field can be queried using
+   * query() and query_range(). Nested fields are specified using
+   * dots (e.g. "func.name").
+   *
+   * Secondary indexes are only supported by some backends
+   * (e.g. "unqlite"); this function throws an Exception otherwise.
+   *
+   * @param field Field path to index.
+   */
+  void create_index(const std::string &field) const;
+
+  /**
+   * @brief Removes a secondary index from the collection.
+   *
+   * @param field Indexed field path.
+   */
+  void drop_index(const std::string &field) const;
+
+  /**
+   * @brief Asynchronously looks up the ids of the documents whose
+   * indexed field is equal to the provided (non-null) value.
+   * Ids are returned in increasing order.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param field Indexed field path.
+   * @param value Value to look up.
+   * @param ids Resulting record ids.
+   * @param req Pointer to a request to wait on.
+   */
+  void query(const std::string &field, const json &value,
+             std::vector<uint64_t> *ids, AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously looks up the documents whose
+   * indexed field is equal to the provided (non-null) value.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param field Indexed field path.
+   * @param value Value to look up.
+   * @param records Resulting JSON array of documents.
+   * @param req Pointer to a request to wait on.
+   */
+  void query(const std::string &field, const json &value, json *records,
+             AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously looks up the ids of the documents whose
+   * indexed field is within [lower, upper]. A null bound leaves the
+   * range open on that side, within the type of the other bound (e.g.
+   * [5, null] does not match strings). Ids are returned in increasing
+   * order.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param field Indexed field path.
+   * @param lower Lower bound (inclusive).
+   * @param upper Upper bound (inclusive).
+   * @param ids Resulting record ids.
+   * @param req Pointer to a request to wait on.
+   */
+  void query_range(const std::string &field, const json &lower,
+                   const json &upper, std::vector<uint64_t> *ids,
+                   AsyncRequest *req = nullptr) const;
+
+  /**
+   * @brief Asynchronously looks up the documents whose
+   * indexed field is within [lower, upper]. A null bound leaves the
+   * range open on that side, within the type of the other bound.
+   * If req is null, this function becomes synchronous.
+   *
+   * @param field Indexed field path.
+   * @param lower Lower bound (inclusive).
+   * @param upper Upper bound (inclusive).
+   * @param records Resulting JSON array of documents.
+   * @param req Pointer to a request to wait on.
+   */
+  void query_range(const std::string &field, const json &lower,
+                   const json &upper, json *records,
+                   AsyncRequest *req = nullptr) const;
+
 private:
   /**
    * @brief Constructor. This constructor is private.
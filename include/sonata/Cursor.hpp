@@ -0,0 +1,116 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_CURSOR_HPP
+#define __SONATA_CURSOR_HPP
+
+#include <nlohmann/json.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+class CursorImpl;
+class Collection;
+
+/**
+ * @brief A Cursor is used to stream the records of a collection
+ * (optionally filtered by a JSON predicate) page by page, so that
+ * neither the server nor the client needs to hold the full result
+ * in memory. Cursors are created by Collection::open_cursor.
+ *
+ * Records are returned in increasing order of ids. Records stored
+ * after the cursor was opened are not returned.
+ *
+ * The server-side cursor is released by close(), or asynchronously when
+ * the last copy of the Cursor object is destroyed. The server also
+ * releases cursors that have not been used for 5 minutes, and limits
+ * the number of open cursors (open_cursor throws when it is reached).
+ */
+class Cursor {
+
+  friend class Collection;
+
+public:
+  /**
+   * @brief Default constructor. The resulting cursor
+   * instance will be invalid.
+   */
+  Cursor();
+
+  /**
+   * @brief Copy constructor.
+   */
+  Cursor(const Cursor &);
+
+  /**
+   * @brief Move constructor.
+   */
+  Cursor(Cursor &&);
+
+  /**
+   * @brief Copy-assignment operator.
+   */
+  Cursor &operator=(const Cursor &);
+
+  /**
+   * @brief Move-assignment operator.
+   */
+  Cursor &operator=(Cursor &&);
+
+  /**
+   * @brief Destructor.
+   */
+  ~Cursor();
+
+  /**
+   * @brief Checks if the Cursor object is valid.
+   */
+  operator bool() const;
+
+  /**
+   * @brief Fetches the next page of records. The page stops after
+   * max_records records, or once it reaches max_bytes bytes (at least
+   * one record is always returned). A value of 0 means no limit.
+   *
+   * @param result Resulting vector of records as strings.
+   * @param max_records Maximum number of records in the page.
+   * @param max_bytes Approximate maximum size of the page.
+   *
+   * @return false if the cursor was exhausted (result is then empty).
+   */
+  bool next(std::vector<std::string> *result, size_t max_records,
+            size_t max_bytes = 0) const;
+
+  /**
+   * @brief Same as the above function but returns the page
+   * as a JSON array.
+   *
+   * @param result Resulting JSON array of records.
+   * @param max_records Maximum number of records in the page.
+   * @param max_bytes Approximate maximum size of the page.
+   *
+   * @return false if the cursor was exhausted (result is then empty).
+   */
+  bool next(json *result, size_t max_records, size_t max_bytes = 0) const;
+
+  /**
+   * @brief Releases the server-side cursor. Calling next()
+   * afterwards throws an Exception.
+   */
+  void close() const;
+
+private:
+  std::shared_ptr<CursorImpl> self;
+
+  Cursor(const std::shared_ptr<CursorImpl> &impl);
+};
+
+} // namespace sonata
+
+#endif
@@ -8,6 +8,8 @@
 
 #include <sonata/Exception.hpp>
 #include <nlohmann/json.hpp>
+#include <cstring>
+#include <mercury_proc.h>
 #include <thallium/serialization/stl/string.hpp>
 #include <thallium/serialization/stl/tuple.hpp>
 #include <thallium/serialization/stl/vector.hpp>
@@ -17,8 +19,20 @@ namespace sonata {
 
 using nlohmann::json;
 
+/**
+ * @brief Formats in which JSON values are serialized in RPCs.
+ * Tree serializes the value node by node through the archive.
+ * Compact encodes the whole value in one pass into a contiguous buffer
+ * (see JsonCompactCodec) that is transferred at once, and decoded in one
+ * pass on the other side. Each serialized value starts with a tag
+ * identifying its format, so the receiver decodes either format and
+ * the sender can choose the format of each RPC argument and response.
+ */
+enum class JsonWireFormat { Tree, Compact };
+
 struct JsonWrapper {
     json m_object;
+    JsonWireFormat m_format = JsonWireFormat::Compact;
     JsonWrapper() = default;
     ~JsonWrapper() = default;
     JsonWrapper(const JsonWrapper&) = default;
@@ -47,8 +61,11 @@ struct JsonWrapper {
 
 struct JsonRefWrapper {
     json& m_object;
+    JsonWireFormat m_format;
     ~JsonRefWrapper() = default;
-    JsonRefWrapper(json& obj) : m_object(obj) {}
+    JsonRefWrapper(json& obj,
+                   JsonWireFormat format = JsonWireFormat::Compact)
+    : m_object(obj), m_format(format) {}
     JsonRefWrapper(const JsonRefWrapper&) = default;
     JsonRefWrapper(JsonRefWrapper&&) = default;
     JsonRefWrapper& operator=(const JsonRefWrapper&) = default;
@@ -72,8 +89,11 @@ struct JsonRefWrapper {
 
 struct ConstJsonRefWrapper {
     const json& m_object;
+    JsonWireFormat m_format;
     ~ConstJsonRefWrapper() = default;
-    ConstJsonRefWrapper(const json& obj) : m_object(obj) {}
+    ConstJsonRefWrapper(const json& obj,
+                        JsonWireFormat format = JsonWireFormat::Compact)
+    : m_object(obj), m_format(format) {}
     ConstJsonRefWrapper(const ConstJsonRefWrapper&) = default;
     ConstJsonRefWrapper(ConstJsonRefWrapper&&) = default;
     ConstJsonRefWrapper& operator=(const ConstJsonRefWrapper&) = default;
@@ -123,9 +143,9 @@ template <typename A> void saveJSON(A &ar, json const &val) {
   }
 }
 
-template <typename A> void loadJSON(A &ar, json &val) {
-  char t;
-  ar(t);
+template <typename A> void loadJSON(A &ar, json &val);
+
+template <typename A> void loadJSON(A &ar, json &val, char t) {
   switch ((json::value_t)t) {
   case json::value_t::null:
     break;
@@ -169,10 +189,10 @@ template <typename A> void loadJSON(A &ar, json &val) {
         size_t s;
         val = json::array();
         ar(s);
-        for(size_t i=0; i < s; i++) {
-            JsonWrapper w;
-            ar(w);
-            val.push_back(std::move(w.m_object));
+        auto& array = val.get_ref<json::array_t&>();
+        array.resize(s);
+        for(auto& v : array) {
+            loadJSON(ar, v);
         }
     }
     break;
@@ -181,12 +201,11 @@ template <typename A> void loadJSON(A &ar, json &val) {
         size_t s;
         val = json::object();
         ar(s);
+        auto& object = val.get_ref<json::object_t&>();
         for(size_t i=0; i < s; i++) {
             std::string key;
-            JsonWrapper w;
             ar(key);
-            ar(w);
-            val.emplace(key, std::move(w.m_object));
+            loadJSON(ar, object[std::move(key)]);
         }
     }
     break;
@@ -196,28 +215,339 @@ template <typename A> void loadJSON(A &ar, json &val) {
   }
 }
 
+template <typename A> void loadJSON(A &ar, json &val) {
+  char t;
+  ar(t);
+  loadJSON(ar, val, t);
+}
+
+/**
+ * @brief Binary encoding of JSON values used by JsonWireFormat::Compact.
+ * Each node is a json::value_t tag followed by its content: booleans take
+ * one byte, numbers are 8 bytes, strings and keys are prefixed by their
+ * size, and arrays and objects by their number of entries, so that the
+ * decoder can allocate them at once. Numbers and sizes are in the native
+ * byte order, as is the rest of Thallium's serialization.
+ */
+class JsonCompactCodec {
+
+public:
+  static void encode(const json &val, std::string &buffer) {
+    size_t size = buffer.size();
+    buffer.resize(size + encodedSize(val));
+    char *data = &buffer[size];
+    encode(val, data);
+  }
+
+  /**
+   * @brief Encodes the value at data, which should have room for
+   * encodedSize(val) bytes, and advances data past it.
+   */
+  static void encode(const json &val, char *&data) {
+    auto type = val.type();
+    *data++ = (char)type;
+    switch (type) {
+    case json::value_t::null:
+      break;
+    case json::value_t::boolean:
+      *data++ = val.get<json::boolean_t>() ? 1 : 0;
+      break;
+    case json::value_t::number_integer:
+      write(data, val.get<json::number_integer_t>());
+      break;
+    case json::value_t::number_unsigned:
+      write(data, val.get<json::number_unsigned_t>());
+      break;
+    case json::value_t::number_float:
+      write(data, val.get<json::number_float_t>());
+      break;
+    case json::value_t::string:
+      writeString(data, val.get_ref<const json::string_t &>());
+      break;
+    case json::value_t::array:
+      write(data, (uint64_t)val.size());
+      for (auto &v : val)
+        encode(v, data);
+      break;
+    case json::value_t::object:
+      write(data, (uint64_t)val.size());
+      for (auto &e : val.get_ref<const json::object_t &>()) {
+        writeString(data, e.first);
+        encode(e.second, data);
+      }
+      break;
+    case json::value_t::binary:
+    case json::value_t::discarded:
+      throw sonata::Exception("Invalid json type found (binary or discarded)");
+    }
+  }
+
+  /**
+   * @brief Size in bytes of the encoded value.
+   */
+  static size_t encodedSize(const json &val) {
+    switch (val.type()) {
+    case json::value_t::null:
+      return 1;
+    case json::value_t::boolean:
+      return 2;
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+    case json::value_t::number_float:
+      return 1 + sizeof(uint64_t);
+    case json::value_t::string:
+      return 1 + sizeof(uint64_t) + val.get_ref<const json::string_t &>().size();
+    case json::value_t::array: {
+      size_t size = 1 + sizeof(uint64_t);
+      for (auto &v : val)
+        size += encodedSize(v);
+      return size;
+    }
+    case json::value_t::object: {
+      size_t size = 1 + sizeof(uint64_t);
+      for (auto &e : val.get_ref<const json::object_t &>())
+        size += sizeof(uint64_t) + e.first.size() + encodedSize(e.second);
+      return size;
+    }
+    default:
+      throw sonata::Exception("Invalid json type found (binary or discarded)");
+    }
+  }
+
+  /**
+   * @brief Decodes the value starting at data and advances data
+   * past it. Throws an Exception if the buffer is not well-formed.
+   */
+  static void decode(const char *&data, const char *end, json &val) {
+    auto type = (json::value_t)read<char>(data, end);
+    switch (type) {
+    case json::value_t::null:
+      val = nullptr;
+      break;
+    case json::value_t::boolean:
+      val = read<char>(data, end) != 0;
+      break;
+    case json::value_t::number_integer:
+      val = read<json::number_integer_t>(data, end);
+      break;
+    case json::value_t::number_unsigned:
+      val = read<json::number_unsigned_t>(data, end);
+      break;
+    case json::value_t::number_float:
+      val = read<json::number_float_t>(data, end);
+      break;
+    case json::value_t::string:
+      val = json::value_t::string;
+      readString(data, end, val.get_ref<json::string_t &>());
+      break;
+    case json::value_t::array: {
+      auto count = readCount(data, end);
+      val = json::value_t::array;
+      auto &array = val.get_ref<json::array_t &>();
+      array.resize(count);
+      for (auto &v : array)
+        decode(data, end, v);
+    } break;
+    case json::value_t::object: {
+      auto count = readCount(data, end);
+      val = json::value_t::object;
+      auto &object = val.get_ref<json::object_t &>();
+      std::string key;
+      for (uint64_t i = 0; i < count; i++) {
+        readString(data, end, key);
+        // keys were encoded in order, so they are inserted at the end
+        auto it = object.emplace_hint(object.end(), std::move(key), json());
+        decode(data, end, it->second);
+      }
+    } break;
+    default:
+      throw sonata::Exception("Invalid compact JSON value");
+    }
+  }
+
+  /**
+   * @brief Advances data past the value it points to, without decoding it.
+   * Throws an Exception if the buffer is not well-formed.
+   */
+  static void skip(const char *&data, const char *end) {
+    auto type = (json::value_t)read<char>(data, end);
+    switch (type) {
+    case json::value_t::null:
+      break;
+    case json::value_t::boolean:
+      read<char>(data, end);
+      break;
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+    case json::value_t::number_float:
+      read<uint64_t>(data, end);
+      break;
+    case json::value_t::string:
+      skipString(data, end);
+      break;
+    case json::value_t::array: {
+      auto count = readCount(data, end);
+      for (uint64_t i = 0; i < count; i++)
+        skip(data, end);
+    } break;
+    case json::value_t::object: {
+      auto count = readCount(data, end);
+      for (uint64_t i = 0; i < count; i++) {
+        skipString(data, end);
+        skip(data, end);
+      }
+    } break;
+    default:
+      throw sonata::Exception("Invalid compact JSON value");
+    }
+  }
+
+  // The functions bellow read the components of an encoded value in place
+  // (see RecordView), throwing an Exception if the buffer is too short.
+
+  template <typename T> static T read(const char *&data, const char *end) {
+    T x;
+    if ((size_t)(end - data) < sizeof(x))
+      throw sonata::Exception("Invalid compact JSON value (truncated)");
+    std::memcpy(&x, data, sizeof(x));
+    data += sizeof(x);
+    return x;
+  }
+
+  static void readString(const char *&data, const char *end,
+                         std::string &str) {
+    uint64_t size;
+    auto chars = skipString(data, end, &size);
+    str.assign(chars, size);
+  }
+
+  // Returns a pointer to the string's characters and advances data past it.
+  static const char *skipString(const char *&data, const char *end,
+                                uint64_t *size = nullptr) {
+    auto str_size = read<uint64_t>(data, end);
+    if ((uint64_t)(end - data) < str_size)
+      throw sonata::Exception("Invalid compact JSON value (truncated)");
+    auto str = data;
+    data += str_size;
+    if (size)
+      *size = str_size;
+    return str;
+  }
+
+  // Reads a number of entries, each of which takes at least one byte.
+  static uint64_t readCount(const char *&data, const char *end) {
+    auto count = read<uint64_t>(data, end);
+    if ((uint64_t)(end - data) < count)
+      throw sonata::Exception("Invalid compact JSON value (truncated)");
+    return count;
+  }
+
+private:
+  template <typename T> static void write(char *&data, T x) {
+    std::memcpy(data, &x, sizeof(x));
+    data += sizeof(x);
+  }
+
+  static void writeString(char *&data, const std::string &str) {
+    write(data, (uint64_t)str.size());
+    std::memcpy(data, str.data(), str.size());
+    data += str.size();
+  }
+};
+
+// Tag that starts a value serialized in the compact format. It differs
+// from the json::value_t tags that start a value in the tree format.
+constexpr char compact_json_tag = 0x7f;
+
+template <typename A>
+void saveJSON(A &ar, json const &val, JsonWireFormat format) {
+  if (format == JsonWireFormat::Tree) {
+    saveJSON(ar, val);
+    return;
+  }
+  // same layout as a serialized std::string, encoded in place
+  // in the archive's buffer
+  size_t size = JsonCompactCodec::encodedSize(val);
+  ar(compact_json_tag);
+  ar(size);
+  auto proc = ar.get_proc();
+  auto data = static_cast<char *>(hg_proc_save_ptr(proc, size));
+  if (!data)
+    throw sonata::Exception("Could not serialize compact JSON value");
+  auto begin = data;
+  JsonCompactCodec::encode(val, data);
+  hg_proc_restore_ptr(proc, begin, size);
+}
+
+template <typename A> JsonWireFormat loadJSONAnyFormat(A &ar, json &val) {
+  char t;
+  ar(t);
+  if (t != compact_json_tag) {
+    loadJSON(ar, val, t);
+    return JsonWireFormat::Tree;
+  }
+  // decoded in place from the archive's buffer
+  size_t size;
+  ar(size);
+  auto proc = ar.get_proc();
+  auto begin = static_cast<const char *>(hg_proc_save_ptr(proc, size));
+  if (!begin)
+    throw sonata::Exception("Invalid compact JSON value (truncated)");
+  const char *data = begin;
+  const char *end = begin + size;
+  JsonCompactCodec::decode(data, end, val);
+  hg_proc_restore_ptr(proc, const_cast<char *>(begin), size);
+  if (data != end)
+    throw sonata::Exception("Invalid compact JSON value (trailing bytes)");
+  return JsonWireFormat::Compact;
+}
+
+/**
+ * @brief A JsonCompactBuffer holds a JSON value encoded with
+ * JsonCompactCodec. It can be loaded from a JsonWrapper sent in either
+ * wire format, without building the value's tree if it was sent in the
+ * compact format.
+ */
+struct JsonCompactBuffer {
+    std::string m_data;
+};
+
+template <typename A> void load(A &ar, JsonCompactBuffer& buffer) {
+  char t;
+  ar(t);
+  if (t == compact_json_tag) {
+    ar(buffer.m_data);
+    return;
+  }
+  json val;
+  loadJSON(ar, val, t);
+  buffer.m_data.clear();
+  JsonCompactCodec::encode(val, buffer.m_data);
+}
+
 template <typename A> void load(A &ar, JsonWrapper& wrapper) {
-    loadJSON(ar, wrapper.m_object);
+    wrapper.m_format = loadJSONAnyFormat(ar, wrapper.m_object);
 }
 
 template <typename A> void load(A &ar, JsonRefWrapper& wrapper) {
-    loadJSON(ar, wrapper.m_object);
+    wrapper.m_format = loadJSONAnyFormat(ar, wrapper.m_object);
 }
 
 template <typename A> void load(A& ar, ConstJsonRefWrapper& wrapper) {
-    loadJSON(ar, const_cast<json&>(wrapper.m_object));
+    wrapper.m_format =
+        loadJSONAnyFormat(ar, const_cast<json&>(wrapper.m_object));
 }
 
 template <typename A> void save(A& ar, const JsonWrapper& wrapper) {
-    saveJSON(ar, wrapper.m_object);
+    saveJSON(ar, wrapper.m_object, wrapper.m_format);
 }
 
 template <typename A> void save(A& ar, const JsonRefWrapper& wrapper) {
-    saveJSON(ar, wrapper.m_object);
+    saveJSON(ar, wrapper.m_object, wrapper.m_format);
 }
 
 template <typename A> void save(A& ar, const ConstJsonRefWrapper& wrapper) {
-    saveJSON(ar, wrapper.m_object);
+    saveJSON(ar, wrapper.m_object, wrapper.m_format);
 }
 
 } // namespace sonata
@@ -0,0 +1,145 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_RECORD_VIEW_HPP
+#define __SONATA_RECORD_VIEW_HPP
+
+#include <nlohmann/json.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+class Collection;
+
+/**
+ * @brief A RecordView is a read-only view of a JSON record (or of a value
+ * within a record) that keeps the binary buffer received from the provider
+ * and only decodes the values that are accessed, so that reading a few
+ * fields from many records does not require building their JSON trees.
+ * Record views are obtained from Collection::fetch and
+ * Collection::fetch_multi.
+ *
+ * The entries of an object (resp. array) are located the first time one
+ * of them is accessed, and their offsets are kept in the view, so that
+ * subsequent accesses do not scan the buffer again. Because of this,
+ * a RecordView object should not be accessed concurrently by multiple
+ * threads (copies of it may).
+ *
+ * Accessing a field or an index that does not exist returns a view that
+ * does not exist (exists() returns false).
+ */
+class RecordView {
+
+  friend class Collection;
+
+public:
+  /**
+   * @brief Default constructor. The resulting view does not exist.
+   */
+  RecordView();
+
+  RecordView(const RecordView &);
+
+  RecordView(RecordView &&);
+
+  RecordView &operator=(const RecordView &);
+
+  RecordView &operator=(RecordView &&);
+
+  ~RecordView();
+
+  /**
+   * @brief Whether the view refers to a value.
+   */
+  bool exists() const;
+
+  /**
+   * @brief Type of the value (discarded if the view does not exist).
+   */
+  json::value_t type() const;
+
+  bool is_null() const { return type() == json::value_t::null; }
+  bool is_boolean() const { return type() == json::value_t::boolean; }
+  bool is_number() const;
+  bool is_string() const { return type() == json::value_t::string; }
+  bool is_array() const { return type() == json::value_t::array; }
+  bool is_object() const { return type() == json::value_t::object; }
+
+  /**
+   * @brief Number of entries of an array or object, 0 for other values.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Returns a view of the field with the given key
+   * if the value is an object.
+   */
+  RecordView operator[](const std::string &key) const;
+
+  /**
+   * @brief Returns a view of the element at the given index
+   * if the value is an array.
+   */
+  RecordView operator[](size_t index) const;
+
+  /**
+   * @brief Returns a view of the value at a dot-separated
+   * path (e.g. "func.name").
+   */
+  RecordView lookup(const std::string &path) const;
+
+  /**
+   * @brief Checks if the value is an object with the given key.
+   */
+  bool contains(const std::string &key) const;
+
+  /**
+   * @brief Returns the keys of an object, in order.
+   */
+  std::vector<std::string> keys() const;
+
+  /**
+   * @brief Decodes the value (and its content, if it is
+   * an array or an object) into a JSON object. Returns
+   * a discarded value if the view does not exist.
+   */
+  json to_json() const;
+
+  /**
+   * @brief Decodes the value and converts it to type T.
+   * Throws an Exception if the view does not exist.
+   */
+  template <typename T> T get() const { return checkedJson().get<T>(); }
+
+private:
+  struct Entry {
+    size_t m_key = 0; // offset of the key (objects only)
+    size_t m_value = 0; // offset of the value
+  };
+
+  std::shared_ptr<const std::string> m_buffer;
+  size_t m_offset = 0;
+  mutable std::shared_ptr<std::vector<Entry>> m_entries;
+
+  RecordView(const std::shared_ptr<const std::string> &buffer, size_t offset);
+
+  /**
+   * @brief Creates a view of a buffer received from a provider,
+   * throwing an Exception if it is not well-formed.
+   */
+  static RecordView fromBuffer(std::string &&buffer);
+
+  const std::vector<Entry> &entries() const;
+
+  json checkedJson() const;
+};
+
+} // namespace sonata
+
+#endif
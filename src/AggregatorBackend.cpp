@@ -27,6 +27,10 @@ std::unique_ptr<Backend> AggregatorBackend::create(const tl::engine &engine,
   size_t batch_size     = config.value("batch_size", (size_t)32);
   bool commit_on_flush  = config.value("commit_on_flush", true);
   bool async_flush      = config.value("async_flush", false);
+  size_t batch_bytes    = config.value("batch_bytes", (size_t)0);
+  double max_batch_age  = config.value("max_batch_age", 0.0);
+  size_t flush_threads  = config.value("flush_threads", (size_t)1);
+  size_t flush_queue_size = config.value("flush_queue_size", (size_t)4);
   std::unique_ptr<Backend> inner =
       BackendFactory::createBackend(backend_type, engine, pool, inner_cfg);
   auto backend = std::make_unique<AggregatorBackend>(std::move(inner), pool,
@@ -34,7 +38,11 @@ std::unique_ptr<Backend> AggregatorBackend::create(const tl::engine &engine,
                                                flush_on_exec,
                                                batch_size,
                                                commit_on_flush,
-                                               async_flush);
+                                               async_flush,
+                                               batch_bytes,
+                                               max_batch_age,
+                                               flush_threads,
+                                               flush_queue_size);
   spdlog::trace("[aggregator] Successfully created database");
   return backend;
 }
@@ -54,6 +62,10 @@ std::unique_ptr<Backend> AggregatorBackend::attach(const thallium::engine &engin
   size_t batch_size     = config.value("batch_size", (size_t)32);
   bool commit_on_flush  = config.value("commit_on_flush", true);
   bool async_flush      = config.value("async_flush", false);
+  size_t batch_bytes    = config.value("batch_bytes", (size_t)0);
+  double max_batch_age  = config.value("max_batch_age", 0.0);
+  size_t flush_threads  = config.value("flush_threads", (size_t)1);
+  size_t flush_queue_size = config.value("flush_queue_size", (size_t)4);
   std::unique_ptr<Backend> inner =
       BackendFactory::attachBackend(backend_type, engine, pool, inner_cfg);
   auto backend = std::make_unique<AggregatorBackend>(std::move(inner), pool,
@@ -61,7 +73,11 @@ std::unique_ptr<Backend> AggregatorBackend::attach(const thallium::engine &engin
                                                flush_on_exec,
                                                batch_size,
                                                commit_on_flush,
-                                               async_flush);
+                                               async_flush,
+                                               batch_bytes,
+                                               max_batch_age,
+                                               flush_threads,
+                                               flush_queue_size);
   spdlog::trace("[aggregator] Successfully opened database");
   return backend;
 }
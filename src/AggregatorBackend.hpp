@@ -9,9 +9,17 @@
 #include "sonata/Admin.hpp"
 #include "sonata/Backend.hpp"
 #include "sonata/Client.hpp"
+#include "FetchMerge.hpp"
+#include "JsonProjection.hpp"
+#include "JsonSize.hpp"
 
+#include <atomic>
+#include <cmath>
 #include <cstdio>
+#include <ctime>
+#include <deque>
 #include <fstream>
+#include <list>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -29,10 +37,23 @@ public:
   AggregatorBackend(std::unique_ptr<Backend> &&inner, const tl::pool &pool,
               bool flush_on_read, bool flush_on_exec,
               size_t batch_size, bool commit_on_flush,
-              bool async_flush)
+              bool async_flush, size_t batch_bytes = 0,
+              double max_batch_age = 0.0, size_t flush_threads = 1,
+              size_t flush_queue_size = 4)
       : m_db(std::move(inner)), m_pool(pool), m_flush_on_read(flush_on_read),
         m_flush_on_exec(flush_on_exec), m_batch_size(batch_size),
-        m_commit_on_flush(commit_on_flush), m_async_flush(async_flush) {}
+        m_commit_on_flush(commit_on_flush), m_async_flush(async_flush),
+        m_batch_bytes(batch_bytes), m_max_batch_age(max_batch_age),
+        m_flush_threads(std::max<size_t>(flush_threads, 1)),
+        m_flush_queue_size(std::max<size_t>(flush_queue_size, 1)) {
+    if (m_max_batch_age > 0.0)
+      m_flushers.push_back(m_pool.make_thread([this]() { flushOldBatches(); }));
+    if (m_async_flush) {
+      for (size_t i = 0; i < m_flush_threads; i++)
+        m_flushers.push_back(
+            m_pool.make_thread([this]() { processFlushQueue(); }));
+    }
+  }
 
   AggregatorBackend(AggregatorBackend &&) = delete;
 
@@ -51,6 +72,14 @@ public:
                                          const json &config);
 
   virtual ~AggregatorBackend() {
+    {
+      std::unique_lock<tl::mutex> lock(m_batches_mtx);
+      m_stopping = true;
+    }
+    m_flusher_cv.notify_all();
+    m_flush_queue_cv.notify_all();
+    for (auto &flusher : m_flushers)
+      flusher->join();
     flush();
   }
 
@@ -79,7 +108,7 @@ public:
   virtual RequestResult<bool>
   dropCollection(const std::string &coll_name) override {
     std::unique_lock<tl::mutex> lock(m_batches_mtx);
-    flush(coll_name, false);
+    flush(lock, coll_name);
     m_batches.erase(coll_name);
     return m_db->dropCollection(coll_name);
   }
@@ -103,43 +132,12 @@ public:
                                             const JsonWrapper &record,
                                             bool commit) override {
     RequestResult<uint64_t> result;
-    result.success() = true;
-    result.value() = std::numeric_limits<uint64_t>::max();
-    std::unique_lock<tl::mutex> lock(m_batches_mtx);
-    auto it = m_batches.find(coll_name);
-    if(it == m_batches.end()) {
-        lock.unlock();
-        auto coll_exists = openCollection(coll_name);
-        lock.lock();
-        if(coll_exists.success()) {
-            it = m_batches.find(coll_name);
-            if(it == m_batches.end()) {
-                result.success() = false;
-                result.error() = "Unexpected error when trying"
-                " to open collection in storeMultiJson";
-                return result;
-            }
-        } else {
-            result.success() = false;
-            result.error() = "Collection does not exist";
-            return result;
-        }
-    }
-    auto& batch = it->second;
-    batch.m_content->push_back(std::move(record.m_object));
-    if((batch.m_content->size() >= m_batch_size) || commit) {
-      auto batch_content = std::move(batch.m_content);
-      batch.reset();
-      auto do_store =
-        [backend = this, coll_name, content = std::move(batch_content), commit]() {
-            PendingWrite pw(*backend);
-            backend->m_db->storeMultiJson(coll_name, content, commit || backend->m_commit_on_flush);
-        };
-      if(m_async_flush)
-          m_pool.make_thread(std::move(do_store), tl::anonymous());
-      else
-          do_store();
-    }
+    auto appended = append(coll_name, &record.m_object, 1,
+                           approximateJsonSize(record.m_object), commit);
+    result.success() = appended.success();
+    result.error() = std::move(appended.error());
+    if (result.success())
+      result.value() = appended.value()[0];
     return result;
   }
 
@@ -177,81 +175,80 @@ public:
       result.success() = false;
       return result;
     }
-    result.success() = true;
-    result.value() = std::vector<uint64_t>(
-        records->size(), std::numeric_limits<uint64_t>::max());
-
-    std::unique_lock<tl::mutex> lock(m_batches_mtx);
-    auto it = m_batches.find(coll_name);
-    if(it == m_batches.end()) {
-        lock.unlock();
-        auto coll_exists = openCollection(coll_name);
-        lock.lock();
-        if(coll_exists.success()) {
-            it = m_batches.find(coll_name);
-            if(it == m_batches.end()) {
-                result.success() = false;
-                result.error() = "Unexpected error when trying"
-                " to open collection in storeMultiJson";
-                return result;
-            }
-        } else {
-            result.success() = false;
-            result.error() = "Collection does not exist";
-            return result;
-        }
-    }
-
-    auto& batch = it->second;
-    batch.m_content->insert(
-        batch.m_content->end(),
-        records->begin(),
-        records->end());
-
-    if((batch.m_content->size() >= m_batch_size) || commit) {
-      auto batch_content = std::move(batch.m_content);
-      batch.reset();
-      auto do_flush =
-        [backend = this, coll_name, content = std::move(batch_content), commit]() {
-            PendingWrite pw(*backend);
-            backend->m_db->storeMultiJson(coll_name, content, commit || backend->m_commit_on_flush);
-        };
-      if(m_async_flush)
-          m_pool.make_thread(std::move(do_flush), tl::anonymous());
-      else
-          do_flush();
-    }
-    return result;
+    return append(coll_name, records->get_ref<const json::array_t &>().data(),
+                  records->size(), approximateJsonSize(records.m_object),
+                  commit);
   }
 
+  bool addsRecordIds() const override { return m_db->addsRecordIds(); }
+
   virtual RequestResult<std::string> fetch(const std::string &coll_name,
                                            uint64_t record_id) override {
-    if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->fetch(coll_name, record_id);
+    json record;
+    if (!fetchPending(coll_name, record_id, record))
+      return m_db->fetch(coll_name, record_id);
+    RequestResult<std::string> result;
+    result.value() = record.dump();
+    return result;
   }
 
   virtual RequestResult<JsonWrapper> fetchJson(const std::string &coll_name,
                                                uint64_t record_id) override {
-    if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->fetchJson(coll_name, record_id);
+    json record;
+    if (!fetchPending(coll_name, record_id, record))
+      return m_db->fetchJson(coll_name, record_id);
+    RequestResult<JsonWrapper> result;
+    result.value() = std::move(record);
+    return result;
   }
 
   virtual RequestResult<std::vector<std::string>>
   fetchMulti(const std::string &coll_name,
              const std::vector<uint64_t> &record_ids) override {
-    if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->fetchMulti(coll_name, record_ids);
+    std::vector<json> pending;
+    std::vector<uint64_t> missing;
+    if (!fetchMultiPending(coll_name, record_ids, pending, missing))
+      return m_db->fetchMulti(coll_name, record_ids);
+    return mergeFetchMulti(*m_db, coll_name, record_ids, pending, missing,
+                           [](uint64_t, const std::string &) {});
   }
 
   virtual RequestResult<JsonWrapper>
   fetchMultiJson(const std::string &coll_name,
                  const std::vector<uint64_t> &record_ids) override {
-    if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->fetchMultiJson(coll_name, record_ids);
+    std::vector<json> pending;
+    std::vector<uint64_t> missing;
+    if (!fetchMultiPending(coll_name, record_ids, pending, missing))
+      return m_db->fetchMultiJson(coll_name, record_ids);
+    return mergeFetchMultiJson(*m_db, coll_name, record_ids, pending, missing,
+                               [](uint64_t, const json &) {});
+  }
+
+  virtual RequestResult<JsonWrapper>
+  fetchJsonProjected(const std::string &coll_name, uint64_t record_id,
+                     const std::vector<std::string> &fields) override {
+    json record;
+    if (!fetchPending(coll_name, record_id, record))
+      return m_db->fetchJsonProjected(coll_name, record_id, fields);
+    JsonProjection(fields).apply(record);
+    RequestResult<JsonWrapper> result;
+    result.value() = std::move(record);
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  fetchMultiJsonProjected(const std::string &coll_name,
+                          const std::vector<uint64_t> &record_ids,
+                          const std::vector<std::string> &fields) override {
+    std::vector<json> pending;
+    std::vector<uint64_t> missing;
+    if (!fetchMultiPending(coll_name, record_ids, pending, missing))
+      return m_db->fetchMultiJsonProjected(coll_name, record_ids, fields);
+    auto result = mergeFetchMultiJson(*m_db, coll_name, record_ids, pending,
+                                      missing, [](uint64_t, const json &) {});
+    if (result.success())
+      JsonProjection(fields).applyToArray(result.value().m_object);
+    return result;
   }
 
   virtual RequestResult<std::vector<std::string>>
@@ -270,6 +267,48 @@ public:
     return m_db->filterJson(coll_name, filter_code);
   }
 
+  virtual RequestResult<JsonWrapper>
+  filterJsonProjected(const std::string &coll_name,
+                      const std::string &filter_code,
+                      const std::vector<std::string> &fields) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->filterJsonProjected(coll_name, filter_code, fields);
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name,
+                  const JsonWrapper &predicate) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->filterPredicate(coll_name, predicate);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->filterPredicateJson(coll_name, predicate);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJsonProjected(const std::string &coll_name,
+                               const JsonWrapper &predicate,
+                               const std::vector<std::string> &fields) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->filterPredicateJsonProjected(coll_name, predicate, fields);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name,
+            const JsonWrapper &pipeline) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->aggregate(coll_name, pipeline);
+  }
+
   virtual RequestResult<bool> update(const std::string &coll_name,
                                      uint64_t record_id,
                                      const std::string &new_content,
@@ -319,17 +358,48 @@ public:
     return m_db->allJson(coll_name);
   }
 
+  virtual RequestResult<JsonWrapper>
+  allJsonProjected(const std::string &coll_name,
+                   const std::vector<std::string> &fields) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->allJsonProjected(coll_name, fields);
+  }
+
   virtual RequestResult<uint64_t>
   lastID(const std::string &coll_name) override {
+    // the ids of the pending records are reserved in the inner backend,
+    // only the records that could not get one need to be flushed first
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
     if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->lastID(coll_name);
+      readableBatch(lock, coll_name);
+    // the ids reserved but not handed out yet are the last ones of the
+    // inner backend, they should not be counted
+    auto result = m_db->lastID(coll_name);
+    auto it = m_batches.find(coll_name);
+    if (result.success() && it != m_batches.end())
+      result.value() -= it->second.m_end_id - it->second.m_next_id;
+    return result;
   }
 
   virtual RequestResult<size_t> size(const std::string &coll_name) override {
-    if (m_flush_on_read)
-      flush(coll_name);
-    return m_db->size(coll_name);
+    // pending records are those of the batch and those of m_flushing that
+    // have not been written yet; the lock prevents records from moving
+    // from the former to the latter while the inner backend is queried
+    // (a record whose write completes during the query, before being
+    // marked as written, may however be counted twice)
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    auto result = m_db->size(coll_name);
+    auto it = m_batches.find(coll_name);
+    if (!result.success() || it == m_batches.end())
+      return result;
+    auto &batch = it->second;
+    result.value() += batch.m_content->size();
+    for (auto &records : batch.m_flushing) {
+      if (!records->m_written)
+        result.value() += records->m_content->size();
+    }
+    return result;
   }
 
   virtual RequestResult<bool> erase(const std::string &coll_name,
@@ -347,6 +417,33 @@ public:
     return m_db->eraseMulti(coll_name, record_ids, commit);
   }
 
+  virtual RequestResult<bool> createIndex(const std::string &coll_name,
+                                          const std::string &field) override {
+    flush(coll_name);
+    return m_db->createIndex(coll_name, field);
+  }
+
+  virtual RequestResult<bool> dropIndex(const std::string &coll_name,
+                                        const std::string &field) override {
+    return m_db->dropIndex(coll_name, field);
+  }
+
+  virtual RequestResult<std::vector<uint64_t>>
+  queryIndex(const std::string &coll_name, const std::string &field,
+             const JsonWrapper &lower, const JsonWrapper &upper) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->queryIndex(coll_name, field, lower, upper);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  queryIndexJson(const std::string &coll_name, const std::string &field,
+                 const JsonWrapper &lower, const JsonWrapper &upper) override {
+    if (m_flush_on_read)
+      flush(coll_name);
+    return m_db->queryIndexJson(coll_name, field, lower, upper);
+  }
+
   virtual RequestResult<std::unordered_map<std::string, std::string>>
   execute(const std::string &code, const std::unordered_set<std::string> &vars,
           bool commit) override {
@@ -366,23 +463,379 @@ public:
            ",\"commit_on_flush\":"s + (m_commit_on_flush ? "true" : "false") +
            ",\"batch_size\":"s + std::to_string(m_batch_size) +
            ",\"async_flush\":"s + (m_async_flush ? "true" : "false") +
+           ",\"batch_bytes\":"s + std::to_string(m_batch_bytes) +
+           ",\"max_batch_age\":"s + std::to_string(m_max_batch_age) +
+           ",\"flush_threads\":"s + std::to_string(m_flush_threads) +
+           ",\"flush_queue_size\":"s + std::to_string(m_flush_queue_size) +
            ",\"config\":" + m_db->getConfig() + "}";
   }
 
 private:
-  void flush(const std::string &coll_name = "", bool use_lock=true) {
-    std::unique_lock<tl::mutex> lock;
-    if(use_lock)
-        lock = std::unique_lock<tl::mutex>(m_batches_mtx);
+  struct Records {
+    JsonWrapper m_content;
+    std::vector<uint64_t> m_ids; // reserved ids (or max uint64_t)
+    std::unordered_map<uint64_t, size_t> m_index; // reserved id -> position
+    // set once the records have been written to the inner backend
+    mutable std::atomic<bool> m_written{false};
+    Records() { m_content = json::array(); }
+    const json *find(uint64_t id) const {
+      auto it = m_index.find(id);
+      return it == m_index.end() ? nullptr : &m_content.m_object[it->second];
+    }
+    bool indexed() const { return m_index.size() == m_ids.size(); }
+  };
+
+  struct Batch : Records {
+    size_t m_size = 0;    // approximate size in bytes of the content
+    double m_start = 0.0; // time at which the first record was added
+    // records of this collection being written by flushBatch
+    std::list<std::shared_ptr<const Records>> m_flushing;
+    // ids reserved in the inner backend and not handed out yet
+    uint64_t m_next_id = 0;
+    uint64_t m_end_id = 0;
+    void reset() {
+        m_content = json::array();
+        m_ids.clear();
+        m_index.clear();
+        m_size = 0;
+    }
+  };
+
+  // Adds records to the batch of the collection, and flushes the batch
+  // if it reaches batch_size records or batch_bytes bytes (bytes being
+  // the approximate size of the records), or if commit is requested.
+  // The ids of the records are reserved in the inner backend, so that
+  // they can be returned right away. If the inner backend does not
+  // support reservations, the returned ids are max uint64_t.
+  RequestResult<std::vector<uint64_t>>
+  append(const std::string &coll_name, const json *records, size_t count,
+         size_t bytes, bool commit) {
+    RequestResult<std::vector<uint64_t>> result;
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    auto it = m_batches.find(coll_name);
+    if(it == m_batches.end()) {
+        lock.unlock();
+        auto coll_exists = openCollection(coll_name);
+        lock.lock();
+        if(coll_exists.success()) {
+            it = m_batches.find(coll_name);
+            if(it == m_batches.end()) {
+                result.success() = false;
+                result.error() = "Unexpected error when trying"
+                " to open collection in storeMultiJson";
+                return result;
+            }
+        } else {
+            result.success() = false;
+            result.error() = "Collection does not exist";
+            return result;
+        }
+    }
+    auto& batch = it->second;
+    uint64_t first_id = 0;
+    bool reserved = count != 0 && takeIds(coll_name, batch, count, first_id);
+    for(size_t i = 0; i < count; i++)
+      result.value().push_back(reserved
+                               ? first_id + i
+                               : std::numeric_limits<uint64_t>::max());
+    if(batch.m_content->empty() && count != 0)
+      batch.m_start = tl::timer::wtime();
+    for(size_t i = 0; i < count; i++) {
+      if(reserved)
+        batch.m_index[result.value()[i]] = batch.m_content->size();
+      batch.m_content->push_back(records[i]);
+    }
+    batch.m_ids.insert(batch.m_ids.end(), result.value().begin(),
+                       result.value().end());
+    batch.m_size += bytes;
+    if((batch.m_content->size() >= m_batch_size)
+    || (m_batch_bytes != 0 && batch.m_size >= m_batch_bytes)
+    || commit)
+      flushBatch(lock, coll_name, batch, commit);
+    return result;
+  }
+
+  // Takes count ids from the block of ids reserved in the inner backend
+  // for the collection (to be called with m_batches_mtx held). If the
+  // block does not have enough ids left, a new block of at least
+  // batch_size ids is reserved; the ids left in the previous one are
+  // never used. Returns false if the inner backend does not support
+  // reservations.
+  bool takeIds(const std::string &coll_name, Batch &batch, size_t count,
+               uint64_t &first_id) {
+    if (batch.m_end_id - batch.m_next_id < count) {
+      size_t block_size = std::max(count, m_batch_size);
+      auto reserved = m_db->reserveIds(coll_name, block_size);
+      if (!reserved.success())
+        return false;
+      batch.m_next_id = reserved.value();
+      batch.m_end_id = reserved.value() + block_size;
+    }
+    first_id = batch.m_next_id;
+    batch.m_next_id += count;
+    return true;
+  }
+
+  // Records of a batch waiting in the flush queue.
+  struct FlushTask {
+    std::string m_coll_name;
+    std::shared_ptr<const Records> m_records;
+    bool m_commit = false;
+  };
+
+  // Sends the content of a batch to the inner backend, through the flush
+  // queue if async_flush is set, in which case the caller waits for room
+  // if the queue is full. The records are kept in m_flushing until they are
+  // written so that they can still be read, and the write is accounted for
+  // in m_pending_writes so that flush() waits for it.
+  void flushBatch(std::unique_lock<tl::mutex> &lock,
+                  const std::string &coll_name, Batch &batch, bool commit) {
+    auto records = std::make_shared<Records>();
+    records->m_content = std::move(batch.m_content);
+    records->m_ids = std::move(batch.m_ids);
+    records->m_index = std::move(batch.m_index);
+    batch.reset();
+    batch.m_flushing.push_back(records);
+    FlushTask task;
+    task.m_coll_name = coll_name;
+    task.m_records = std::move(records);
+    task.m_commit = commit || m_commit_on_flush;
+    m_pending_writes += 1;
+    if(m_async_flush) {
+      m_flush_space_cv.wait(lock, [this]() {
+        return m_flush_queue.size() < m_flush_queue_size;
+      });
+      m_flush_queue.push_back(std::move(task));
+      m_flush_queue_cv.notify_one();
+    } else {
+      runFlushTask(lock, task);
+    }
+  }
+
+  // Writes the records of a task to the inner backend and commits them if
+  // requested, releasing the lock meanwhile, then removes them from
+  // m_flushing.
+  void runFlushTask(std::unique_lock<tl::mutex> &lock, const FlushTask &task) {
+    lock.unlock();
+    writeRecords(task.m_coll_name, *task.m_records);
+    task.m_records->m_written = true;
+    if(task.m_commit)
+      m_db->commit();
+    lock.lock();
+    auto it = m_batches.find(task.m_coll_name);
+    if(it != m_batches.end())
+      it->second.m_flushing.remove(task.m_records);
+    m_pending_writes -= 1;
+    if(m_pending_writes == 0)
+      m_batches_cv.notify_all();
+  }
+
+  // Body of the flusher ULTs when async_flush is set, which write the
+  // batches queued by flushBatch. They exit when the backend is destroyed,
+  // once the queue is empty.
+  void processFlushQueue() {
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    while(true) {
+      m_flush_queue_cv.wait(lock, [this]() {
+        return m_stopping || !m_flush_queue.empty();
+      });
+      if(m_flush_queue.empty())
+        return;
+      auto task = std::move(m_flush_queue.front());
+      m_flush_queue.pop_front();
+      m_flush_space_cv.notify_one();
+      runFlushTask(lock, task);
+    }
+  }
+
+  // Writes the batches that are in the flush queue from the calling thread
+  // rather than waiting for the flushers, then waits for the writes that
+  // are still in progress.
+  void drainFlushQueue(std::unique_lock<tl::mutex> &lock) {
+    size_t queued = m_flush_queue.size();
+    for(size_t i = 0; i < queued && !m_flush_queue.empty(); i++) {
+      auto task = std::move(m_flush_queue.front());
+      m_flush_queue.pop_front();
+      m_flush_space_cv.notify_one();
+      runFlushTask(lock, task);
+    }
     m_batches_cv.wait(lock, [this]() { return m_pending_writes == 0; });
+  }
+
+  // Body of the age flusher ULT, which flushes the batches that are older
+  // than max_batch_age, sleeping until the oldest batch reaches this age.
+  void flushOldBatches() {
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    while(!m_stopping) {
+      double now = tl::timer::wtime();
+      double next_deadline = now + m_max_batch_age;
+      std::vector<std::string> expired;
+      for(auto& p : m_batches) {
+        if(p.second.m_content->empty())
+          continue;
+        double deadline = p.second.m_start + m_max_batch_age;
+        if(deadline <= now)
+          expired.push_back(p.first);
+        else
+          next_deadline = std::min(next_deadline, deadline);
+      }
+      // the lock is released by flushBatch, so batches are looked up again
+      for(auto& coll_name : expired) {
+        auto it = m_batches.find(coll_name);
+        if(it == m_batches.end() || it->second.m_content->empty()
+        || it->second.m_start + m_max_batch_age > now)
+          continue;
+        flushBatch(lock, coll_name, it->second, false);
+      }
+      if(!expired.empty())
+        continue;
+      double delay = std::max(0.0, next_deadline - tl::timer::wtime());
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += static_cast<time_t>(delay);
+      deadline.tv_nsec += static_cast<long>((delay - std::floor(delay)) * 1e9);
+      if(deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      m_flusher_cv.wait_until(lock, &deadline);
+    }
+  }
+
+  // Writes the records of a batch to the inner backend, with storeReserved
+  // for the records that have a reserved id and storeMultiJson for the
+  // others, preserving their order, without committing them.
+  void writeRecords(const std::string &coll_name, const Records &records) {
+    static constexpr auto no_id = std::numeric_limits<uint64_t>::max();
+    auto& content = records.m_content;
+    auto& ids = records.m_ids;
+    size_t count = content->size();
+    for(size_t begin = 0, end = 0; begin < count; begin = end) {
+      bool reserved = ids[begin] != no_id;
+      end = begin + 1;
+      while(end < count && (ids[end] != no_id) == reserved)
+        end += 1;
+      JsonWrapper run;
+      if(begin != 0 || end != count) {
+        run = json::array();
+        for(size_t i = begin; i < end; i++)
+          run->push_back(content.m_object[i]);
+      }
+      auto& to_store = (begin == 0 && end == count) ? content : run;
+      std::string error;
+      if(reserved) {
+        auto result = m_db->storeReserved(
+            coll_name,
+            std::vector<uint64_t>(ids.begin() + begin, ids.begin() + end),
+            to_store, false);
+        if(!result.success())
+          error = std::move(result.error());
+      } else {
+        auto result = m_db->storeMultiJson(coll_name, to_store, false);
+        if(!result.success())
+          error = std::move(result.error());
+      }
+      if(!error.empty())
+        spdlog::error("[aggregator] Could not flush batch of collection {}: {}",
+                      coll_name, error);
+    }
+  }
+
+  // Returns the batch of the collection (nullptr if there is none) for
+  // reading pending records from it. If flush_on_read is set and some
+  // pending records have no reserved id (and hence can't be found by id),
+  // they are flushed first.
+  Batch *readableBatch(std::unique_lock<tl::mutex> &lock,
+                       const std::string &coll_name) {
+    auto it = m_batches.find(coll_name);
+    if(it == m_batches.end())
+      return nullptr;
+    if(m_flush_on_read) {
+      bool indexed = it->second.indexed();
+      for(auto& records : it->second.m_flushing)
+        indexed = indexed && records->indexed();
+      if(!indexed) {
+        flush(lock, coll_name);
+        it = m_batches.find(coll_name);
+        if(it == m_batches.end())
+          return nullptr;
+      }
+    }
+    return &it->second;
+  }
+
+  // Looks up a record that has not been written to the inner backend
+  // yet, in the batch of its collection or in the records being flushed.
+  static const json *findPending(const Batch &batch, uint64_t record_id) {
+    auto record = batch.find(record_id);
+    for(auto it = batch.m_flushing.begin();
+        !record && it != batch.m_flushing.end(); ++it)
+      record = (*it)->find(record_id);
+    return record;
+  }
+
+  // Copies a pending record into record, adding its id if the inner
+  // backend does. Returns false if the record is not pending.
+  bool fetchPending(const std::string &coll_name, uint64_t record_id,
+                    json &record) {
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    auto batch = readableBatch(lock, coll_name);
+    auto found = batch ? findPending(*batch, record_id) : nullptr;
+    if(!found)
+      return false;
+    record = *found;
+    if(record.is_object() && m_db->addsRecordIds())
+      record["__id"] = record_id;
+    return true;
+  }
+
+  // Same as above for multiple records: pending[i] is set to the record
+  // with id record_ids[i] if it is pending (and is discarded otherwise),
+  // and the ids of the other records are added to missing, in order.
+  // Returns false if none of the records is pending.
+  bool fetchMultiPending(const std::string &coll_name,
+                         const std::vector<uint64_t> &record_ids,
+                         std::vector<json> &pending,
+                         std::vector<uint64_t> &missing) {
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    auto batch = readableBatch(lock, coll_name);
+    if(!batch)
+      return false;
+    pending.assign(record_ids.size(), json(json::value_t::discarded));
+    bool adds_ids = m_db->addsRecordIds();
+    bool found_any = false;
+    for(size_t i = 0; i < record_ids.size(); i++) {
+      auto found = findPending(*batch, record_ids[i]);
+      if(!found) {
+        missing.push_back(record_ids[i]);
+        continue;
+      }
+      found_any = true;
+      pending[i] = *found;
+      if(pending[i].is_object() && adds_ids)
+        pending[i]["__id"] = record_ids[i];
+    }
+    return found_any;
+  }
+
+  void flush(const std::string &coll_name = "") {
+    std::unique_lock<tl::mutex> lock(m_batches_mtx);
+    flush(lock, coll_name);
+  }
+
+  void flush(std::unique_lock<tl::mutex> &lock,
+             const std::string &coll_name = "") {
+    drainFlushQueue(lock);
+    bool written = false;
     if(coll_name.empty()) {
       for(auto& p : m_batches) {
         auto& coll = p.first;
         auto& batch = p.second;
         if(batch.m_content->empty())
           continue;
-        m_db->storeMultiJson(coll, batch.m_content, m_commit_on_flush);
+        writeRecords(coll, batch);
         batch.reset();
+        written = true;
       }
     } else {
       auto it = m_batches.find(coll_name);
@@ -391,24 +844,23 @@ private:
       auto& batch = it->second;
       if(batch.m_content->empty())
         return;
-      m_db->storeMultiJson(coll_name, batch.m_content, m_commit_on_flush);
+      writeRecords(coll_name, batch);
       batch.reset();
+      written = true;
     }
+    if(written && m_commit_on_flush)
+      m_db->commit();
   }
 
-  struct Batch {
-    JsonWrapper m_content;
-    Batch() { m_content = json::array(); }
-    void reset() {
-        m_content = json::array();
-    }
-  };
-
   bool m_flush_on_read   = true;
   bool m_flush_on_exec   = true;
   bool m_commit_on_flush = true;
   size_t m_batch_size    = 32;
   bool m_async_flush     = false;
+  size_t m_batch_bytes   = 0;
+  double m_max_batch_age = 0.0;
+  size_t m_flush_threads    = 1;
+  size_t m_flush_queue_size = 4;
 
   std::unique_ptr<Backend> m_db;
   tl::pool m_pool;
@@ -416,27 +868,12 @@ private:
   tl::mutex m_batches_mtx;
   tl::condition_variable m_batches_cv;
   uint64_t m_pending_writes = 0;
-
-  struct PendingWrite {
-
-    AggregatorBackend &m_backend;
-
-    PendingWrite(AggregatorBackend &backend) : m_backend(backend) {
-      std::unique_lock<tl::mutex> lock(m_backend.m_batches_mtx);
-      m_backend.m_pending_writes += 1;
-    }
-
-    ~PendingWrite() {
-      bool notify = false;
-      {
-        std::unique_lock<tl::mutex> lock(m_backend.m_batches_mtx);
-        m_backend.m_pending_writes -= 1;
-        notify = m_backend.m_pending_writes == 0;
-      }
-      if (notify)
-        m_backend.m_batches_cv.notify_all();
-    }
-  };
+  bool m_stopping = false;
+  tl::condition_variable m_flusher_cv;
+  std::vector<tl::managed<tl::thread>> m_flushers;
+  std::deque<FlushTask> m_flush_queue;
+  tl::condition_variable m_flush_queue_cv; // a task was queued, or stopping
+  tl::condition_variable m_flush_space_cv; // a task was dequeued
 };
 
 } // namespace sonata
@@ -22,7 +22,7 @@ AsyncRequest::AsyncRequest(AsyncRequest &&other) {
 }
 
 AsyncRequest::~AsyncRequest() {
-  if (self && self.unique()) {
+  if (self && self.unique() && !self->m_waited) {
     wait();
   }
 }
@@ -30,7 +30,7 @@ AsyncRequest::~AsyncRequest() {
 AsyncRequest &AsyncRequest::operator=(const AsyncRequest &other) {
   if (this == &other || self == other.self)
     return *this;
-  if (self && self.unique()) {
+  if (self && self.unique() && !self->m_waited) {
     wait();
   }
   self = other.self;
@@ -40,7 +40,7 @@ AsyncRequest &AsyncRequest::operator=(const AsyncRequest &other) {
 AsyncRequest &AsyncRequest::operator=(AsyncRequest &&other) {
   if (this == &other || self == other.self)
     return *this;
-  if (self && self.unique()) {
+  if (self && self.unique() && !self->m_waited) {
     wait();
   }
   self = std::move(other.self);
@@ -48,23 +48,157 @@ AsyncRequest &AsyncRequest::operator=(AsyncRequest &&other) {
   return *this;
 }
 
+namespace {
+
+// Converts the result of a completed (or to be waited on) request and calls
+// its continuations, recording any error so that wait() can rethrow it.
+void finish(AsyncRequestImpl &impl) {
+  if (impl.m_waited)
+    return;
+  // the callback waits on the underlying RPC, which can only be done once
+  impl.m_waited = true;
+  try {
+    impl.m_wait_callback(impl);
+    for (auto &continuation : impl.m_continuations)
+      continuation();
+  } catch (...) {
+    impl.m_error = std::current_exception();
+  }
+  impl.m_continuations.clear();
+}
+
+} // namespace
+
 void AsyncRequest::wait() const {
   if (not self)
     throw Exception("Invalid sonata::AsyncRequest object");
-  if (self->m_waited)
-    return;
-  self->m_wait_callback(*self);
-  self->m_waited = true;
+  finish(*self);
+  if (self->m_error)
+    std::rethrow_exception(self->m_error);
 }
 
 bool AsyncRequest::completed() const {
   if (not self)
     throw Exception("Invalid sonata::AsyncRequest object");
-  return self->m_async_response.received();
+  if (self->m_waited)
+    return true;
+  bool done = self->m_async_response ? self->m_async_response->received()
+                                     : self->m_completed_callback();
+  if (done)
+    finish(*self);
+  return done;
+}
+
+const AsyncRequest &
+AsyncRequest::then(std::function<void()> callback) const {
+  if (not self)
+    throw Exception("Invalid sonata::AsyncRequest object");
+  if (not self->m_waited) {
+    self->m_continuations.push_back(std::move(callback));
+  } else if (not self->m_error) {
+    try {
+      callback();
+    } catch (...) {
+      self->m_error = std::current_exception();
+    }
+  }
+  return *this;
+}
+
+void AsyncRequest::wait_all(const std::vector<AsyncRequest> &requests) {
+  std::exception_ptr error;
+  for (auto &request : requests) {
+    if (not request)
+      continue;
+    try {
+      request.wait();
+    } catch (...) {
+      if (not error)
+        error = std::current_exception();
+    }
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+size_t AsyncRequest::wait_any(const std::vector<AsyncRequest> &requests) {
+  while (true) {
+    bool any_valid = false;
+    for (size_t i = 0; i < requests.size(); i++) {
+      if (not requests[i])
+        continue;
+      any_valid = true;
+      if (requests[i].completed()) {
+        requests[i].wait();
+        return i;
+      }
+    }
+    if (not any_valid)
+      throw Exception("No valid sonata::AsyncRequest to wait on");
+    // let the progress loop (and other ULTs) run
+    tl::thread::yield();
+  }
 }
 
 AsyncRequest::operator bool() const {
     return static_cast<bool>(self);
 }
 
+AsyncRequestWindow::AsyncRequestWindow(size_t max_in_flight)
+    : m_requests(max_in_flight) {
+  if (max_in_flight == 0)
+    throw Exception("AsyncRequestWindow should allow at least one request");
+}
+
+AsyncRequestWindow::~AsyncRequestWindow() {
+  try {
+    wait_all();
+  } catch (...) {
+  }
+}
+
+AsyncRequest *AsyncRequestWindow::next() {
+  // m_requests is never resized, so the pointers handed out remain valid;
+  // a completed request is moved out of its slot before being waited on,
+  // so that a failed request is removed from the window even if it throws
+  AsyncRequest *free_slot = nullptr;
+  for (auto &request : m_requests) {
+    if (request && request.completed()) {
+      AsyncRequest done = std::move(request);
+      done.wait();
+    }
+    if (not request && not free_slot)
+      free_slot = &request;
+  }
+  while (not free_slot) {
+    // let the progress loop (and other ULTs) run
+    tl::thread::yield();
+    for (auto &request : m_requests) {
+      if (request.completed()) {
+        AsyncRequest done = std::move(request);
+        done.wait();
+        free_slot = &request;
+        break;
+      }
+    }
+  }
+  return free_slot;
+}
+
+void AsyncRequestWindow::wait_all() {
+  std::vector<AsyncRequest> requests;
+  requests.swap(m_requests);
+  m_requests.resize(requests.size());
+  AsyncRequest::wait_all(requests);
+}
+
+size_t AsyncRequestWindow::size() const {
+  size_t count = 0;
+  for (auto &request : m_requests) {
+    if (request)
+      count += 1;
+  }
+  return count;
+}
+
 } // namespace sonata
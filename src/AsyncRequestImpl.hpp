@@ -6,7 +6,10 @@
 #ifndef __SONATA_ASYNC_REQUEST_IMPL_H
 #define __SONATA_ASYNC_REQUEST_IMPL_H
 
+#include <exception>
 #include <functional>
+#include <memory>
+#include <vector>
 #include <thallium.hpp>
 
 namespace sonata {
@@ -16,11 +19,20 @@ namespace tl = thallium;
 struct AsyncRequestImpl {
 
   AsyncRequestImpl(tl::async_response &&async_response)
-      : m_async_response(std::move(async_response)) {}
+      : m_async_response(
+            std::make_unique<tl::async_response>(std::move(async_response))) {}
 
-  tl::async_response m_async_response;
+  // request that is not tied to a single RPC, whose completion
+  // is tested by the provided function instead
+  AsyncRequestImpl(std::function<bool()> completed_callback)
+      : m_completed_callback(std::move(completed_callback)) {}
+
+  std::unique_ptr<tl::async_response> m_async_response;
   bool m_waited = false;
+  std::exception_ptr m_error; // rethrown by subsequent calls to wait()
   std::function<void(AsyncRequestImpl &)> m_wait_callback;
+  std::function<bool()> m_completed_callback;
+  std::vector<std::function<void()>> m_continuations; // see then()
 };
 
 } // namespace sonata
@@ -4,6 +4,9 @@
  * See COPYRIGHT in top-level directory.
  */
 #include "sonata/Backend.hpp"
+#include "JsonAggregation.hpp"
+#include "JsonPredicate.hpp"
+#include "JsonProjection.hpp"
 
 namespace tl = thallium;
 using nlohmann::json;
@@ -42,4 +45,130 @@ BackendFactory::attachBackend(const std::string &backend_name,
   return f(engine, pool, config);
 }
 
+RequestResult<uint64_t> Backend::reserveIds(const std::string &coll_name,
+                                            size_t count) {
+  RequestResult<uint64_t> result;
+  result.success() = false;
+  result.error() = "Backend does not support reserving record ids";
+  return result;
+}
+
+RequestResult<bool> Backend::storeReserved(
+    const std::string &coll_name, const std::vector<uint64_t> &record_ids,
+    const JsonWrapper &records, bool commit) {
+  RequestResult<bool> result;
+  result.success() = false;
+  result.error() = "Backend does not support reserving record ids";
+  return result;
+}
+
+bool Backend::addsRecordIds() const { return false; }
+
+RequestResult<JsonWrapper>
+Backend::fetchJsonProjected(const std::string &coll_name, uint64_t record_id,
+                            const std::vector<std::string> &fields) {
+  auto result = fetchJson(coll_name, record_id);
+  if (result.success())
+    JsonProjection(fields).apply(result.value().m_object);
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::fetchMultiJsonProjected(const std::string &coll_name,
+                                 const std::vector<uint64_t> &record_ids,
+                                 const std::vector<std::string> &fields) {
+  auto result = fetchMultiJson(coll_name, record_ids);
+  if (result.success())
+    JsonProjection(fields).applyToArray(result.value().m_object);
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::filterJsonProjected(const std::string &coll_name,
+                             const std::string &filter_code,
+                             const std::vector<std::string> &fields) {
+  auto result = filterJson(coll_name, filter_code);
+  if (result.success())
+    JsonProjection(fields).applyToArray(result.value().m_object);
+  return result;
+}
+
+RequestResult<std::vector<std::string>>
+Backend::filterPredicate(const std::string &coll_name,
+                         const JsonWrapper &predicate) {
+  RequestResult<std::vector<std::string>> result;
+  auto records = filterPredicateJson(coll_name, predicate);
+  if (!records.success()) {
+    result.success() = false;
+    result.error() = std::move(records.error());
+    return result;
+  }
+  result.value().reserve(records.value()->size());
+  for (auto &record : records.value().m_object)
+    result.value().push_back(record.dump());
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::filterPredicateJson(const std::string &coll_name,
+                             const JsonWrapper &predicate) {
+  RequestResult<JsonWrapper> result;
+  JsonPredicate pred;
+  try {
+    pred = JsonPredicate(predicate.m_object);
+  } catch (const Exception &e) {
+    result.success() = false;
+    result.error() = e.what();
+    return result;
+  }
+  auto records = allJson(coll_name);
+  if (!records.success())
+    return records;
+  result.value() = json::array();
+  for (auto &record : records.value().m_object) {
+    if (pred(record))
+      result.value()->push_back(std::move(record));
+  }
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::filterPredicateJsonProjected(const std::string &coll_name,
+                                      const JsonWrapper &predicate,
+                                      const std::vector<std::string> &fields) {
+  auto result = filterPredicateJson(coll_name, predicate);
+  if (result.success())
+    JsonProjection(fields).applyToArray(result.value().m_object);
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::allJsonProjected(const std::string &coll_name,
+                          const std::vector<std::string> &fields) {
+  auto result = allJson(coll_name);
+  if (result.success())
+    JsonProjection(fields).applyToArray(result.value().m_object);
+  return result;
+}
+
+RequestResult<JsonWrapper>
+Backend::aggregate(const std::string &coll_name, const JsonWrapper &pipeline) {
+  RequestResult<JsonWrapper> result;
+  JsonAggregation aggregation;
+  try {
+    aggregation = JsonAggregation(pipeline.m_object);
+  } catch (const Exception &e) {
+    result.success() = false;
+    result.error() = e.what();
+    return result;
+  }
+  auto records = allJson(coll_name);
+  if (!records.success())
+    return records;
+  for (auto &record : records.value().m_object)
+    aggregation.add(record);
+  result.value() = aggregation.result();
+  return result;
+}
+
 } // namespace sonata
@@ -0,0 +1,193 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "sonata/Batch.hpp"
+#include "sonata/Exception.hpp"
+#include "sonata/JsonSerialize.hpp"
+#include "sonata/RequestResult.hpp"
+
+#include "AsyncRequestImpl.hpp"
+#include "BatchImpl.hpp"
+#include "ClientImpl.hpp"
+#include "CollectionImpl.hpp"
+#include "DatabaseImpl.hpp"
+
+#include <thallium/serialization/stl/vector.hpp>
+#include <thallium/serialization/stl/string.hpp>
+
+namespace sonata {
+
+namespace {
+
+// Adds an operation on the collection to the batch, binding the batch
+// to the collection's provider if it is empty, and returns the operation
+// and its output so that the caller can fill them.
+std::pair<BatchOperation &, BatchImpl::Output &>
+addOperation(BatchImpl &batch, const std::shared_ptr<CollectionImpl> &coll,
+             BatchOperation::Type type) {
+  if (not coll)
+    throw Exception("Invalid sonata::Collection object");
+  auto &db = coll->m_database;
+  if (batch.m_operations.empty()) {
+    batch.m_client = db->m_client;
+    batch.m_ph = db->m_ph;
+    batch.m_address = static_cast<std::string>(db->m_ph);
+    batch.m_last_database = db.get();
+  } else if (db.get() != batch.m_last_database) {
+    if (db->m_client != batch.m_client ||
+        db->m_ph.provider_id() != batch.m_ph.provider_id() ||
+        static_cast<std::string>(db->m_ph) != batch.m_address)
+      throw Exception("All the operations of a batch should target "
+                      "the same provider");
+    batch.m_last_database = db.get();
+  }
+  batch.m_operations.emplace_back();
+  batch.m_outputs.emplace_back();
+  auto &op = batch.m_operations.back();
+  op.m_type = type;
+  op.m_db_name = db->m_name;
+  op.m_coll_name = coll->m_name;
+  return {op, batch.m_outputs.back()};
+}
+
+} // namespace
+
+Batch::Batch() : self(std::make_shared<BatchImpl>()) {}
+
+Batch::Batch(const Batch &) = default;
+
+Batch::Batch(Batch &&) = default;
+
+Batch &Batch::operator=(const Batch &) = default;
+
+Batch &Batch::operator=(Batch &&) = default;
+
+Batch::~Batch() = default;
+
+Batch::operator bool() const { return static_cast<bool>(self); }
+
+size_t Batch::size() const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  return self->m_operations.size();
+}
+
+void Batch::store(const Collection &coll, const std::string &record,
+                  uint64_t *id) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::Store);
+  added.first.m_record = record;
+  added.second.m_id = id;
+}
+
+void Batch::store(const Collection &coll, const json &record,
+                  uint64_t *id) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::StoreJson);
+  added.first.m_json = record;
+  added.second.m_id = id;
+}
+
+void Batch::update(const Collection &coll, uint64_t id,
+                   const std::string &record, bool *updated) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::Update);
+  added.first.m_record_id = id;
+  added.first.m_record = record;
+  added.second.m_updated = updated;
+}
+
+void Batch::update(const Collection &coll, uint64_t id, const json &record,
+                   bool *updated) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::UpdateJson);
+  added.first.m_record_id = id;
+  added.first.m_json = record;
+  added.second.m_updated = updated;
+}
+
+void Batch::erase(const Collection &coll, uint64_t id) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::Erase);
+  added.first.m_record_id = id;
+}
+
+void Batch::fetch(const Collection &coll, uint64_t id,
+                  std::string *record) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::Fetch);
+  added.first.m_record_id = id;
+  added.second.m_record = record;
+}
+
+void Batch::fetch(const Collection &coll, uint64_t id, json *record) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  auto added = addOperation(*self, coll.self, BatchOperation::FetchJson);
+  added.first.m_record_id = id;
+  added.second.m_json = record;
+}
+
+void Batch::execute(bool commit, AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Batch object");
+  if (self->m_operations.empty()) {
+    if (req)
+      *req = AsyncRequest();
+    return;
+  }
+  auto &rpc = self->m_client->m_batch;
+  auto async_response = rpc.on(self->m_ph).async(self->m_operations, commit);
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  auto outputs = std::make_shared<std::vector<BatchImpl::Output>>(
+      std::move(self->m_outputs));
+  self->m_operations.clear();
+  self->m_outputs.clear();
+  self->m_client.reset();
+  self->m_last_database = nullptr;
+  async_request_impl->m_wait_callback =
+      [outputs](AsyncRequestImpl &async_request_impl) {
+        RequestResult<std::vector<BatchOperationResult>> result =
+            async_request_impl.m_async_response->wait();
+        if (not result.success())
+          throw Exception(result.error());
+        auto &results = result.value();
+        if (results.size() != outputs->size())
+          throw Exception("Invalid number of results received for batch");
+        std::string error;
+        for (size_t i = 0; i < results.size(); i++) {
+          auto &r = results[i];
+          auto &out = (*outputs)[i];
+          if (not r.m_success) {
+            if (error.empty())
+              error = std::move(r.m_error);
+            continue;
+          }
+          if (out.m_id)
+            *out.m_id = r.m_record_id;
+          if (out.m_updated)
+            *out.m_updated = r.m_updated;
+          if (out.m_record)
+            *out.m_record = std::move(r.m_record);
+          if (out.m_json)
+            *out.m_json = std::move(r.m_json.m_object);
+        }
+        if (not error.empty())
+          throw Exception(error);
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+} // namespace sonata
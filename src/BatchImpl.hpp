@@ -0,0 +1,48 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BATCH_IMPL_H
+#define __SONATA_BATCH_IMPL_H
+
+#include "BatchOperation.hpp"
+
+#include <nlohmann/json.hpp>
+#include <thallium.hpp>
+#include <vector>
+
+namespace sonata {
+
+namespace tl = thallium;
+using nlohmann::json;
+
+class ClientImpl;
+class DatabaseImpl;
+
+class BatchImpl {
+
+public:
+  // where to put the result of an operation
+  struct Output {
+    uint64_t *m_id = nullptr;
+    bool *m_updated = nullptr;
+    std::string *m_record = nullptr;
+    json *m_json = nullptr;
+  };
+
+  std::shared_ptr<ClientImpl> m_client;
+  tl::provider_handle m_ph;
+  std::string m_address;
+  const DatabaseImpl *m_last_database = nullptr; // last database checked
+  std::vector<BatchOperation> m_operations;
+  std::vector<Output> m_outputs;
+
+  BatchImpl() = default;
+
+  ~BatchImpl() = default;
+};
+
+} // namespace sonata
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BATCH_OPERATION_HPP
+#define __SONATA_BATCH_OPERATION_HPP
+
+#include "sonata/JsonSerialize.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace sonata {
+
+/**
+ * @brief Operation of a batch (see Batch), as sent to the provider.
+ * Only the fields relevant to the type of operation are serialized.
+ */
+struct BatchOperation {
+
+  enum Type : uint8_t {
+    Store,
+    StoreJson,
+    Update,
+    UpdateJson,
+    Erase,
+    Fetch,
+    FetchJson
+  };
+
+  uint8_t m_type = Store;
+  std::string m_db_name;
+  std::string m_coll_name;
+  uint64_t m_record_id = 0; // Update(Json), Erase, Fetch(Json)
+  std::string m_record;     // Store, Update
+  JsonWrapper m_json;       // StoreJson, UpdateJson
+
+  bool isWrite() const { return m_type <= Erase; }
+
+  template <typename Archive> void save(Archive &a) const {
+    a &m_type;
+    a &m_db_name;
+    a &m_coll_name;
+    if (m_type != Store && m_type != StoreJson)
+      a &m_record_id;
+    if (m_type == Store || m_type == Update)
+      a &m_record;
+    if (m_type == StoreJson || m_type == UpdateJson)
+      a &m_json;
+  }
+
+  template <typename Archive> void load(Archive &a) {
+    a &m_type;
+    a &m_db_name;
+    a &m_coll_name;
+    if (m_type != Store && m_type != StoreJson)
+      a &m_record_id;
+    if (m_type == Store || m_type == Update)
+      a &m_record;
+    if (m_type == StoreJson || m_type == UpdateJson)
+      a &m_json;
+  }
+};
+
+/**
+ * @brief Result of a BatchOperation, as returned by the provider.
+ * m_record_id is the id of a stored record, m_updated tells whether
+ * an update was applied, and m_record (resp. m_json) is the content
+ * of a fetched record.
+ */
+struct BatchOperationResult {
+
+  uint8_t m_type = BatchOperation::Store;
+  bool m_success = true;
+  std::string m_error;
+  uint64_t m_record_id = 0;
+  bool m_updated = false;
+  std::string m_record;
+  JsonWrapper m_json;
+
+  template <typename Archive> void save(Archive &a) const {
+    a &m_type;
+    a &m_success;
+    if (!m_success) {
+      a &m_error;
+      return;
+    }
+    switch (m_type) {
+    case BatchOperation::Store:
+    case BatchOperation::StoreJson:
+      a &m_record_id;
+      break;
+    case BatchOperation::Update:
+    case BatchOperation::UpdateJson:
+      a &m_updated;
+      break;
+    case BatchOperation::Fetch:
+      a &m_record;
+      break;
+    case BatchOperation::FetchJson:
+      a &m_json;
+      break;
+    }
+  }
+
+  template <typename Archive> void load(Archive &a) {
+    a &m_type;
+    a &m_success;
+    if (!m_success) {
+      a &m_error;
+      return;
+    }
+    switch (m_type) {
+    case BatchOperation::Store:
+    case BatchOperation::StoreJson:
+      a &m_record_id;
+      break;
+    case BatchOperation::Update:
+    case BatchOperation::UpdateJson:
+      a &m_updated;
+      break;
+    case BatchOperation::Fetch:
+      a &m_record;
+      break;
+    case BatchOperation::FetchJson:
+      a &m_json;
+      break;
+    }
+  }
+};
+
+} // namespace sonata
+
+#endif
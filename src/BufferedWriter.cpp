@@ -0,0 +1,193 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "sonata/BufferedWriter.hpp"
+#include "sonata/Exception.hpp"
+
+#include "AsyncRequestImpl.hpp"
+#include "BufferedWriterImpl.hpp"
+
+namespace sonata {
+
+void BufferedWriterImpl::Buffer::wait() {
+  std::lock_guard<tl::mutex> lock(m_mutex);
+  if (not m_done) {
+    try {
+      m_request.wait();
+      for (size_t i = 0; i < m_id_outputs.size(); i++) {
+        if (m_id_outputs[i])
+          *m_id_outputs[i] = m_ids[i];
+      }
+    } catch (const std::exception &ex) {
+      m_error = ex.what();
+    }
+    m_done = true;
+  }
+  if (not m_error.empty())
+    throw Exception(m_error);
+}
+
+BufferedWriterImpl::~BufferedWriterImpl() {
+  std::string error;
+  auto buffers = detach(error);
+  for (auto &buffer : buffers) {
+    try {
+      buffer->wait();
+    } catch (...) {
+    }
+  }
+}
+
+void BufferedWriterImpl::add(std::string &&record, uint64_t *id,
+                             AsyncRequest *req) {
+  std::shared_ptr<Buffer> buffer;
+  {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    // wait on the buffers that have completed, so that
+    // they can be released and their errors reported
+    size_t completed = 0;
+    while (completed < m_in_flight.size() &&
+           m_in_flight[completed]->completed()) {
+      try {
+        m_in_flight[completed]->wait();
+      } catch (const Exception &ex) {
+        if (m_error.empty())
+          m_error = ex.what();
+      }
+      completed += 1;
+    }
+    m_in_flight.erase(m_in_flight.begin(), m_in_flight.begin() + completed);
+    if (not m_current) {
+      m_current = std::make_shared<Buffer>();
+      m_current->m_start = tl::timer::wtime();
+    }
+    buffer = m_current;
+    buffer->m_size += record.size();
+    buffer->m_records.push_back(std::move(record));
+    buffer->m_id_outputs.push_back(id);
+    if ((m_max_records != 0 && buffer->m_records.size() >= m_max_records) ||
+        (m_max_bytes != 0 && buffer->m_size >= m_max_bytes) ||
+        (m_max_delay > 0.0 &&
+         tl::timer::wtime() - buffer->m_start >= m_max_delay))
+      sendCurrent();
+  }
+  if (not req)
+    return;
+  auto async_request_impl = std::make_shared<AsyncRequestImpl>(
+      [buffer]() { return buffer->completed(); });
+  async_request_impl->m_wait_callback =
+      [self = shared_from_this(), buffer](AsyncRequestImpl &) {
+        self->send(buffer);
+        buffer->wait();
+      };
+  *req = AsyncRequest(std::move(async_request_impl));
+}
+
+void BufferedWriterImpl::send(const std::shared_ptr<Buffer> &buffer) {
+  std::lock_guard<tl::mutex> lock(m_mutex);
+  if (buffer == m_current)
+    sendCurrent();
+}
+
+void BufferedWriterImpl::sendCurrent() {
+  auto buffer = std::move(m_current);
+  m_current.reset();
+  buffer->m_ids.resize(buffer->m_records.size());
+  try {
+    m_collection.store_multi(buffer->m_records, buffer->m_ids.data(),
+                             m_commit, &buffer->m_request);
+  } catch (const std::exception &ex) {
+    // the RPC could not be issued
+    buffer->m_error = ex.what();
+    buffer->m_done = true;
+  }
+  buffer->m_sent = true;
+  // the records have been serialized (or packed into a bulk buffer)
+  std::vector<std::string>().swap(buffer->m_records);
+  m_in_flight.push_back(std::move(buffer));
+}
+
+std::vector<std::shared_ptr<BufferedWriterImpl::Buffer>>
+BufferedWriterImpl::detach(std::string &error) {
+  std::lock_guard<tl::mutex> lock(m_mutex);
+  if (m_current)
+    sendCurrent();
+  error = std::move(m_error);
+  m_error.clear();
+  std::vector<std::shared_ptr<Buffer>> buffers;
+  buffers.swap(m_in_flight);
+  return buffers;
+}
+
+BufferedWriter::BufferedWriter() = default;
+
+BufferedWriter::BufferedWriter(const std::shared_ptr<BufferedWriterImpl> &impl)
+    : self(impl) {}
+
+BufferedWriter::BufferedWriter(const BufferedWriter &) = default;
+
+BufferedWriter::BufferedWriter(BufferedWriter &&) = default;
+
+BufferedWriter &BufferedWriter::operator=(const BufferedWriter &) = default;
+
+BufferedWriter &BufferedWriter::operator=(BufferedWriter &&) = default;
+
+BufferedWriter::~BufferedWriter() = default;
+
+BufferedWriter::operator bool() const { return static_cast<bool>(self); }
+
+void BufferedWriter::store(const std::string &record, uint64_t *id,
+                           AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::BufferedWriter object");
+  self->add(std::string(record), id, req);
+}
+
+void BufferedWriter::store(const json &record, uint64_t *id,
+                           AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::BufferedWriter object");
+  self->add(record.dump(), id, req);
+}
+
+void BufferedWriter::flush(AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::BufferedWriter object");
+  auto error = std::make_shared<std::string>();
+  using buffer_list = std::vector<std::shared_ptr<BufferedWriterImpl::Buffer>>;
+  auto buffers = std::make_shared<buffer_list>(self->detach(*error));
+  auto async_request_impl = std::make_shared<AsyncRequestImpl>([buffers]() {
+    for (auto &buffer : *buffers) {
+      if (not buffer->completed())
+        return false;
+    }
+    return true;
+  });
+  async_request_impl->m_wait_callback = [buffers, error](AsyncRequestImpl &) {
+    for (auto &buffer : *buffers) {
+      try {
+        buffer->wait();
+      } catch (const Exception &ex) {
+        if (error->empty())
+          *error = ex.what();
+      }
+    }
+    if (not error->empty())
+      throw Exception(*error);
+  };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+size_t BufferedWriter::pending() const {
+  if (not self)
+    throw Exception("Invalid sonata::BufferedWriter object");
+  std::lock_guard<tl::mutex> lock(self->m_mutex);
+  return self->m_current ? self->m_current->m_records.size() : 0;
+}
+
+} // namespace sonata
@@ -0,0 +1,82 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BUFFERED_WRITER_IMPL_H
+#define __SONATA_BUFFERED_WRITER_IMPL_H
+
+#include "sonata/AsyncRequest.hpp"
+#include "sonata/Collection.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thallium.hpp>
+#include <vector>
+
+namespace sonata {
+
+namespace tl = thallium;
+
+class BufferedWriterImpl
+    : public std::enable_shared_from_this<BufferedWriterImpl> {
+
+public:
+  // Records sent to the provider with a single store_multi.
+  struct Buffer {
+    std::vector<std::string> m_records;
+    std::vector<uint64_t *> m_id_outputs;
+    std::vector<uint64_t> m_ids;
+    size_t m_size = 0;
+    double m_start = 0.0;   // time at which the first record was added
+    AsyncRequest m_request; // invalid if the RPC could not be issued
+    std::atomic<bool> m_sent{false};
+    bool m_done = false; // m_request has been waited on
+    std::string m_error;
+    tl::mutex m_mutex; // protects m_done and m_error
+
+    bool completed() const {
+      return m_sent && (!m_request || m_request.completed());
+    }
+
+    // Waits for the buffer to be stored and sets the ids of its records.
+    // The buffer must have been sent.
+    void wait();
+  };
+
+  Collection m_collection;
+  size_t m_max_records;
+  size_t m_max_bytes;
+  double m_max_delay;
+  bool m_commit;
+  tl::mutex m_mutex; // protects the fields below
+  std::shared_ptr<Buffer> m_current;
+  std::vector<std::shared_ptr<Buffer>> m_in_flight; // sent, not waited on
+  std::string m_error; // first error of a buffer waited on by add()
+
+  BufferedWriterImpl(const Collection &collection, size_t max_records,
+                     size_t max_bytes, double max_delay, bool commit)
+      : m_collection(collection), m_max_records(max_records),
+        m_max_bytes(max_bytes), m_max_delay(max_delay), m_commit(commit) {}
+
+  // flushes the remaining records, ignoring errors
+  ~BufferedWriterImpl();
+
+  void add(std::string &&record, uint64_t *id, AsyncRequest *req);
+
+  // sends the buffer if it is still the current one
+  void send(const std::shared_ptr<Buffer> &buffer);
+
+  // sends the current buffer and returns the buffers to wait on,
+  // along with the first error of the buffers already waited on
+  std::vector<std::shared_ptr<Buffer>> detach(std::string &error);
+
+private:
+  // sends m_current, must be called with m_mutex held
+  void sendCurrent();
+};
+
+} // namespace sonata
+
+#endif
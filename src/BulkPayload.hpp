@@ -0,0 +1,101 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_BULK_PAYLOAD_HPP
+#define __SONATA_BULK_PAYLOAD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+/**
+ * @brief Helper functions to pack a list of records into a contiguous
+ * buffer, and to unpack it, so that large payloads can be transferred
+ * through a tl::bulk handle (RDMA) instead of being serialized as RPC
+ * arguments. The format is the number of records as a uint64_t, followed
+ * by each record as a uint64_t size and the record's bytes.
+ */
+struct BulkPayload {
+
+  static size_t packedSize(const std::vector<std::string> &records) {
+    size_t size = sizeof(uint64_t);
+    for (auto &record : records)
+      size += sizeof(uint64_t) + record.size();
+    return size;
+  }
+
+  /**
+   * @brief Packs the records into the buffer, which should be
+   * at least packedSize(records) bytes.
+   */
+  static void pack(const std::vector<std::string> &records, char *buffer) {
+    uint64_t count = records.size();
+    std::memcpy(buffer, &count, sizeof(count));
+    buffer += sizeof(count);
+    for (auto &record : records) {
+      uint64_t size = record.size();
+      std::memcpy(buffer, &size, sizeof(size));
+      buffer += sizeof(size);
+      std::memcpy(buffer, record.data(), size);
+      buffer += size;
+    }
+  }
+
+  /**
+   * @brief Unpacks the records from the buffer.
+   * Returns false if the buffer is not well-formed.
+   */
+  static bool unpack(const char *buffer, size_t size,
+                     std::vector<std::string> &records) {
+    uint64_t count;
+    if (size < sizeof(count))
+      return false;
+    std::memcpy(&count, buffer, sizeof(count));
+    size_t offset = sizeof(count);
+    // each record takes at least sizeof(uint64_t) bytes
+    if (count > (size - offset) / sizeof(uint64_t))
+      return false;
+    records.clear();
+    records.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      uint64_t record_size;
+      if (size - offset < sizeof(record_size))
+        return false;
+      std::memcpy(&record_size, buffer + offset, sizeof(record_size));
+      offset += sizeof(record_size);
+      if (size - offset < record_size)
+        return false;
+      records.emplace_back(buffer + offset, record_size);
+      offset += record_size;
+    }
+    return offset == size;
+  }
+};
+
+/**
+ * @brief Value returned by the bulk variants of read operations.
+ * Results smaller than the client's bulk threshold are returned inline
+ * in m_records. Larger results are packed (see BulkPayload) and kept by
+ * the provider: m_size is then their packed size and m_result_id the id
+ * with which the client pulls them into a buffer of that size.
+ */
+struct BulkReadResult {
+  std::vector<std::string> m_records;
+  uint64_t m_size = 0;
+  uint64_t m_result_id = 0;
+
+  template <typename Archive> void serialize(Archive &a) {
+    a &m_records;
+    a &m_size;
+    a &m_result_id;
+  }
+};
+
+} // namespace sonata
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "CacheBackend.hpp"
+
+namespace sonata {
+
+namespace tl = thallium;
+using namespace std::string_literals;
+
+SONATA_REGISTER_BACKEND(cache, CacheBackend);
+
+std::unique_ptr<Backend> CacheBackend::create(const tl::engine &engine,
+                                              const tl::pool &pool,
+                                              const json &config) {
+  spdlog::trace("[cache] Creating Cache database");
+  std::string backend_type = config.value("backend", "");
+  if (backend_type.size() == 0) {
+    throw Exception(
+        "CacheBackend needs to be initialized with a \"backend\" entry");
+  }
+  const auto &inner_cfg = config["config"];
+  size_t max_bytes = config.value("max_bytes", (size_t)64 * 1024 * 1024);
+  std::unique_ptr<Backend> inner =
+      BackendFactory::createBackend(backend_type, engine, pool, inner_cfg);
+  auto backend = std::make_unique<CacheBackend>(std::move(inner), max_bytes);
+  spdlog::trace("[cache] Successfully created database");
+  return backend;
+}
+
+std::unique_ptr<Backend> CacheBackend::attach(const tl::engine &engine,
+                                              const tl::pool &pool,
+                                              const json &config) {
+  spdlog::trace("[cache] Opening Cache database");
+  std::string backend_type = config.value("backend", "");
+  if (backend_type.size() == 0) {
+    throw Exception(
+        "CacheBackend needs to be initialized with a \"backend\" entry");
+  }
+  const auto &inner_cfg = config["config"];
+  size_t max_bytes = config.value("max_bytes", (size_t)64 * 1024 * 1024);
+  std::unique_ptr<Backend> inner =
+      BackendFactory::attachBackend(backend_type, engine, pool, inner_cfg);
+  auto backend = std::make_unique<CacheBackend>(std::move(inner), max_bytes);
+  spdlog::trace("[cache] Successfully opened database");
+  return backend;
+}
+
+} // namespace sonata
@@ -0,0 +1,581 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_CACHE_BACKEND_HPP
+#define __SONATA_CACHE_BACKEND_HPP
+
+#include "sonata/Backend.hpp"
+#include "FetchMerge.hpp"
+#include "JsonProjection.hpp"
+#include "JsonSize.hpp"
+
+#include <list>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <thallium.hpp>
+#include <unordered_map>
+
+namespace sonata {
+
+namespace tl = thallium;
+using namespace std::string_literals;
+using nlohmann::json;
+
+/**
+ * @brief The CacheBackend wraps another backend and keeps the records
+ * fetched from it, decoded, in an LRU cache bounded by max_bytes (the
+ * approximate size of the cached records). Writes go directly to the
+ * inner backend and invalidate the records they modify; execute()
+ * invalidates the whole cache since Jx9 code can modify any record.
+ * Records fetched as strings from the cache are serialized again, so
+ * their formatting may differ from that of the inner backend.
+ */
+class CacheBackend : public Backend {
+
+public:
+  CacheBackend(std::unique_ptr<Backend> &&inner, size_t max_bytes)
+      : m_db(std::move(inner)), m_max_bytes(max_bytes) {}
+
+  CacheBackend(CacheBackend &&) = delete;
+
+  CacheBackend(const CacheBackend &) = delete;
+
+  CacheBackend &operator=(CacheBackend &&) = delete;
+
+  CacheBackend &operator=(const CacheBackend &) = delete;
+
+  static std::unique_ptr<Backend> create(const tl::engine &engine,
+                                         const tl::pool &pool,
+                                         const json &config);
+
+  static std::unique_ptr<Backend> attach(const tl::engine &engine,
+                                         const tl::pool &pool,
+                                         const json &config);
+
+  virtual ~CacheBackend() {
+    spdlog::debug("[cache] {} hits, {} misses, {} evictions",
+                  m_hits, m_misses, m_evictions);
+  }
+
+  virtual RequestResult<bool>
+  createCollection(const std::string &coll_name) override {
+    return m_db->createCollection(coll_name);
+  }
+
+  virtual RequestResult<bool>
+  openCollection(const std::string &coll_name) override {
+    return m_db->openCollection(coll_name);
+  }
+
+  virtual RequestResult<bool>
+  dropCollection(const std::string &coll_name) override {
+    auto result = m_db->dropCollection(coll_name);
+    invalidateCollection(coll_name);
+    return result;
+  }
+
+  virtual RequestResult<uint64_t> store(const std::string &coll_name,
+                                        const std::string &record,
+                                        bool commit) override {
+    return m_db->store(coll_name, record, commit);
+  }
+
+  virtual RequestResult<uint64_t> storeJson(const std::string &coll_name,
+                                            const JsonWrapper &record,
+                                            bool commit) override {
+    return m_db->storeJson(coll_name, record, commit);
+  }
+
+  virtual RequestResult<std::vector<uint64_t>>
+  storeMulti(const std::string &coll_name,
+             const std::vector<std::string> &records, bool commit) override {
+    return m_db->storeMulti(coll_name, records, commit);
+  }
+
+  virtual RequestResult<std::vector<uint64_t>>
+  storeMultiJson(const std::string &coll_name, const JsonWrapper &records,
+                 bool commit) override {
+    return m_db->storeMultiJson(coll_name, records, commit);
+  }
+
+  virtual RequestResult<uint64_t> reserveIds(const std::string &coll_name,
+                                             size_t count) override {
+    return m_db->reserveIds(coll_name, count);
+  }
+
+  virtual RequestResult<bool>
+  storeReserved(const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const JsonWrapper &records, bool commit) override {
+    return m_db->storeReserved(coll_name, record_ids, records, commit);
+  }
+
+  bool addsRecordIds() const override { return m_db->addsRecordIds(); }
+
+  virtual RequestResult<bool> commit() override { return m_db->commit(); }
+
+  virtual RequestResult<std::string> fetch(const std::string &coll_name,
+                                           uint64_t record_id) override {
+    RequestResult<std::string> result;
+    json record;
+    uint64_t version;
+    if (lookup(coll_name, record_id, record, version)) {
+      result.value() = record.dump();
+      return result;
+    }
+    result = m_db->fetch(coll_name, record_id);
+    if (result.success())
+      insertString(coll_name, record_id, result.value(), version);
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper> fetchJson(const std::string &coll_name,
+                                               uint64_t record_id) override {
+    RequestResult<JsonWrapper> result;
+    json record;
+    uint64_t version;
+    if (lookup(coll_name, record_id, record, version)) {
+      result.value() = std::move(record);
+      return result;
+    }
+    result = m_db->fetchJson(coll_name, record_id);
+    if (result.success())
+      insert(coll_name, record_id, result.value().m_object, version);
+    return result;
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  fetchMulti(const std::string &coll_name,
+             const std::vector<uint64_t> &record_ids) override {
+    std::vector<json> cached;
+    std::vector<uint64_t> missing;
+    uint64_t version;
+    lookupMulti(coll_name, record_ids, cached, missing, version);
+    if (missing.size() == record_ids.size()) {
+      auto inner = m_db->fetchMulti(coll_name, record_ids);
+      if (inner.success() && inner.value().size() == record_ids.size()) {
+        for (size_t i = 0; i < record_ids.size(); i++)
+          insertString(coll_name, record_ids[i], inner.value()[i], version);
+      }
+      return inner;
+    }
+    return mergeFetchMulti(
+        *m_db, coll_name, record_ids, cached, missing,
+        [this, &coll_name, version](uint64_t id, const std::string &record) {
+          insertString(coll_name, id, record, version);
+        });
+  }
+
+  virtual RequestResult<JsonWrapper>
+  fetchMultiJson(const std::string &coll_name,
+                 const std::vector<uint64_t> &record_ids) override {
+    std::vector<json> cached;
+    std::vector<uint64_t> missing;
+    uint64_t version;
+    lookupMulti(coll_name, record_ids, cached, missing, version);
+    if (missing.size() == record_ids.size()) {
+      auto inner = m_db->fetchMultiJson(coll_name, record_ids);
+      if (inner.success() && inner.value()->size() == record_ids.size()) {
+        for (size_t i = 0; i < record_ids.size(); i++)
+          insert(coll_name, record_ids[i], inner.value().m_object[i], version);
+      }
+      return inner;
+    }
+    return mergeFetchMultiJson(
+        *m_db, coll_name, record_ids, cached, missing,
+        [this, &coll_name, version](uint64_t id, const json &record) {
+          insert(coll_name, id, record, version);
+        });
+  }
+
+  // Cached records are projected. Projected records are not cached, so
+  // records that are not cached are fetched from the inner backend with
+  // the projection if none of them is cached, and in full otherwise.
+  virtual RequestResult<JsonWrapper>
+  fetchJsonProjected(const std::string &coll_name, uint64_t record_id,
+                     const std::vector<std::string> &fields) override {
+    RequestResult<JsonWrapper> result;
+    json record;
+    uint64_t version;
+    if (!lookup(coll_name, record_id, record, version))
+      return m_db->fetchJsonProjected(coll_name, record_id, fields);
+    JsonProjection(fields).apply(record);
+    result.value() = std::move(record);
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  fetchMultiJsonProjected(const std::string &coll_name,
+                          const std::vector<uint64_t> &record_ids,
+                          const std::vector<std::string> &fields) override {
+    std::vector<json> cached;
+    std::vector<uint64_t> missing;
+    uint64_t version;
+    lookupMulti(coll_name, record_ids, cached, missing, version);
+    if (missing.size() == record_ids.size())
+      return m_db->fetchMultiJsonProjected(coll_name, record_ids, fields);
+    auto result = mergeFetchMultiJson(
+        *m_db, coll_name, record_ids, cached, missing,
+        [this, &coll_name, version](uint64_t id, const json &record) {
+          insert(coll_name, id, record, version);
+        });
+    if (result.success())
+      JsonProjection(fields).applyToArray(result.value().m_object);
+    return result;
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  filter(const std::string &coll_name,
+         const std::string &filter_code) override {
+    return m_db->filter(coll_name, filter_code);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterJson(const std::string &coll_name,
+             const std::string &filter_code) override {
+    return m_db->filterJson(coll_name, filter_code);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterJsonProjected(const std::string &coll_name,
+                      const std::string &filter_code,
+                      const std::vector<std::string> &fields) override {
+    return m_db->filterJsonProjected(coll_name, filter_code, fields);
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name,
+                  const JsonWrapper &predicate) override {
+    return m_db->filterPredicate(coll_name, predicate);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate) override {
+    return m_db->filterPredicateJson(coll_name, predicate);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJsonProjected(const std::string &coll_name,
+                               const JsonWrapper &predicate,
+                               const std::vector<std::string> &fields) override {
+    return m_db->filterPredicateJsonProjected(coll_name, predicate, fields);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name,
+            const JsonWrapper &pipeline) override {
+    return m_db->aggregate(coll_name, pipeline);
+  }
+
+  virtual RequestResult<bool> update(const std::string &coll_name,
+                                     uint64_t record_id,
+                                     const std::string &new_content,
+                                     bool commit) override {
+    auto result = m_db->update(coll_name, record_id, new_content, commit);
+    invalidate(coll_name, &record_id, 1);
+    return result;
+  }
+
+  virtual RequestResult<bool> updateJson(const std::string &coll_name,
+                                         uint64_t record_id,
+                                         const JsonWrapper &new_content,
+                                         bool commit) override {
+    auto result = m_db->updateJson(coll_name, record_id, new_content, commit);
+    invalidate(coll_name, &record_id, 1);
+    return result;
+  }
+
+  virtual RequestResult<std::vector<bool>> updateMulti(
+      const std::string &coll_name, const std::vector<uint64_t> &record_ids,
+      const std::vector<std::string> &new_contents, bool commit) override {
+    auto result =
+        m_db->updateMulti(coll_name, record_ids, new_contents, commit);
+    invalidate(coll_name, record_ids.data(), record_ids.size());
+    return result;
+  }
+
+  virtual RequestResult<std::vector<bool>>
+  updateMultiJson(const std::string &coll_name,
+                  const std::vector<uint64_t> &record_ids,
+                  const JsonWrapper &new_contents, bool commit) override {
+    auto result =
+        m_db->updateMultiJson(coll_name, record_ids, new_contents, commit);
+    invalidate(coll_name, record_ids.data(), record_ids.size());
+    return result;
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  all(const std::string &coll_name) override {
+    return m_db->all(coll_name);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  allJson(const std::string &coll_name) override {
+    return m_db->allJson(coll_name);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  allJsonProjected(const std::string &coll_name,
+                   const std::vector<std::string> &fields) override {
+    return m_db->allJsonProjected(coll_name, fields);
+  }
+
+  virtual RequestResult<uint64_t>
+  lastID(const std::string &coll_name) override {
+    return m_db->lastID(coll_name);
+  }
+
+  virtual RequestResult<size_t> size(const std::string &coll_name) override {
+    return m_db->size(coll_name);
+  }
+
+  virtual RequestResult<bool> erase(const std::string &coll_name,
+                                    uint64_t record_id, bool commit) override {
+    auto result = m_db->erase(coll_name, record_id, commit);
+    invalidate(coll_name, &record_id, 1);
+    return result;
+  }
+
+  virtual RequestResult<bool>
+  eraseMulti(const std::string &coll_name,
+             const std::vector<uint64_t> &record_ids, bool commit) override {
+    auto result = m_db->eraseMulti(coll_name, record_ids, commit);
+    invalidate(coll_name, record_ids.data(), record_ids.size());
+    return result;
+  }
+
+  virtual RequestResult<bool> createIndex(const std::string &coll_name,
+                                          const std::string &field) override {
+    return m_db->createIndex(coll_name, field);
+  }
+
+  virtual RequestResult<bool> dropIndex(const std::string &coll_name,
+                                        const std::string &field) override {
+    return m_db->dropIndex(coll_name, field);
+  }
+
+  virtual RequestResult<std::vector<uint64_t>>
+  queryIndex(const std::string &coll_name, const std::string &field,
+             const JsonWrapper &lower, const JsonWrapper &upper) override {
+    return m_db->queryIndex(coll_name, field, lower, upper);
+  }
+
+  virtual RequestResult<JsonWrapper>
+  queryIndexJson(const std::string &coll_name, const std::string &field,
+                 const JsonWrapper &lower, const JsonWrapper &upper) override {
+    return m_db->queryIndexJson(coll_name, field, lower, upper);
+  }
+
+  virtual RequestResult<std::unordered_map<std::string, std::string>>
+  execute(const std::string &code, const std::unordered_set<std::string> &vars,
+          bool commit) override {
+    auto result = m_db->execute(code, vars, commit);
+    invalidateAll();
+    return result;
+  }
+
+  virtual RequestResult<bool> destroy() override {
+    auto result = m_db->destroy();
+    invalidateAll();
+    return result;
+  }
+
+  std::string getConfig() const override {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    return "{\"max_bytes\":"s + std::to_string(m_max_bytes) +
+           ",\"stats\":{\"hits\":"s + std::to_string(m_hits) +
+           ",\"misses\":"s + std::to_string(m_misses) +
+           ",\"evictions\":"s + std::to_string(m_evictions) +
+           ",\"records\":"s + std::to_string(m_lru.size()) +
+           ",\"bytes\":"s + std::to_string(m_bytes) + "}" +
+           ",\"config\":" + m_db->getConfig() + "}";
+  }
+
+private:
+  struct Collection;
+
+  struct Entry {
+    Collection *m_coll;
+    uint64_t m_id;
+    json m_record;
+    size_t m_size; // approximate size in bytes of the entry
+  };
+
+  using LRU = std::list<Entry>;
+
+  // Cached records of a collection. The version is set to a new value of
+  // m_epoch each time records of the collection are invalidated, so that
+  // records fetched from the inner backend before the invalidation are not
+  // cached. Collection objects are never erased, so that entries can point
+  // to them.
+  struct Collection {
+    std::unordered_map<uint64_t, LRU::iterator> m_index;
+    uint64_t m_version = 0;
+  };
+
+  // Returns the collection, creating it if it does not exist. A new
+  // collection gets the current epoch as version, hence records fetched
+  // before an invalidateAll() are not cached in it.
+  Collection &getCollection(const std::string &coll_name) {
+    auto it = m_collections.find(coll_name);
+    if (it == m_collections.end()) {
+      it = m_collections.emplace(coll_name, Collection()).first;
+      it->second.m_version = m_epoch;
+    }
+    return it->second;
+  }
+
+  // Looks up a record in the cache, moving it to the front of the LRU list.
+  // If the record is not cached, sets version to the version of its
+  // collection, to be passed to insert() along with the fetched record.
+  bool lookup(const std::string &coll_name, uint64_t record_id, json &record,
+              uint64_t &version) {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    auto coll_it = m_collections.find(coll_name);
+    if (coll_it == m_collections.end()) {
+      m_misses += 1;
+      version = m_epoch;
+      return false;
+    }
+    auto &coll = coll_it->second;
+    auto it = coll.m_index.find(record_id);
+    if (it == coll.m_index.end()) {
+      m_misses += 1;
+      version = coll.m_version;
+      return false;
+    }
+    m_hits += 1;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    record = it->second->m_record;
+    return true;
+  }
+
+  // Same as above for multiple records: cached[i] is set to the record with
+  // id record_ids[i] if it is cached (and is discarded otherwise), and the
+  // ids of the other records are added to missing, in order.
+  void lookupMulti(const std::string &coll_name,
+                   const std::vector<uint64_t> &record_ids,
+                   std::vector<json> &cached, std::vector<uint64_t> &missing,
+                   uint64_t &version) {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    cached.assign(record_ids.size(), json(json::value_t::discarded));
+    auto coll_it = m_collections.find(coll_name);
+    if (coll_it == m_collections.end()) {
+      m_misses += record_ids.size();
+      missing = record_ids;
+      version = m_epoch;
+      return;
+    }
+    auto &coll = coll_it->second;
+    version = coll.m_version;
+    for (size_t i = 0; i < record_ids.size(); i++) {
+      auto it = coll.m_index.find(record_ids[i]);
+      if (it == coll.m_index.end()) {
+        m_misses += 1;
+        missing.push_back(record_ids[i]);
+        continue;
+      }
+      m_hits += 1;
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      cached[i] = it->second->m_record;
+    }
+  }
+
+  // Adds a record fetched from the inner backend to the cache, unless
+  // records of its collection were invalidated since version was obtained,
+  // then evicts the least recently used records to fit in max_bytes.
+  void insert(const std::string &coll_name, uint64_t record_id,
+              const json &record, uint64_t version) {
+    if (record.is_null())
+      return;
+    size_t size = approximateJsonSize(record) + sizeof(Entry);
+    if (size > m_max_bytes)
+      return;
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    auto &coll = getCollection(coll_name);
+    if (coll.m_version != version || coll.m_index.count(record_id))
+      return;
+    m_lru.push_front(Entry{&coll, record_id, record, size});
+    coll.m_index[record_id] = m_lru.begin();
+    m_bytes += size;
+    while (m_bytes > m_max_bytes) {
+      auto &last = m_lru.back();
+      last.m_coll->m_index.erase(last.m_id);
+      m_bytes -= last.m_size;
+      m_lru.pop_back();
+      m_evictions += 1;
+    }
+  }
+
+  // Same as above for a record fetched as a string.
+  void insertString(const std::string &coll_name, uint64_t record_id,
+                    const std::string &record, uint64_t version) {
+    if (record.empty())
+      return;
+    auto parsed = json::parse(record, nullptr, false);
+    if (!parsed.is_discarded())
+      insert(coll_name, record_id, parsed, version);
+  }
+
+  void invalidate(const std::string &coll_name, const uint64_t *record_ids,
+                  size_t count) {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    m_epoch += 1;
+    auto coll_it = m_collections.find(coll_name);
+    if (coll_it == m_collections.end())
+      return;
+    auto &coll = coll_it->second;
+    coll.m_version = m_epoch;
+    for (size_t i = 0; i < count; i++) {
+      auto it = coll.m_index.find(record_ids[i]);
+      if (it == coll.m_index.end())
+        continue;
+      m_bytes -= it->second->m_size;
+      m_lru.erase(it->second);
+      coll.m_index.erase(it);
+    }
+  }
+
+  void invalidateCollection(const std::string &coll_name) {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    m_epoch += 1;
+    auto coll_it = m_collections.find(coll_name);
+    if (coll_it == m_collections.end())
+      return;
+    auto &coll = coll_it->second;
+    coll.m_version = m_epoch;
+    for (auto &p : coll.m_index) {
+      m_bytes -= p.second->m_size;
+      m_lru.erase(p.second);
+    }
+    coll.m_index.clear();
+  }
+
+  void invalidateAll() {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    m_epoch += 1;
+    for (auto &p : m_collections) {
+      p.second.m_version = m_epoch;
+      p.second.m_index.clear();
+    }
+    m_lru.clear();
+    m_bytes = 0;
+  }
+
+  std::unique_ptr<Backend> m_db;
+  size_t m_max_bytes;
+  mutable tl::mutex m_mutex;
+  LRU m_lru; // most recently used first
+  std::unordered_map<std::string, Collection> m_collections;
+  uint64_t m_epoch = 0; // incremented by each invalidation
+  size_t m_bytes = 0;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+  uint64_t m_evictions = 0;
+};
+
+} // namespace sonata
+#endif
@@ -66,6 +66,12 @@ ProviderHandle Client::createProviderHandle(hg_addr_t address,
   return ProviderHandle(self->m_engine, address, provider_id, false);
 }
 
+void Client::setBulkThreshold(size_t threshold) const {
+  self->m_bulk_threshold = threshold;
+}
+
+size_t Client::getBulkThreshold() const { return self->m_bulk_threshold; }
+
 Database Client::open(const ProviderHandle &ph, const std::string &db_name,
                       bool check) const {
   RequestResult<bool> result;
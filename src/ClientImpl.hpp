@@ -11,6 +11,9 @@
 #include <thallium/serialization/stl/unordered_map.hpp>
 #include <thallium/serialization/stl/unordered_set.hpp>
 
+#include <atomic>
+#include <list>
+
 namespace sonata {
 
 namespace tl = thallium;
@@ -29,22 +32,50 @@ public:
   tl::remote_procedure m_coll_store_json;
   tl::remote_procedure m_coll_store_multi;
   tl::remote_procedure m_coll_store_multi_json;
+  tl::remote_procedure m_coll_store_multi_bulk;
+  tl::remote_procedure m_coll_store_multi_json_bulk;
   tl::remote_procedure m_coll_fetch;
   tl::remote_procedure m_coll_fetch_json;
+  tl::remote_procedure m_coll_fetch_json_projected;
   tl::remote_procedure m_coll_fetch_multi;
   tl::remote_procedure m_coll_fetch_multi_json;
+  tl::remote_procedure m_coll_fetch_multi_json_projected;
+  tl::remote_procedure m_coll_fetch_multi_bulk;
   tl::remote_procedure m_coll_filter;
   tl::remote_procedure m_coll_filter_json;
+  tl::remote_procedure m_coll_filter_json_projected;
+  tl::remote_procedure m_coll_filter_predicate;
+  tl::remote_procedure m_coll_filter_predicate_json;
+  tl::remote_procedure m_coll_filter_predicate_json_projected;
+  tl::remote_procedure m_coll_aggregate;
   tl::remote_procedure m_coll_update;
   tl::remote_procedure m_coll_update_json;
   tl::remote_procedure m_coll_update_multi;
   tl::remote_procedure m_coll_update_multi_json;
   tl::remote_procedure m_coll_all;
   tl::remote_procedure m_coll_all_json;
+  tl::remote_procedure m_coll_all_json_projected;
+  tl::remote_procedure m_coll_all_bulk;
+  tl::remote_procedure m_pull_bulk_result;
   tl::remote_procedure m_coll_last_id;
   tl::remote_procedure m_coll_size;
   tl::remote_procedure m_coll_erase;
   tl::remote_procedure m_coll_erase_multi;
+  tl::remote_procedure m_coll_create_index;
+  tl::remote_procedure m_coll_drop_index;
+  tl::remote_procedure m_coll_query_index;
+  tl::remote_procedure m_coll_query_index_json;
+  tl::remote_procedure m_cursor_open;
+  tl::remote_procedure m_cursor_next;
+  tl::remote_procedure m_cursor_next_json;
+  tl::remote_procedure m_cursor_close;
+  tl::remote_procedure m_batch;
+  // payloads of at least this many bytes are transferred using RDMA
+  std::atomic<size_t> m_bulk_threshold{1024 * 1024};
+  // cursor_close RPCs sent by cursors destroyed without being closed,
+  // whose responses have not been received yet
+  std::list<tl::async_response> m_pending_closes;
+  tl::mutex m_pending_closes_mtx;
 
   ClientImpl(const tl::engine &engine)
       : m_engine(engine),
@@ -58,26 +89,80 @@ public:
         m_coll_store_json(m_engine.define("sonata_store_json")),
         m_coll_store_multi(m_engine.define("sonata_store_multi")),
         m_coll_store_multi_json(m_engine.define("sonata_store_multi_json")),
+        m_coll_store_multi_bulk(m_engine.define("sonata_store_multi_bulk")),
+        m_coll_store_multi_json_bulk(
+            m_engine.define("sonata_store_multi_json_bulk")),
         m_coll_fetch(m_engine.define("sonata_fetch")),
         m_coll_fetch_json(m_engine.define("sonata_fetch_json")),
+        m_coll_fetch_json_projected(
+            m_engine.define("sonata_fetch_json_projected")),
         m_coll_fetch_multi(m_engine.define("sonata_fetch_multi")),
         m_coll_fetch_multi_json(m_engine.define("sonata_fetch_multi_json")),
+        m_coll_fetch_multi_json_projected(
+            m_engine.define("sonata_fetch_multi_json_projected")),
+        m_coll_fetch_multi_bulk(m_engine.define("sonata_fetch_multi_bulk")),
         m_coll_filter(m_engine.define("sonata_filter")),
         m_coll_filter_json(m_engine.define("sonata_filter_json")),
+        m_coll_filter_json_projected(
+            m_engine.define("sonata_filter_json_projected")),
+        m_coll_filter_predicate(m_engine.define("sonata_filter_predicate")),
+        m_coll_filter_predicate_json(
+            m_engine.define("sonata_filter_predicate_json")),
+        m_coll_filter_predicate_json_projected(
+            m_engine.define("sonata_filter_predicate_json_projected")),
+        m_coll_aggregate(m_engine.define("sonata_aggregate")),
         m_coll_update(m_engine.define("sonata_update")),
         m_coll_update_json(m_engine.define("sonata_update_json")),
         m_coll_update_multi(m_engine.define("sonata_update_multi")),
         m_coll_update_multi_json(m_engine.define("sonata_update_multi_json")),
         m_coll_all(m_engine.define("sonata_all")),
         m_coll_all_json(m_engine.define("sonata_all_json")),
+        m_coll_all_json_projected(m_engine.define("sonata_all_json_projected")),
+        m_coll_all_bulk(m_engine.define("sonata_all_bulk")),
+        m_pull_bulk_result(m_engine.define("sonata_pull_bulk_result")),
         m_coll_last_id(m_engine.define("sonata_last_id")),
         m_coll_size(m_engine.define("sonata_size")),
         m_coll_erase(m_engine.define("sonata_erase")),
-        m_coll_erase_multi(m_engine.define("sonata_erase_multi")) {}
+        m_coll_erase_multi(m_engine.define("sonata_erase_multi")),
+        m_coll_create_index(m_engine.define("sonata_create_index")),
+        m_coll_drop_index(m_engine.define("sonata_drop_index")),
+        m_coll_query_index(m_engine.define("sonata_query_index")),
+        m_coll_query_index_json(m_engine.define("sonata_query_index_json")),
+        m_cursor_open(m_engine.define("sonata_cursor_open")),
+        m_cursor_next(m_engine.define("sonata_cursor_next")),
+        m_cursor_next_json(m_engine.define("sonata_cursor_next_json")),
+        m_cursor_close(m_engine.define("sonata_cursor_close")),
+        m_batch(m_engine.define("sonata_batch")) {}
 
   ClientImpl(margo_instance_id mid) : ClientImpl(tl::engine(mid)) {}
 
-  ~ClientImpl() {}
+  ~ClientImpl() {
+    for (auto &response : m_pending_closes) {
+      try {
+        response.wait();
+      } catch (...) {
+      }
+    }
+  }
+
+  // Sends a cursor_close RPC without waiting for its response. Responses
+  // that were received are collected each time a new RPC is sent.
+  void closeCursorAsync(const tl::provider_handle &ph, uint64_t cursor_id) {
+    auto response = m_cursor_close.on(ph).async(cursor_id);
+    std::lock_guard<tl::mutex> lock(m_pending_closes_mtx);
+    for (auto it = m_pending_closes.begin(); it != m_pending_closes.end();) {
+      if (!it->received()) {
+        ++it;
+        continue;
+      }
+      try {
+        it->wait();
+      } catch (...) {
+      }
+      it = m_pending_closes.erase(it);
+    }
+    m_pending_closes.push_back(std::move(response));
+  }
 };
 
 } // namespace sonata
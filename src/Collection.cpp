@@ -9,9 +9,13 @@
 #include "sonata/RequestResult.hpp"
 
 #include "AsyncRequestImpl.hpp"
+#include "BufferedWriterImpl.hpp"
+#include "BulkPayload.hpp"
 #include "ClientImpl.hpp"
 #include "CollectionImpl.hpp"
+#include "CursorImpl.hpp"
 #include "DatabaseImpl.hpp"
+#include "JsonSize.hpp"
 
 #include <thallium/serialization/stl/vector.hpp>
 #include <thallium/serialization/stl/pair.hpp>
@@ -19,6 +23,59 @@
 
 namespace sonata {
 
+namespace {
+
+// Buffer exposed to the provider for a bulk transfer. It must be kept
+// alive until the response of the RPC has been received.
+struct BulkBuffer {
+  std::unique_ptr<char[]> m_data;
+  size_t m_size;
+  tl::bulk m_bulk;
+
+  BulkBuffer(tl::engine &engine, size_t size, tl::bulk_mode mode)
+      : m_data(new char[size]), m_size(size) {
+    std::vector<std::pair<void *, size_t>> segments = {{m_data.get(), size}};
+    m_bulk = engine.expose(segments, mode);
+  }
+};
+
+// Issues a bulk read RPC (send() should call the RPC) and returns
+// a request that sets out from its result. If the provider reports that
+// the result does not fit in the RPC response, the result is pulled into
+// a buffer of the required size.
+template <typename SendFn>
+std::shared_ptr<AsyncRequestImpl>
+bulkRead(const std::shared_ptr<ClientImpl> &client,
+         const tl::provider_handle &ph, SendFn send,
+         std::vector<std::string> *out) {
+  auto async_response = send();
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [client, ph, out](AsyncRequestImpl &async_request_impl) {
+        RequestResult<BulkReadResult> result =
+            async_request_impl.m_async_response->wait();
+        if (!result.success())
+          throw Exception(result.error());
+        auto &value = result.value();
+        if (value.m_size == 0) {
+          *out = std::move(value.m_records);
+          return;
+        }
+        BulkBuffer buffer(client->m_engine, value.m_size,
+                          tl::bulk_mode::write_only);
+        RequestResult<bool> pulled = client->m_pull_bulk_result.on(ph)(
+            value.m_result_id, buffer.m_bulk);
+        if (!pulled.success())
+          throw Exception(pulled.error());
+        if (!BulkPayload::unpack(buffer.m_data.get(), value.m_size, *out))
+          throw Exception("Invalid bulk payload received");
+      };
+  return async_request_impl;
+}
+
+} // namespace
+
 Collection::Collection() = default;
 
 Collection::Collection(const std::shared_ptr<CollectionImpl> &impl)
@@ -53,7 +110,7 @@ void Collection::store(const json &record, uint64_t *id, bool commit,
   async_request_impl->m_wait_callback =
       [id](AsyncRequestImpl &async_request_impl) {
         RequestResult<uint64_t> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (id)
             *id = result.value();
@@ -80,7 +137,7 @@ void Collection::store(const std::string &record, uint64_t *id, bool commit,
   async_request_impl->m_wait_callback =
       [id](AsyncRequestImpl &async_request_impl) {
         RequestResult<uint64_t> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (id)
             *id = result.value();
@@ -101,19 +158,30 @@ void Collection::store_multi(const json &records, uint64_t *ids,
   if (records.type() != json::value_t::array) {
     throw Exception("JSON object is not of Array type");
   }
-  auto &rpc = self->m_database->m_client->m_coll_store_multi_json;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
+  size_t threshold = client->m_bulk_threshold;
+  std::shared_ptr<BulkBuffer> payload;
+  if (threshold != 0 && approximateJsonSize(records) >= threshold) {
+    // large payloads are sent as text through a bulk handle
+    auto text = records.dump();
+    payload = std::make_shared<BulkBuffer>(client->m_engine, text.size(),
+                                           tl::bulk_mode::read_only);
+    memcpy(payload->m_data.get(), text.data(), text.size());
+  }
   auto async_response =
-      rpc.on(ph).async(db_name, self->m_name,
-                       ConstJsonRefWrapper(records),
-                       commit);
+      payload ? client->m_coll_store_multi_json_bulk.on(ph).async(
+                    db_name, self->m_name, payload->m_bulk, commit)
+              : client->m_coll_store_multi_json.on(ph).async(
+                    db_name, self->m_name, ConstJsonRefWrapper(records),
+                    commit);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
-      [ids](AsyncRequestImpl &async_request_impl) {
+      [ids, payload](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<uint64_t>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (ids)
             memcpy(ids, result.value().data(),
@@ -133,17 +201,30 @@ void Collection::store_multi(const std::vector<std::string> &records,
                              AsyncRequest *req) const {
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_store_multi;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
+  size_t threshold = client->m_bulk_threshold;
+  std::shared_ptr<BulkBuffer> payload;
+  if (threshold != 0) {
+    size_t size = BulkPayload::packedSize(records);
+    if (size >= threshold) {
+      payload = std::make_shared<BulkBuffer>(client->m_engine, size,
+                                             tl::bulk_mode::read_only);
+      BulkPayload::pack(records, payload->m_data.get());
+    }
+  }
   auto async_response =
-      rpc.on(ph).async(db_name, self->m_name, records, commit);
+      payload ? client->m_coll_store_multi_bulk.on(ph).async(
+                    db_name, self->m_name, payload->m_bulk, commit)
+              : client->m_coll_store_multi.on(ph).async(db_name, self->m_name,
+                                                         records, commit);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
-      [ids](AsyncRequestImpl &async_request_impl) {
+      [ids, payload](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<uint64_t>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (ids)
             memcpy(ids, result.value().data(),
@@ -158,6 +239,15 @@ void Collection::store_multi(const std::vector<std::string> &records,
     AsyncRequest(std::move(async_request_impl)).wait();
 }
 
+BufferedWriter Collection::buffered_writer(size_t max_records,
+                                          size_t max_bytes, double max_delay,
+                                          bool commit) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  return BufferedWriter(std::make_shared<BufferedWriterImpl>(
+      *this, max_records, max_bytes, max_delay, commit));
+}
+
 void Collection::fetch(uint64_t id, std::string *out, AsyncRequest *req) const {
   if (not out)
     return;
@@ -172,7 +262,7 @@ void Collection::fetch(uint64_t id, std::string *out, AsyncRequest *req) const {
   async_request_impl->m_wait_callback =
       [out](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::string> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           *out = std::move(result.value());
         } else {
@@ -186,20 +276,29 @@ void Collection::fetch(uint64_t id, std::string *out, AsyncRequest *req) const {
 }
 
 void Collection::fetch(uint64_t id, json *out, AsyncRequest *req) const {
+  fetch(id, std::vector<std::string>(), out, req);
+}
+
+void Collection::fetch(uint64_t id, const std::vector<std::string> &fields,
+                       json *out, AsyncRequest *req) const {
   if (not out)
     return;
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_fetch_json;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
-  auto async_response = rpc.on(ph).async(db_name, self->m_name, id);
+  auto async_response =
+      fields.empty() ? client->m_coll_fetch_json.on(ph).async(
+                           db_name, self->m_name, id)
+                     : client->m_coll_fetch_json_projected.on(ph).async(
+                           db_name, self->m_name, id, fields);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out, self = self](AsyncRequestImpl &async_request_impl) {
         RequestResult<JsonWrapper> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           *out = std::move(result.value().m_object);
         } else {
@@ -212,6 +311,43 @@ void Collection::fetch(uint64_t id, json *out, AsyncRequest *req) const {
     AsyncRequest(std::move(async_request_impl)).wait();
 }
 
+void Collection::fetch(uint64_t id, RecordView *out, AsyncRequest *req) const {
+  fetch(id, std::vector<std::string>(), out, req);
+}
+
+void Collection::fetch(uint64_t id, const std::vector<std::string> &fields,
+                       RecordView *out, AsyncRequest *req) const {
+  if (not out)
+    return;
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &client = self->m_database->m_client;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response =
+      fields.empty() ? client->m_coll_fetch_json.on(ph).async(
+                           db_name, self->m_name, id)
+                     : client->m_coll_fetch_json_projected.on(ph).async(
+                           db_name, self->m_name, id, fields);
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [out](AsyncRequestImpl &async_request_impl) {
+        // the record is kept encoded instead of being loaded as a JsonWrapper
+        RequestResult<JsonCompactBuffer> result =
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          *out = RecordView::fromBuffer(std::move(result.value().m_data));
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
 void Collection::fetch_multi(const uint64_t *ids, size_t count,
                              std::vector<std::string> *out,
                              AsyncRequest *req) const {
@@ -219,17 +355,32 @@ void Collection::fetch_multi(const uint64_t *ids, size_t count,
     return;
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_fetch_multi;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
   std::vector<uint64_t> ids_vec(ids, ids + count);
+  size_t threshold = client->m_bulk_threshold;
+  if (threshold != 0) {
+    auto &coll_name = self->m_name;
+    auto send = [client, ph, db_name, coll_name, ids_vec, threshold]() {
+      return client->m_coll_fetch_multi_bulk.on(ph).async(
+          db_name, coll_name, ids_vec, (uint64_t)threshold);
+    };
+    auto async_request_impl = bulkRead(client, ph, send, out);
+    if (req)
+      *req = AsyncRequest(std::move(async_request_impl));
+    else
+      AsyncRequest(std::move(async_request_impl)).wait();
+    return;
+  }
+  auto &rpc = client->m_coll_fetch_multi;
   auto async_response = rpc.on(ph).async(db_name, self->m_name, ids_vec);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<std::string>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           *out = std::move(result.value());
         } else {
@@ -244,21 +395,31 @@ void Collection::fetch_multi(const uint64_t *ids, size_t count,
 
 void Collection::fetch_multi(const uint64_t *ids, size_t count,
                              json *out, AsyncRequest *req) const {
+  fetch_multi(ids, count, std::vector<std::string>(), out, req);
+}
+
+void Collection::fetch_multi(const uint64_t *ids, size_t count,
+                             const std::vector<std::string> &fields,
+                             json *out, AsyncRequest *req) const {
   if (not out)
     return;
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_fetch_multi_json;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
   std::vector<uint64_t> ids_vec(ids, ids + count);
-  auto async_response = rpc.on(ph).async(db_name, self->m_name, ids_vec);
+  auto async_response =
+      fields.empty() ? client->m_coll_fetch_multi_json.on(ph).async(
+                           db_name, self->m_name, ids_vec)
+                     : client->m_coll_fetch_multi_json_projected.on(ph).async(
+                           db_name, self->m_name, ids_vec, fields);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out, self = self](AsyncRequestImpl &async_request_impl) {
         RequestResult<JsonWrapper> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           *out = std::move(result.value().m_object);
         } else {
@@ -271,6 +432,52 @@ void Collection::fetch_multi(const uint64_t *ids, size_t count,
     AsyncRequest(std::move(async_request_impl)).wait();
 }
 
+void Collection::fetch_multi(const uint64_t *ids, size_t count,
+                             std::vector<RecordView> *out,
+                             AsyncRequest *req) const {
+  fetch_multi(ids, count, std::vector<std::string>(), out, req);
+}
+
+void Collection::fetch_multi(const uint64_t *ids, size_t count,
+                             const std::vector<std::string> &fields,
+                             std::vector<RecordView> *out,
+                             AsyncRequest *req) const {
+  if (not out)
+    return;
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &client = self->m_database->m_client;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  std::vector<uint64_t> ids_vec(ids, ids + count);
+  auto async_response =
+      fields.empty() ? client->m_coll_fetch_multi_json.on(ph).async(
+                           db_name, self->m_name, ids_vec)
+                     : client->m_coll_fetch_multi_json_projected.on(ph).async(
+                           db_name, self->m_name, ids_vec, fields);
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [out](AsyncRequestImpl &async_request_impl) {
+        RequestResult<JsonCompactBuffer> result =
+            async_request_impl.m_async_response->wait();
+        if (not result.success())
+          throw Exception(result.error());
+        auto records = RecordView::fromBuffer(std::move(result.value().m_data));
+        if (not records.is_array())
+          throw Exception("Invalid records received (expected an array)");
+        size_t size = records.size();
+        out->clear();
+        out->reserve(size);
+        for (size_t i = 0; i < size; i++)
+          out->push_back(records[i]);
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
 void Collection::filter(const std::string &filterCode,
                         std::vector<std::string> *out,
                         AsyncRequest *req) const {
@@ -285,7 +492,7 @@ void Collection::filter(const std::string &filterCode,
   async_request_impl->m_wait_callback =
       [out](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<std::string>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (out)
             *out = std::move(result.value());
@@ -301,18 +508,123 @@ void Collection::filter(const std::string &filterCode,
 
 void Collection::filter(const std::string &filterCode, json *out,
                         AsyncRequest *req) const {
+  filter(filterCode, std::vector<std::string>(), out, req);
+}
+
+void Collection::filter(const std::string &filterCode,
+                        const std::vector<std::string> &fields, json *out,
+                        AsyncRequest *req) const {
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_filter_json;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
-  auto async_response = rpc.on(ph).async(db_name, self->m_name, filterCode);
+  auto async_response =
+      fields.empty() ? client->m_coll_filter_json.on(ph).async(
+                           db_name, self->m_name, filterCode)
+                     : client->m_coll_filter_json_projected.on(ph).async(
+                           db_name, self->m_name, filterCode, fields);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out, self = self](AsyncRequestImpl &async_request_impl) {
         RequestResult<JsonWrapper> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          if (out)
+            *out = std::move(result.value().m_object);
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+void Collection::filter_predicate(const json &predicate,
+                                  std::vector<std::string> *out,
+                                  AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_filter_predicate;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response = rpc.on(ph).async(db_name, self->m_name,
+                                         ConstJsonRefWrapper(predicate));
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [out](AsyncRequestImpl &async_request_impl) {
+        RequestResult<std::vector<std::string>> result =
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          if (out)
+            *out = std::move(result.value());
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+void Collection::filter_predicate(const json &predicate, json *out,
+                                  AsyncRequest *req) const {
+  filter_predicate(predicate, std::vector<std::string>(), out, req);
+}
+
+void Collection::filter_predicate(const json &predicate,
+                                  const std::vector<std::string> &fields,
+                                  json *out, AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &client = self->m_database->m_client;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response =
+      fields.empty()
+          ? client->m_coll_filter_predicate_json.on(ph).async(
+                db_name, self->m_name, ConstJsonRefWrapper(predicate))
+          : client->m_coll_filter_predicate_json_projected.on(ph).async(
+                db_name, self->m_name, ConstJsonRefWrapper(predicate), fields);
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [out](AsyncRequestImpl &async_request_impl) {
+        RequestResult<JsonWrapper> result =
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          if (out)
+            *out = std::move(result.value().m_object);
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+void Collection::aggregate(const json &pipeline, json *out,
+                           AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_aggregate;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response = rpc.on(ph).async(db_name, self->m_name,
+                                         ConstJsonRefWrapper(pipeline));
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [out](AsyncRequestImpl &async_request_impl) {
+        RequestResult<JsonWrapper> result =
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (out)
             *out = std::move(result.value().m_object);
@@ -339,7 +651,7 @@ void Collection::update(uint64_t id, const std::string &record, bool commit,
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [](AsyncRequestImpl &async_request_impl) {
-        RequestResult<bool> result = async_request_impl.m_async_response.wait();
+        RequestResult<bool> result = async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         }
@@ -365,7 +677,7 @@ void Collection::update(uint64_t id, const json &record, bool commit,
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [](AsyncRequestImpl &async_request_impl) {
-        RequestResult<bool> result = async_request_impl.m_async_response.wait();
+        RequestResult<bool> result = async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         }
@@ -393,7 +705,7 @@ void Collection::update_multi(const uint64_t *ids,
   async_request_impl->m_wait_callback =
       [updated](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<bool>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         } else {
@@ -429,7 +741,7 @@ void Collection::update_multi(const uint64_t *ids, const json &records,
   async_request_impl->m_wait_callback =
       [updated](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<bool>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         } else {
@@ -449,16 +761,31 @@ void Collection::all(std::vector<std::string> *out, AsyncRequest *req) const {
     return;
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_all;
+  auto &client = self->m_database->m_client;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
+  size_t threshold = client->m_bulk_threshold;
+  if (threshold != 0) {
+    auto &coll_name = self->m_name;
+    auto send = [client, ph, db_name, coll_name, threshold]() {
+      return client->m_coll_all_bulk.on(ph).async(db_name, coll_name,
+                                                  (uint64_t)threshold);
+    };
+    auto async_request_impl = bulkRead(client, ph, send, out);
+    if (req)
+      *req = AsyncRequest(std::move(async_request_impl));
+    else
+      AsyncRequest(std::move(async_request_impl)).wait();
+    return;
+  }
+  auto &rpc = client->m_coll_all;
   auto async_response = rpc.on(ph).async(db_name, self->m_name);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out](AsyncRequestImpl &async_request_impl) {
         RequestResult<std::vector<std::string>> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           *out = std::move(result.value());
         } else {
@@ -472,18 +799,41 @@ void Collection::all(std::vector<std::string> *out, AsyncRequest *req) const {
 }
 
 void Collection::all(json *out, AsyncRequest *req) const {
+  all(std::vector<std::string>(), out, req);
+}
+
+Cursor Collection::open_cursor(const json &predicate,
+                               const std::vector<std::string> &fields) const {
   if (not self)
     throw Exception("Invalid sonata::Collection object");
-  auto &rpc = self->m_database->m_client->m_coll_all_json;
+  auto &rpc = self->m_database->m_client->m_cursor_open;
   auto &ph = self->m_database->m_ph;
   auto &db_name = self->m_database->m_name;
-  auto async_response = rpc.on(ph).async(db_name, self->m_name);
+  RequestResult<uint64_t> result = rpc.on(ph)(
+      db_name, self->m_name, ConstJsonRefWrapper(predicate), fields);
+  if (not result.success())
+    throw Exception(result.error());
+  return Cursor(std::make_shared<CursorImpl>(self->m_database, result.value()));
+}
+
+void Collection::all(const std::vector<std::string> &fields, json *out,
+                     AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &client = self->m_database->m_client;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response =
+      fields.empty() ? client->m_coll_all_json.on(ph).async(db_name,
+                                                             self->m_name)
+                     : client->m_coll_all_json_projected.on(ph).async(
+                           db_name, self->m_name, fields);
   auto async_request_impl =
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [out, self = self](AsyncRequestImpl &async_request_impl) {
         RequestResult<JsonWrapper> result =
-            async_request_impl.m_async_response.wait();
+            async_request_impl.m_async_response->wait();
         if (result.success()) {
           if (out)
             *out = std::move(result.value().m_object);
@@ -532,7 +882,7 @@ void Collection::erase(uint64_t id, bool commit, AsyncRequest *req) const {
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [](AsyncRequestImpl &async_request_impl) {
-        RequestResult<bool> result = async_request_impl.m_async_response.wait();
+        RequestResult<bool> result = async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         }
@@ -557,7 +907,7 @@ void Collection::erase_multi(const uint64_t *ids, size_t count, bool commit,
       std::make_shared<AsyncRequestImpl>(std::move(async_response));
   async_request_impl->m_wait_callback =
       [](AsyncRequestImpl &async_request_impl) {
-        RequestResult<bool> result = async_request_impl.m_async_response.wait();
+        RequestResult<bool> result = async_request_impl.m_async_response->wait();
         if (!result.success()) {
           throw Exception(result.error());
         }
@@ -568,4 +918,100 @@ void Collection::erase_multi(const uint64_t *ids, size_t count, bool commit,
     AsyncRequest(std::move(async_request_impl)).wait();
 }
 
+void Collection::create_index(const std::string &field) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_create_index;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  RequestResult<bool> result = rpc.on(ph)(db_name, self->m_name, field);
+  if (not result.success())
+    throw Exception(result.error());
+}
+
+void Collection::drop_index(const std::string &field) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_drop_index;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  RequestResult<bool> result = rpc.on(ph)(db_name, self->m_name, field);
+  if (not result.success())
+    throw Exception(result.error());
+}
+
+void Collection::query(const std::string &field, const json &value,
+                       std::vector<uint64_t> *ids, AsyncRequest *req) const {
+  if (value.is_null())
+    throw Exception("Cannot query an index for a null value");
+  query_range(field, value, value, ids, req);
+}
+
+void Collection::query(const std::string &field, const json &value,
+                       json *records, AsyncRequest *req) const {
+  if (value.is_null())
+    throw Exception("Cannot query an index for a null value");
+  query_range(field, value, value, records, req);
+}
+
+void Collection::query_range(const std::string &field, const json &lower,
+                             const json &upper, std::vector<uint64_t> *ids,
+                             AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_query_index;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response =
+      rpc.on(ph).async(db_name, self->m_name, field,
+                       ConstJsonRefWrapper(lower), ConstJsonRefWrapper(upper));
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [ids](AsyncRequestImpl &async_request_impl) {
+        RequestResult<std::vector<uint64_t>> result =
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          if (ids)
+            *ids = std::move(result.value());
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
+void Collection::query_range(const std::string &field, const json &lower,
+                             const json &upper, json *records,
+                             AsyncRequest *req) const {
+  if (not self)
+    throw Exception("Invalid sonata::Collection object");
+  auto &rpc = self->m_database->m_client->m_coll_query_index_json;
+  auto &ph = self->m_database->m_ph;
+  auto &db_name = self->m_database->m_name;
+  auto async_response =
+      rpc.on(ph).async(db_name, self->m_name, field,
+                       ConstJsonRefWrapper(lower), ConstJsonRefWrapper(upper));
+  auto async_request_impl =
+      std::make_shared<AsyncRequestImpl>(std::move(async_response));
+  async_request_impl->m_wait_callback =
+      [records](AsyncRequestImpl &async_request_impl) {
+        RequestResult<JsonWrapper> result =
+            async_request_impl.m_async_response->wait();
+        if (result.success()) {
+          if (records)
+            *records = std::move(result.value().m_object);
+        } else {
+          throw Exception(result.error());
+        }
+      };
+  if (req)
+    *req = AsyncRequest(std::move(async_request_impl));
+  else
+    AsyncRequest(std::move(async_request_impl)).wait();
+}
+
 } // namespace sonata
@@ -0,0 +1,95 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "sonata/Cursor.hpp"
+#include "sonata/Exception.hpp"
+#include "sonata/JsonSerialize.hpp"
+#include "sonata/RequestResult.hpp"
+
+#include "ClientImpl.hpp"
+#include "CursorImpl.hpp"
+#include "DatabaseImpl.hpp"
+
+#include <thallium/serialization/stl/vector.hpp>
+#include <thallium/serialization/stl/string.hpp>
+
+namespace sonata {
+
+CursorImpl::~CursorImpl() {
+  if (m_closed || !m_database)
+    return;
+  // the cursor is closed asynchronously, its destruction does not wait
+  // for a round trip to the provider
+  try {
+    m_database->m_client->closeCursorAsync(m_database->m_ph, m_id);
+  } catch (...) {
+  }
+}
+
+Cursor::Cursor() = default;
+
+Cursor::Cursor(const std::shared_ptr<CursorImpl> &impl) : self(impl) {}
+
+Cursor::Cursor(const Cursor &) = default;
+
+Cursor::Cursor(Cursor &&) = default;
+
+Cursor &Cursor::operator=(const Cursor &) = default;
+
+Cursor &Cursor::operator=(Cursor &&) = default;
+
+Cursor::~Cursor() = default;
+
+Cursor::operator bool() const { return static_cast<bool>(self); }
+
+bool Cursor::next(std::vector<std::string> *out, size_t max_records,
+                  size_t max_bytes) const {
+  if (not self)
+    throw Exception("Invalid sonata::Cursor object");
+  if (self->m_closed)
+    throw Exception("Cursor was closed");
+  auto &rpc = self->m_database->m_client->m_cursor_next;
+  auto &ph = self->m_database->m_ph;
+  RequestResult<std::vector<std::string>> result =
+      rpc.on(ph)(self->m_id, max_records, max_bytes);
+  if (not result.success())
+    throw Exception(result.error());
+  bool more = !result.value().empty();
+  if (out)
+    *out = std::move(result.value());
+  return more;
+}
+
+bool Cursor::next(json *out, size_t max_records, size_t max_bytes) const {
+  if (not self)
+    throw Exception("Invalid sonata::Cursor object");
+  if (self->m_closed)
+    throw Exception("Cursor was closed");
+  auto &rpc = self->m_database->m_client->m_cursor_next_json;
+  auto &ph = self->m_database->m_ph;
+  RequestResult<JsonWrapper> result =
+      rpc.on(ph)(self->m_id, max_records, max_bytes);
+  if (not result.success())
+    throw Exception(result.error());
+  bool more = !result.value()->empty();
+  if (out)
+    *out = std::move(result.value().m_object);
+  return more;
+}
+
+void Cursor::close() const {
+  if (not self)
+    throw Exception("Invalid sonata::Cursor object");
+  if (self->m_closed)
+    return;
+  self->m_closed = true;
+  auto &rpc = self->m_database->m_client->m_cursor_close;
+  auto &ph = self->m_database->m_ph;
+  RequestResult<bool> result = rpc.on(ph)(self->m_id);
+  if (not result.success())
+    throw Exception(result.error());
+}
+
+} // namespace sonata
@@ -0,0 +1,34 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_CURSOR_IMPL_H
+#define __SONATA_CURSOR_IMPL_H
+
+#include <cstdint>
+#include <memory>
+
+namespace sonata {
+
+class DatabaseImpl;
+
+class CursorImpl {
+
+public:
+  std::shared_ptr<DatabaseImpl> m_database;
+  uint64_t m_id = 0;
+  bool m_closed = false;
+
+  CursorImpl() = default;
+
+  CursorImpl(const std::shared_ptr<DatabaseImpl> &db, uint64_t id)
+      : m_database(db), m_id(id) {}
+
+  // closes the server-side cursor if close() was not called
+  ~CursorImpl();
+};
+
+} // namespace sonata
+
+#endif
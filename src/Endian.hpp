@@ -3,6 +3,9 @@
  *
  * See COPYRIGHT in top-level directory.
  */
+#ifndef __SONATA_ENDIAN_HPP
+#define __SONATA_ENDIAN_HPP
+
 #include <cstdint>
 #include <utility>
 
@@ -33,3 +36,5 @@ class Endian
 };
 
 } // namespace sonata
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_FETCH_MERGE_HPP
+#define __SONATA_FETCH_MERGE_HPP
+
+#include "sonata/Backend.hpp"
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief Used by backends wrapping another backend (cache, aggregator)
+ * that can serve some of the records of a fetchMulti themselves.
+ * found[i] is the record with id record_ids[i] if the wrapper has it
+ * (and is discarded otherwise), and missing lists the ids of the other
+ * records, in order. The missing records are fetched from db and merged
+ * with the found ones, in the order of record_ids, and on_fetched(id,
+ * record) is called for each record coming from db.
+ *
+ * Some backends skip the records they can't find, in which case the
+ * missing records are fetched one by one to keep them in order.
+ */
+template <typename F>
+RequestResult<std::vector<std::string>>
+mergeFetchMulti(Backend &db, const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const std::vector<json> &found,
+                const std::vector<uint64_t> &missing, F &&on_fetched) {
+  RequestResult<std::vector<std::string>> inner;
+  if (!missing.empty()) {
+    inner = db.fetchMulti(coll_name, missing);
+    if (!inner.success())
+      return inner;
+  }
+  bool aligned = inner.value().size() == missing.size();
+  RequestResult<std::vector<std::string>> result;
+  for (size_t i = 0, j = 0; i < record_ids.size(); i++) {
+    if (!found[i].is_discarded()) {
+      result.value().push_back(found[i].dump());
+      continue;
+    }
+    if (aligned) {
+      result.value().push_back(std::move(inner.value()[j++]));
+    } else {
+      auto one = db.fetch(coll_name, record_ids[i]);
+      if (!one.success())
+        continue;
+      result.value().push_back(std::move(one.value()));
+    }
+    on_fetched(record_ids[i], result.value().back());
+  }
+  return result;
+}
+
+/**
+ * @brief Same as mergeFetchMulti for fetchMultiJson. The found records
+ * are moved into the result.
+ */
+template <typename F>
+RequestResult<JsonWrapper>
+mergeFetchMultiJson(Backend &db, const std::string &coll_name,
+                    const std::vector<uint64_t> &record_ids,
+                    std::vector<json> &found,
+                    const std::vector<uint64_t> &missing, F &&on_fetched) {
+  RequestResult<JsonWrapper> inner;
+  if (!missing.empty()) {
+    inner = db.fetchMultiJson(coll_name, missing);
+    if (!inner.success())
+      return inner;
+  }
+  bool aligned = inner.value()->size() == missing.size();
+  RequestResult<JsonWrapper> result;
+  result.value() = json::array();
+  for (size_t i = 0, j = 0; i < record_ids.size(); i++) {
+    if (!found[i].is_discarded()) {
+      result.value()->push_back(std::move(found[i]));
+      continue;
+    }
+    if (aligned) {
+      result.value()->push_back(std::move(inner.value().m_object[j++]));
+    } else {
+      auto one = db.fetchJson(coll_name, record_ids[i]);
+      if (!one.success())
+        continue;
+      result.value()->push_back(std::move(one.value().m_object));
+    }
+    on_fetched(record_ids[i], result.value()->back());
+  }
+  return result;
+}
+
+} // namespace sonata
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_JSON_AGGREGATION_HPP
+#define __SONATA_JSON_AGGREGATION_HPP
+
+#include "JsonPath.hpp"
+#include "JsonPredicate.hpp"
+#include <sonata/Exception.hpp>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+using namespace std::string_literals;
+
+/**
+ * @brief A JsonAggregation is an aggregation pipeline expressed in JSON,
+ * compiled once and then fed the records of a collection one by one.
+ * The pipeline has the following form (only "reductions" is required):
+ *
+ * {
+ *   "predicate": <predicate>,
+ *   "group_by": "a.b",
+ *   "reductions": [{"op": <op>, "field": "x.y", "as": "name"}, ...]
+ * }
+ *
+ * The predicate (see JsonPredicate) selects the records to aggregate.
+ * Without "group_by", the result is an array with a single row. With it,
+ * the result has one row per distinct value of the field (records that do
+ * not have it are grouped under null), ordered by value, and each row has
+ * the group_by field set to this value.
+ *
+ * <op> is one of "count", "sum", "min", "max" or "avg". "count" counts the
+ * records, or only those that have the field if one is given. The other
+ * operators require a field; "sum" and "avg" only consider numbers and
+ * "min" and "max" consider all non-null values, ordered as in secondary
+ * indexes. If no value was found in a group, "sum" produces 0 and the
+ * others produce null. Each reduction is written in the row under the
+ * name given by "as", or by default "count" or <op>_<field>.
+ */
+class JsonAggregation {
+
+  enum class Op { Count, Sum, Min, Max, Avg };
+
+  struct Reduction {
+    Op op;
+    bool has_field = false;
+    JsonPath path;
+    std::string name;
+  };
+
+  struct Accumulator {
+    uint64_t count = 0;
+    bool has_float = false;
+    int64_t int_sum = 0;
+    double float_sum = 0.0;
+    json value; // current min or max
+  };
+
+public:
+  JsonAggregation() = default;
+
+  /**
+   * @brief Compiles a pipeline, throwing an Exception if it is
+   * not well-formed.
+   */
+  explicit JsonAggregation(const json &pipeline) {
+    if (!pipeline.is_object())
+      throw Exception("Aggregation pipeline should be a JSON object");
+    for (auto it = pipeline.begin(); it != pipeline.end(); ++it) {
+      if (it.key() == "predicate") {
+        m_predicate = JsonPredicate(it.value());
+      } else if (it.key() == "group_by") {
+        if (!it.value().is_string())
+          throw Exception("\"group_by\" should be a string");
+        m_has_group_by = true;
+        m_group_by = JsonPath(it.value().get<std::string>());
+      } else if (it.key() == "reductions") {
+        if (!it.value().is_array() || it.value().empty())
+          throw Exception("\"reductions\" should be a non-empty array");
+        for (auto &r : it.value())
+          m_reductions.push_back(compileReduction(r));
+      } else {
+        throw Exception("Unknown aggregation pipeline key \""s + it.key() +
+                        "\"");
+      }
+    }
+    if (m_reductions.empty())
+      throw Exception("Aggregation pipeline has no \"reductions\"");
+  }
+
+  /**
+   * @brief Returns the predicate selecting the records to aggregate,
+   * so that backends can use it to find candidate records.
+   */
+  const JsonPredicate &predicate() const { return m_predicate; }
+
+  /**
+   * @brief Aggregates a record, if it matches the predicate.
+   */
+  void add(const json &record) {
+    if (!m_predicate(record))
+      return;
+    json key;
+    if (m_has_group_by) {
+      const json *value = m_group_by.lookup(record);
+      if (value)
+        key = *value;
+    }
+    auto it = m_groups.find(key);
+    if (it == m_groups.end())
+      it = m_groups.emplace(std::move(key),
+                            std::vector<Accumulator>(m_reductions.size()))
+               .first;
+    auto &accumulators = it->second;
+    for (size_t i = 0; i < m_reductions.size(); i++)
+      accumulate(m_reductions[i], accumulators[i], record);
+  }
+
+  /**
+   * @brief Returns the aggregated rows as a JSON array.
+   */
+  json result() const {
+    json rows = json::array();
+    if (!m_has_group_by && m_groups.empty()) {
+      rows.push_back(makeRow(json(), std::vector<Accumulator>(
+                                         m_reductions.size())));
+      return rows;
+    }
+    for (auto &group : m_groups)
+      rows.push_back(makeRow(group.first, group.second));
+    return rows;
+  }
+
+private:
+  JsonPredicate m_predicate;
+  bool m_has_group_by = false;
+  JsonPath m_group_by;
+  std::vector<Reduction> m_reductions;
+  std::map<json, std::vector<Accumulator>> m_groups;
+
+  static Reduction compileReduction(const json &reduction) {
+    if (!reduction.is_object())
+      throw Exception("Reduction should be a JSON object");
+    auto op = reduction.find("op");
+    if (op == reduction.end() || !op->is_string())
+      throw Exception("Reduction should have an \"op\" string");
+    Reduction r;
+    auto op_name = op->get<std::string>();
+    if (op_name == "count")
+      r.op = Op::Count;
+    else if (op_name == "sum")
+      r.op = Op::Sum;
+    else if (op_name == "min")
+      r.op = Op::Min;
+    else if (op_name == "max")
+      r.op = Op::Max;
+    else if (op_name == "avg")
+      r.op = Op::Avg;
+    else
+      throw Exception("Unknown reduction operator \""s + op_name + "\"");
+    auto field = reduction.find("field");
+    if (field != reduction.end()) {
+      if (!field->is_string())
+        throw Exception("Reduction \"field\" should be a string");
+      r.has_field = true;
+      r.path = JsonPath(field->get<std::string>());
+    } else if (r.op != Op::Count) {
+      throw Exception("Reduction \""s + op_name + "\" requires a \"field\"");
+    }
+    auto as = reduction.find("as");
+    if (as != reduction.end()) {
+      if (!as->is_string())
+        throw Exception("Reduction \"as\" should be a string");
+      r.name = as->get<std::string>();
+    } else if (r.has_field) {
+      r.name = op_name + "_" + r.path.str();
+    } else {
+      r.name = op_name;
+    }
+    return r;
+  }
+
+  static void accumulate(const Reduction &r, Accumulator &acc,
+                         const json &record) {
+    if (!r.has_field) {
+      acc.count += 1;
+      return;
+    }
+    const json *value = r.path.lookup(record);
+    if (!value)
+      return;
+    switch (r.op) {
+    case Op::Count:
+      acc.count += 1;
+      break;
+    case Op::Sum:
+    case Op::Avg:
+      if (value->is_number_integer()) {
+        acc.int_sum += value->get<int64_t>();
+      } else if (value->is_number_float()) {
+        acc.has_float = true;
+        acc.float_sum += value->get<double>();
+      } else {
+        break;
+      }
+      acc.count += 1;
+      break;
+    case Op::Min:
+    case Op::Max:
+      if (value->is_null())
+        break;
+      if (acc.count == 0 || (r.op == Op::Min ? *value < acc.value
+                                             : acc.value < *value))
+        acc.value = *value;
+      acc.count += 1;
+      break;
+    }
+  }
+
+  json makeRow(const json &key,
+               const std::vector<Accumulator> &accumulators) const {
+    json row = json::object();
+    if (m_has_group_by)
+      row[m_group_by.str()] = key;
+    for (size_t i = 0; i < m_reductions.size(); i++) {
+      auto &r = m_reductions[i];
+      auto &acc = accumulators[i];
+      json &out = row[r.name];
+      switch (r.op) {
+      case Op::Count:
+        out = acc.count;
+        break;
+      case Op::Sum:
+        if (acc.has_float)
+          out = acc.float_sum + (double)acc.int_sum;
+        else
+          out = acc.int_sum;
+        break;
+      case Op::Avg:
+        if (acc.count != 0)
+          out = (acc.float_sum + (double)acc.int_sum) / (double)acc.count;
+        break;
+      case Op::Min:
+      case Op::Max:
+        out = acc.value;
+        break;
+      }
+    }
+    return row;
+  }
+};
+
+} // namespace sonata
+
+#endif
@@ -19,6 +19,7 @@ std::unique_ptr<Backend> JsonCppBackend::create(const thallium::engine &engine,
   spdlog::trace("[jsoncpp] Creating JsonCpp database");
   int ret;
   auto backend = std::make_unique<JsonCppBackend>();
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[jsoncpp] Successfully created database");
   return backend;
 }
@@ -29,6 +30,7 @@ std::unique_ptr<Backend> JsonCppBackend::attach(const thallium::engine &engine,
   spdlog::trace("[jsoncpp] Opening JsonCpp database");
   int ret;
   auto backend = std::make_unique<JsonCppBackend>();
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[jsoncpp] Successfully opened database");
   return backend;
 }
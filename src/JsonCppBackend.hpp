@@ -9,6 +9,10 @@
 #include "sonata/Admin.hpp"
 #include "sonata/Backend.hpp"
 #include "sonata/Client.hpp"
+#include "JsonAggregation.hpp"
+#include "JsonPredicate.hpp"
+#include "ParallelScan.hpp"
+#include "ReservedIds.hpp"
 
 #include <cstdio>
 #include <fstream>
@@ -82,6 +86,7 @@ public:
     if (m_collections.count(coll_name)) {
       m_collections.erase(coll_name);
       m_collection_size.erase(coll_name);
+      m_reserved.erase(coll_name);
       result.success() = true;
     } else {
       result.error() = "Collection does not exist";
@@ -183,6 +188,71 @@ public:
     return result;
   }
 
+  virtual RequestResult<uint64_t> reserveIds(const std::string &coll_name,
+                                             size_t count) override {
+    RequestResult<uint64_t> result;
+    std::lock_guard<tl::mutex> guard(m_mutex);
+    if (m_collections.count(coll_name) == 0) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    auto &collection = m_collections[coll_name];
+    // reserved ids are null records, like erased ones
+    result.value() = collection.size();
+    for (size_t i = 0; i < count; i++)
+      collection.push_back(json());
+    m_reserved[coll_name].add(result.value(), count);
+    return result;
+  }
+
+  virtual RequestResult<bool>
+  storeReserved(const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const JsonWrapper &records, bool commit) override {
+    RequestResult<bool> result;
+    if (!records->is_array() || records->size() != record_ids.size()) {
+      result.success() = false;
+      result.error() = "Invalid number of records";
+      return result;
+    }
+    std::lock_guard<tl::mutex> guard(m_mutex);
+    if (m_collections.count(coll_name) == 0) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    auto &collection = m_collections[coll_name];
+    // check all the ids before storing anything, on a copy of the
+    // reserved ids so that an id used twice in this call is rejected
+    auto reserved = m_reserved[coll_name];
+    for (size_t i = 0; i < record_ids.size(); i++) {
+      auto id = record_ids[i];
+      if (!reserved.contains(id)) {
+        result.success() = false;
+        result.error() = "Record id " + std::to_string(id) +
+                         " was not reserved";
+        return result;
+      }
+      reserved.remove(id);
+      if (!records.m_object[i].is_object()) {
+        result.success() = false;
+        result.error() = "JSON object is not an object";
+        return result;
+      }
+    }
+    for (size_t i = 0; i < record_ids.size(); i++) {
+      auto id = record_ids[i];
+      collection[id] = records.m_object[i];
+      collection[id]["__id"] = id;
+    }
+    m_reserved[coll_name] = std::move(reserved);
+    m_collection_size[coll_name] += record_ids.size();
+    return result;
+  }
+
+  bool addsRecordIds() const override { return true; }
+
   virtual RequestResult<std::string> fetch(const std::string &coll_name,
                                            uint64_t record_id) override {
     RequestResult<std::string> result;
@@ -283,6 +353,91 @@ public:
     return result;
   }
 
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name,
+                  const JsonWrapper &predicate) override {
+    RequestResult<std::vector<std::string>> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      const auto &collection = m_collections[coll_name];
+      result.value() = m_scan.run<std::string>(
+          collection.size(),
+          [&collection, &pred](size_t begin, size_t end,
+                               std::vector<std::string> &records) {
+            for (size_t i = begin; i < end; i++) {
+              auto &r = collection[i];
+              if (!r.is_null() && pred(r))
+                records.push_back(r.dump());
+            }
+          });
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      const auto &collection = m_collections[coll_name];
+      auto records = m_scan.run<json>(
+          collection.size(),
+          [&collection, &pred](size_t begin, size_t end,
+                               std::vector<json> &records) {
+            for (size_t i = begin; i < end; i++) {
+              auto &r = collection[i];
+              if (!r.is_null() && pred(r))
+                records.push_back(r);
+            }
+          });
+      result.value() = json(std::move(records));
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name,
+            const JsonWrapper &pipeline) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      JsonAggregation aggregation(pipeline.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      for (auto &r : m_collections[coll_name]) {
+        if (!r.is_null())
+          aggregation.add(r);
+      }
+      result.value() = aggregation.result();
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
   virtual RequestResult<bool> update(const std::string &coll_name,
                                      uint64_t record_id,
                                      const std::string &new_content,
@@ -518,6 +673,7 @@ public:
     result.value() = true;
     m_collections.clear();
     m_collection_size.clear();
+    m_reserved.clear();
     return result;
   }
 
@@ -526,7 +682,10 @@ public:
 private:
   std::unordered_map<std::string, json> m_collections;
   std::unordered_map<std::string, size_t> m_collection_size;
+  // ids handed out by reserveIds and not used by storeReserved yet
+  std::unordered_map<std::string, ReservedIds> m_reserved;
   tl::mutex m_mutex;
+  ParallelScan m_scan; // used by filterPredicate(Json)
 };
 
 } // namespace sonata
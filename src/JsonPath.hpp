@@ -0,0 +1,66 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_JSON_PATH_HPP
+#define __SONATA_JSON_PATH_HPP
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief A JsonPath is a dot-separated field path (e.g. "rank" or
+ * "func.name") that is split once so that it can be looked up
+ * efficiently in many records.
+ */
+class JsonPath {
+
+public:
+  JsonPath() = default;
+
+  explicit JsonPath(const std::string &field) : m_field(field) {
+    size_t start = 0;
+    while (true) {
+      size_t end = field.find('.', start);
+      m_keys.push_back(field.substr(start, end - start));
+      if (end == std::string::npos)
+        break;
+      start = end + 1;
+    }
+  }
+
+  const std::string &str() const { return m_field; }
+
+  const std::vector<std::string> &keys() const { return m_keys; }
+
+  /**
+   * @brief Returns a pointer to the value found at this path
+   * in the record, or nullptr if the record does not have it.
+   */
+  const json *lookup(const json &record) const {
+    const json *current = &record;
+    for (auto &key : m_keys) {
+      if (!current->is_object())
+        return nullptr;
+      auto it = current->find(key);
+      if (it == current->end())
+        return nullptr;
+      current = &(*it);
+    }
+    return current;
+  }
+
+private:
+  std::string m_field;
+  std::vector<std::string> m_keys;
+};
+
+} // namespace sonata
+
+#endif
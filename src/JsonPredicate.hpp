@@ -0,0 +1,266 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_JSON_PREDICATE_HPP
+#define __SONATA_JSON_PREDICATE_HPP
+
+#include "JsonPath.hpp"
+#include <sonata/Exception.hpp>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+using namespace std::string_literals;
+
+/**
+ * @brief A JsonPredicate is a filter condition expressed in JSON,
+ * compiled once into a tree of native nodes that can then be evaluated
+ * on any number of records. The following forms are accepted:
+ *
+ * - {} matches every record;
+ * - {"and": [p1, p2, ...]}, {"or": [p1, p2, ...]}, {"not": p};
+ * - {"field": "a.b", <op>: <value>, ...} where <op> is one of
+ *   "eq", "ne", "lt", "le", "gt", "ge", "in" (value is an array of
+ *   candidates) or "exists" (value is a boolean). Several operators on
+ *   the same field are combined with "and", so that a numeric range can
+ *   be written {"field": "x", "ge": 1, "lt": 10}.
+ *
+ * A record that does not have the field only matches "ne" and
+ * {"exists": false}. Ordering operators only match if both sides
+ * are numbers or both are strings.
+ */
+class JsonPredicate {
+
+  enum class Kind { True, And, Or, Not, Eq, Ne, Lt, Le, Gt, Ge, In, Exists };
+
+  struct Node {
+    Kind kind = Kind::True;
+    JsonPath path;
+    json value;
+    std::vector<Node> children;
+  };
+
+public:
+  JsonPredicate() = default;
+
+  /**
+   * @brief Compiles a predicate, throwing an Exception if it is
+   * not well-formed.
+   */
+  explicit JsonPredicate(const json &predicate) {
+    m_root = compile(predicate);
+  }
+
+  /**
+   * @brief Evaluates the predicate on a record.
+   */
+  bool operator()(const json &record) const { return eval(m_root, record); }
+
+  /**
+   * @brief Looks for a field on which the predicate requires an equality
+   * or a range of values, and for which is_indexed(field) returns true,
+   * so that candidate records can be obtained from a secondary index
+   * instead of a full scan. On success, lower and upper are set to the
+   * (inclusive) bounds, null meaning unbounded. The records in this range
+   * are a superset of the matching records, which must still be passed
+   * to operator().
+   */
+  template <typename F>
+  bool indexRange(F &&is_indexed, std::string &field, json &lower,
+                  json &upper) const {
+    std::vector<const Node *> leaves;
+    collectConjunction(m_root, leaves);
+    const std::string *selected = nullptr;
+    for (auto leaf : leaves) {
+      if (is_indexed(leaf->path.str())) {
+        selected = &leaf->path.str();
+        break;
+      }
+    }
+    if (!selected)
+      return false;
+    field = *selected;
+    lower = nullptr;
+    upper = nullptr;
+    for (auto leaf : leaves) {
+      if (leaf->path.str() != field)
+        continue;
+      switch (leaf->kind) {
+      case Kind::Eq:
+        lower = leaf->value;
+        upper = leaf->value;
+        return true;
+      case Kind::Gt:
+      case Kind::Ge:
+        lower = leaf->value;
+        break;
+      case Kind::Lt:
+      case Kind::Le:
+        upper = leaf->value;
+        break;
+      default:
+        break;
+      }
+    }
+    return true;
+  }
+
+private:
+  Node m_root;
+
+  static Node compile(const json &predicate) {
+    Node node;
+    if (!predicate.is_object())
+      throw Exception("Predicate should be a JSON object");
+    if (predicate.empty())
+      return node;
+    if (predicate.contains("and") || predicate.contains("or")) {
+      if (predicate.size() != 1)
+        throw Exception("\"and\"/\"or\" predicates cannot have other keys");
+      bool is_and = predicate.contains("and");
+      auto &args = predicate.begin().value();
+      if (!args.is_array())
+        throw Exception("\""s + predicate.begin().key() +
+                        "\" expects an array of predicates");
+      node.kind = is_and ? Kind::And : Kind::Or;
+      for (auto &arg : args)
+        node.children.push_back(compile(arg));
+      return node;
+    }
+    if (predicate.contains("not")) {
+      if (predicate.size() != 1)
+        throw Exception("\"not\" predicates cannot have other keys");
+      node.kind = Kind::Not;
+      node.children.push_back(compile(predicate["not"]));
+      return node;
+    }
+    auto field = predicate.find("field");
+    if (field == predicate.end() || !field->is_string())
+      throw Exception("Predicate should have a \"field\" string");
+    if (predicate.size() == 1)
+      throw Exception("Predicate on field \""s + field->get<std::string>() +
+                      "\" has no operator");
+    JsonPath path(field->get<std::string>());
+    node.kind = Kind::And;
+    for (auto it = predicate.begin(); it != predicate.end(); ++it) {
+      if (it.key() == "field")
+        continue;
+      Node leaf;
+      leaf.kind = operatorKind(it.key());
+      leaf.path = path;
+      leaf.value = it.value();
+      if (leaf.kind == Kind::In && !leaf.value.is_array())
+        throw Exception("\"in\" expects an array of values");
+      if (leaf.kind == Kind::Exists && !leaf.value.is_boolean())
+        throw Exception("\"exists\" expects a boolean");
+      node.children.push_back(std::move(leaf));
+    }
+    if (node.children.size() == 1)
+      return std::move(node.children[0]);
+    return node;
+  }
+
+  static Kind operatorKind(const std::string &op) {
+    if (op == "eq")
+      return Kind::Eq;
+    if (op == "ne")
+      return Kind::Ne;
+    if (op == "lt")
+      return Kind::Lt;
+    if (op == "le")
+      return Kind::Le;
+    if (op == "gt")
+      return Kind::Gt;
+    if (op == "ge")
+      return Kind::Ge;
+    if (op == "in")
+      return Kind::In;
+    if (op == "exists")
+      return Kind::Exists;
+    throw Exception("Unknown predicate operator \""s + op + "\"");
+  }
+
+  static bool comparable(const json &a, const json &b) {
+    return (a.is_number() && b.is_number()) ||
+           (a.is_string() && b.is_string());
+  }
+
+  static bool eval(const Node &node, const json &record) {
+    switch (node.kind) {
+    case Kind::True:
+      return true;
+    case Kind::And:
+      for (auto &child : node.children)
+        if (!eval(child, record))
+          return false;
+      return true;
+    case Kind::Or:
+      for (auto &child : node.children)
+        if (eval(child, record))
+          return true;
+      return false;
+    case Kind::Not:
+      return !eval(node.children[0], record);
+    default:
+      break;
+    }
+    const json *value = node.path.lookup(record);
+    if (node.kind == Kind::Exists)
+      return (value != nullptr) == node.value.get<bool>();
+    if (node.kind == Kind::Ne)
+      return !value || *value != node.value;
+    if (!value)
+      return false;
+    switch (node.kind) {
+    case Kind::Eq:
+      return *value == node.value;
+    case Kind::Lt:
+      return comparable(*value, node.value) && *value < node.value;
+    case Kind::Le:
+      return comparable(*value, node.value) && *value <= node.value;
+    case Kind::Gt:
+      return comparable(*value, node.value) && *value > node.value;
+    case Kind::Ge:
+      return comparable(*value, node.value) && *value >= node.value;
+    case Kind::In:
+      for (auto &candidate : node.value)
+        if (*value == candidate)
+          return true;
+      return false;
+    default:
+      return false;
+    }
+  }
+
+  // Collects the comparisons that must all hold for the predicate to
+  // match, i.e. the leaves reachable from the root through "and" nodes.
+  static void collectConjunction(const Node &node,
+                                 std::vector<const Node *> &leaves) {
+    switch (node.kind) {
+    case Kind::And:
+      for (auto &child : node.children)
+        collectConjunction(child, leaves);
+      break;
+    case Kind::Eq:
+    case Kind::Lt:
+    case Kind::Le:
+    case Kind::Gt:
+    case Kind::Ge:
+      // a null bound would mean "unbounded" to SecondaryIndex::query
+      if (!node.value.is_null())
+        leaves.push_back(&node);
+      break;
+    default:
+      break;
+    }
+  }
+};
+
+} // namespace sonata
+
+#endif
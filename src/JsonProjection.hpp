@@ -0,0 +1,134 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_JSON_PROJECTION_HPP
+#define __SONATA_JSON_PROJECTION_HPP
+
+#include "JsonPath.hpp"
+#include <nlohmann/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief A JsonProjection reduces records to a list of field paths
+ * (e.g. {"name", "address.city"}), keeping their nesting. The "__id"
+ * field is always kept. Fields that a record does not have are
+ * omitted from its projection.
+ *
+ * The paths are kept as a tree of keys, so that backends can walk it
+ * while decoding a record and skip the fields that are not requested
+ * (see match()).
+ */
+class JsonProjection {
+
+public:
+  enum class Match {
+    none,    // the field is not requested
+    whole,   // the field is requested, with all its content
+    partial, // some fields of the field (an object) are requested
+  };
+
+  // node of the top-level fields of a record
+  static constexpr size_t root = 0;
+
+  JsonProjection() : m_nodes(1) {}
+
+  explicit JsonProjection(const std::vector<std::string> &fields)
+      : m_nodes(1) {
+    for (auto &field : fields) {
+      JsonPath path(field);
+      size_t node = root;
+      for (auto &key : path.keys()) {
+        if (m_nodes[node].m_whole)
+          break;
+        size_t child;
+        if (match(node, key, child) == Match::none) {
+          child = m_nodes.size();
+          m_nodes[node].m_children.emplace_back(key, child);
+          m_nodes.emplace_back();
+        }
+        node = child;
+      }
+      m_nodes[node].m_whole = true;
+    }
+  }
+
+  bool empty() const { return m_nodes[root].m_children.empty(); }
+
+  /**
+   * @brief Looks up a key among the fields requested at a node of
+   * the projection. If the key is partially requested, child is set
+   * to the node of its own fields.
+   */
+  Match match(size_t node, const std::string &key, size_t &child) const {
+    for (auto &c : m_nodes[node].m_children) {
+      if (c.first != key)
+        continue;
+      child = c.second;
+      return m_nodes[child].m_whole ? Match::whole : Match::partial;
+    }
+    return Match::none;
+  }
+
+  /**
+   * @brief Replaces a record with its projection. Anything that is
+   * not an object (e.g. the null placeholder of a missing record)
+   * is left untouched.
+   */
+  void apply(json &record) const {
+    if (empty() || !record.is_object())
+      return;
+    json projected = json::object();
+    auto id = record.find("__id");
+    if (id != record.end())
+      projected["__id"] = *id;
+    project(root, record, projected);
+    record = std::move(projected);
+  }
+
+  /**
+   * @brief Applies the projection to each record of an array.
+   */
+  void applyToArray(json &records) const {
+    if (empty() || !records.is_array())
+      return;
+    for (auto &record : records)
+      apply(record);
+  }
+
+private:
+  struct Node {
+    bool m_whole = false;
+    std::vector<std::pair<std::string, size_t>> m_children;
+  };
+
+  // Moves the fields of object requested at node into projected.
+  void project(size_t node, json &object, json &projected) const {
+    for (auto &c : m_nodes[node].m_children) {
+      auto it = object.find(c.first);
+      if (it == object.end())
+        continue;
+      if (m_nodes[c.second].m_whole) {
+        projected[c.first] = std::move(*it);
+      } else if (it->is_object()) {
+        json sub = json::object();
+        project(c.second, *it, sub);
+        if (!sub.empty())
+          projected[c.first] = std::move(sub);
+      }
+    }
+  }
+
+  std::vector<Node> m_nodes; // m_nodes[root] is the root
+};
+
+} // namespace sonata
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_JSON_SIZE_HPP
+#define __SONATA_JSON_SIZE_HPP
+
+#include <nlohmann/json.hpp>
+#include <cstddef>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief Approximate size of a JSON value in bytes, once serialized.
+ * This is cheaper than serializing the value, and precise enough to
+ * enforce size thresholds and memory budgets.
+ */
+inline size_t approximateJsonSize(const json &value) {
+  switch (value.type()) {
+  case json::value_t::string:
+    return value.get_ref<const std::string &>().size() + 2;
+  case json::value_t::array: {
+    size_t size = 2;
+    for (auto &v : value)
+      size += approximateJsonSize(v) + 1;
+    return size;
+  }
+  case json::value_t::object: {
+    size_t size = 2;
+    for (auto it = value.begin(); it != value.end(); ++it)
+      size += it.key().size() + 4 + approximateJsonSize(it.value());
+    return size;
+  }
+  default:
+    return 8;
+  }
+}
+
+} // namespace sonata
+
+#endif
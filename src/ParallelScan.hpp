@@ -0,0 +1,119 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_PARALLEL_SCAN_HPP
+#define __SONATA_PARALLEL_SCAN_HPP
+
+#include <sonata/Exception.hpp>
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <thallium.hpp>
+#include <vector>
+
+namespace sonata {
+
+namespace tl = thallium;
+using nlohmann::json;
+
+/**
+ * @brief A ParallelScan splits the scan of a range of records into
+ * contiguous partitions that are processed by ULTs created in the
+ * provider's pool, so that a single filter on a large collection can
+ * use all the execution streams associated with the pool. The results
+ * of the partitions are concatenated in order, hence records come out
+ * in the same (id) order as with a sequential scan.
+ *
+ * It is configured by the following fields of the backend's configuration:
+ * - "filter_ults": maximum number of ULTs used by a scan (default 16,
+ *   a value of 0 or 1 makes scans sequential);
+ * - "filter_min_records_per_ult": minimum number of records processed
+ *   by each ULT (default 4096), so that small collections are scanned
+ *   by the calling ULT alone.
+ */
+class ParallelScan {
+
+public:
+  /**
+   * @brief Default constructor. Scans are sequential.
+   */
+  ParallelScan() = default;
+
+  ParallelScan(const tl::pool &pool, const json &config) : m_pool(pool) {
+    auto max_ults = config.value("filter_ults", (int64_t)16);
+    auto min_records = config.value("filter_min_records_per_ult",
+                                    (int64_t)4096);
+    if (max_ults < 0 || min_records < 0)
+      throw Exception("\"filter_ults\" and \"filter_min_records_per_ult\" "
+                      "should be positive integers");
+    m_max_ults = std::max<size_t>(max_ults, 1);
+    m_min_records = std::max<size_t>(min_records, 1);
+  }
+
+  /**
+   * @brief Returns the number of records that a scan which reads its
+   * records in chunks should process per call to run(): enough for
+   * each ULT to get a partition of the minimum size.
+   */
+  size_t chunkSize() const { return m_max_ults * m_min_records; }
+
+  /**
+   * @brief Calls f(begin, end, results) on partitions of [0, count),
+   * each of which appends its results to its own vector, and returns
+   * the concatenation of these vectors. The first partition is processed
+   * by the calling ULT. If any call throws, the exception of the first
+   * failed partition is rethrown once all the ULTs have completed.
+   */
+  template <typename T, typename F>
+  std::vector<T> run(size_t count, F &&f) const {
+    std::vector<T> results;
+    size_t num_partitions = std::min(m_max_ults, count / m_min_records);
+    if (num_partitions <= 1) {
+      f((size_t)0, count, results);
+      return results;
+    }
+    size_t partition_size = (count + num_partitions - 1) / num_partitions;
+    std::vector<std::vector<T>> partitions(num_partitions);
+    std::vector<std::exception_ptr> errors(num_partitions);
+    auto process = [&](size_t i) {
+      size_t begin = std::min(count, i * partition_size);
+      size_t end = std::min(count, begin + partition_size);
+      try {
+        f(begin, end, partitions[i]);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    };
+    std::vector<tl::managed<tl::thread>> ults;
+    ults.reserve(num_partitions - 1);
+    for (size_t i = 1; i < num_partitions; i++)
+      ults.push_back(m_pool.make_thread([&process, i]() { process(i); }));
+    process(0);
+    for (auto &ult : ults)
+      ult->join();
+    for (auto &error : errors) {
+      if (error)
+        std::rethrow_exception(error);
+    }
+    size_t total = 0;
+    for (auto &partition : partitions)
+      total += partition.size();
+    results.reserve(total);
+    for (auto &partition : partitions)
+      std::move(partition.begin(), partition.end(),
+                std::back_inserter(results));
+    return results;
+  }
+
+private:
+  tl::pool m_pool;
+  size_t m_max_ults = 1;
+  size_t m_min_records = 4096;
+};
+
+} // namespace sonata
+
+#endif
@@ -106,6 +106,7 @@ void populateDatabasesFromConfig(
     provider_impl->m_backends[db_name] = std::move(backend);
     provider_impl->m_backend_types[db_name] = db_type;
   }
+  provider_impl->publishDatabases();
 }
 
 Provider::Provider(tl::engine &engine, uint16_t provider_id,
@@ -148,7 +149,11 @@ std::string Provider::getConfig() const {
   std::stringstream ss;
   ss << "{ \"databases\": [";
   std::lock_guard<tl::mutex> g(self->m_backends_mtx);
+  bool first = true;
   for (auto &p : self->m_backends) {
+    if (!first)
+      ss << ", ";
+    first = false;
     auto db_name = p.first;
     auto db_type = self->m_backend_types[db_name];
     auto db_config = self->m_backends[db_name]->getConfig();
@@ -8,6 +8,10 @@
 
 #include "sonata/Backend.hpp"
 #include "sonata/JsonSerialize.hpp"
+#include "BatchOperation.hpp"
+#include "BulkPayload.hpp"
+#include "JsonPredicate.hpp"
+#include "JsonProjection.hpp"
 
 #include <thallium.hpp>
 #include <thallium/serialization/stl/pair.hpp>
@@ -19,19 +23,30 @@
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <memory>
 #include <tuple>
 
 using nlohmann::json;
 
+// Trace logging in the RPC handlers. The calls are compiled out unless
+// SONATA_ENABLE_TRACE is defined (ENABLE_TRACE cmake option), and their
+// arguments are only formatted if the trace level is enabled at run time.
+#ifdef SONATA_ENABLE_TRACE
+#define SONATA_TRACE(...)                                                      \
+  do {                                                                         \
+    if (spdlog::default_logger_raw()->should_log(spdlog::level::trace))        \
+      spdlog::trace(__VA_ARGS__);                                              \
+  } while (0)
+#else
+#define SONATA_TRACE(...)                                                      \
+  do {                                                                         \
+  } while (0)
+#endif
+
 #define FIND_DATABASE(__dbvar__)                                               \
-  std::shared_ptr<Backend> __dbvar__;                                          \
+  std::shared_ptr<Backend> __dbvar__ = findDatabase(db_name);                  \
   do {                                                                         \
-      {                                                                        \
-        std::lock_guard<tl::mutex> lock(m_backends_mtx);                       \
-        auto it = m_backends.find(db_name);                                    \
-        if (it != m_backends.end())                                            \
-            __dbvar__ = it->second;                                            \
-      }                                                                        \
       if (!__dbvar__) {                                                        \
         result.success() = false;                                              \
         result.error() = "Database "s + db_name + " not found";                \
@@ -70,26 +85,91 @@ public:
   tl::remote_procedure m_coll_store_json;
   tl::remote_procedure m_coll_store_multi;
   tl::remote_procedure m_coll_store_multi_json;
+  tl::remote_procedure m_coll_store_multi_bulk;
+  tl::remote_procedure m_coll_store_multi_json_bulk;
   tl::remote_procedure m_coll_fetch;
   tl::remote_procedure m_coll_fetch_json;
+  tl::remote_procedure m_coll_fetch_json_projected;
   tl::remote_procedure m_coll_fetch_multi;
   tl::remote_procedure m_coll_fetch_multi_json;
+  tl::remote_procedure m_coll_fetch_multi_json_projected;
+  tl::remote_procedure m_coll_fetch_multi_bulk;
   tl::remote_procedure m_coll_filter;
   tl::remote_procedure m_coll_filter_json;
+  tl::remote_procedure m_coll_filter_json_projected;
+  tl::remote_procedure m_coll_filter_predicate;
+  tl::remote_procedure m_coll_filter_predicate_json;
+  tl::remote_procedure m_coll_filter_predicate_json_projected;
+  tl::remote_procedure m_coll_aggregate;
   tl::remote_procedure m_coll_update;
   tl::remote_procedure m_coll_update_json;
   tl::remote_procedure m_coll_update_multi;
   tl::remote_procedure m_coll_update_multi_json;
   tl::remote_procedure m_coll_all;
   tl::remote_procedure m_coll_all_json;
+  tl::remote_procedure m_coll_all_json_projected;
+  tl::remote_procedure m_coll_all_bulk;
+  tl::remote_procedure m_pull_bulk_result;
   tl::remote_procedure m_coll_last_id;
   tl::remote_procedure m_coll_size;
   tl::remote_procedure m_coll_erase;
   tl::remote_procedure m_coll_erase_multi;
-  // Backends
-  std::unordered_map<std::string, std::shared_ptr<Backend>> m_backends;
+  tl::remote_procedure m_coll_create_index;
+  tl::remote_procedure m_coll_drop_index;
+  tl::remote_procedure m_coll_query_index;
+  tl::remote_procedure m_coll_query_index_json;
+  tl::remote_procedure m_cursor_open;
+  tl::remote_procedure m_cursor_next;
+  tl::remote_procedure m_cursor_next_json;
+  tl::remote_procedure m_cursor_close;
+  tl::remote_procedure m_batch;
+  // Backends (modified under m_backends_mtx; each modification is followed
+  // by a call to publishDatabases, so that the RPC handlers can look up
+  // databases in m_backends_snapshot without locking)
+  using backend_map = std::unordered_map<std::string, std::shared_ptr<Backend>>;
+  backend_map m_backends;
   std::unordered_map<std::string, std::string> m_backend_types;
   tl::mutex m_backends_mtx;
+  std::shared_ptr<const backend_map> m_backends_snapshot =
+      std::make_shared<const backend_map>();
+  // Cursors
+  struct CursorState {
+    tl::mutex m_mutex; // serializes the next() calls on the cursor
+    std::string m_db_name;
+    std::string m_coll_name;
+    bool m_has_predicate = false;
+    JsonPredicate m_predicate;
+    std::vector<std::string> m_fields;
+    JsonProjection m_projection;
+    uint64_t m_next_id = 0;
+    uint64_t m_end_id = 0; // ids >= m_end_id were stored after opening
+    double m_last_used = 0; // protected by m_cursors_mtx
+
+    CursorState(const std::string &db_name, const std::string &coll_name,
+                const std::vector<std::string> &fields)
+        : m_db_name(db_name), m_coll_name(coll_name), m_fields(fields),
+          m_projection(fields) {}
+  };
+  static constexpr uint64_t cursor_batch_size = 256;
+  // cursors that have not been used for cursor_idle_timeout seconds are
+  // closed (e.g. if their client died), and at most max_cursors cursors
+  // can be open at once
+  static constexpr double cursor_idle_timeout = 300.0;
+  static constexpr size_t max_cursors = 1024;
+  std::unordered_map<uint64_t, std::shared_ptr<CursorState>> m_cursors;
+  uint64_t m_next_cursor_id = 0;
+  tl::mutex m_cursors_mtx;
+  // Packed results of bulk reads, kept until the client pulls them
+  // (results that have not been pulled within bulk_result_timeout
+  // seconds are dropped)
+  struct BulkResult {
+    std::vector<char> m_data;
+    double m_created;
+  };
+  static constexpr double bulk_result_timeout = 60.0;
+  std::unordered_map<uint64_t, BulkResult> m_bulk_results;
+  uint64_t m_next_bulk_result_id = 0;
+  tl::mutex m_bulk_results_mtx;
 
   ProviderImpl(tl::engine &engine, uint16_t provider_id, const tl::pool &pool)
       : tl::provider<ProviderImpl>(engine, provider_id), m_pool(pool),
@@ -121,16 +201,42 @@ public:
             define("sonata_store_multi", &ProviderImpl::storeMulti, pool)),
         m_coll_store_multi_json(define("sonata_store_multi_json",
                                        &ProviderImpl::storeMultiJson, pool)),
+        m_coll_store_multi_bulk(define("sonata_store_multi_bulk",
+                                       &ProviderImpl::storeMultiBulk, pool)),
+        m_coll_store_multi_json_bulk(
+            define("sonata_store_multi_json_bulk",
+                   &ProviderImpl::storeMultiJsonBulk, pool)),
         m_coll_fetch(define("sonata_fetch", &ProviderImpl::fetch, pool)),
         m_coll_fetch_json(
             define("sonata_fetch_json", &ProviderImpl::fetchJson, pool)),
+        m_coll_fetch_json_projected(
+            define("sonata_fetch_json_projected",
+                   &ProviderImpl::fetchJsonProjected, pool)),
         m_coll_fetch_multi(
             define("sonata_fetch_multi", &ProviderImpl::fetchMulti, pool)),
         m_coll_fetch_multi_json(define("sonata_fetch_multi_json",
                                        &ProviderImpl::fetchMultiJson, pool)),
+        m_coll_fetch_multi_json_projected(
+            define("sonata_fetch_multi_json_projected",
+                   &ProviderImpl::fetchMultiJsonProjected, pool)),
+        m_coll_fetch_multi_bulk(define("sonata_fetch_multi_bulk",
+                                       &ProviderImpl::fetchMultiBulk, pool)),
         m_coll_filter(define("sonata_filter", &ProviderImpl::filter, pool)),
         m_coll_filter_json(
             define("sonata_filter_json", &ProviderImpl::filterJson, pool)),
+        m_coll_filter_json_projected(
+            define("sonata_filter_json_projected",
+                   &ProviderImpl::filterJsonProjected, pool)),
+        m_coll_filter_predicate(define("sonata_filter_predicate",
+                                       &ProviderImpl::filterPredicate, pool)),
+        m_coll_filter_predicate_json(
+            define("sonata_filter_predicate_json",
+                   &ProviderImpl::filterPredicateJson, pool)),
+        m_coll_filter_predicate_json_projected(
+            define("sonata_filter_predicate_json_projected",
+                   &ProviderImpl::filterPredicateJsonProjected, pool)),
+        m_coll_aggregate(
+            define("sonata_aggregate", &ProviderImpl::aggregate, pool)),
         m_coll_update(define("sonata_update", &ProviderImpl::update, pool)),
         m_coll_update_json(
             define("sonata_update_json", &ProviderImpl::updateJson, pool)),
@@ -141,18 +247,42 @@ public:
         m_coll_all(define("sonata_all", &ProviderImpl::all, pool)),
         m_coll_all_json(
             define("sonata_all_json", &ProviderImpl::allJson, pool)),
+        m_coll_all_json_projected(
+            define("sonata_all_json_projected",
+                   &ProviderImpl::allJsonProjected, pool)),
+        m_coll_all_bulk(
+            define("sonata_all_bulk", &ProviderImpl::allBulk, pool)),
+        m_pull_bulk_result(define("sonata_pull_bulk_result",
+                                  &ProviderImpl::pullBulkResult, pool)),
         m_coll_last_id(define("sonata_last_id", &ProviderImpl::lastID, pool)),
         m_coll_size(define("sonata_size", &ProviderImpl::size, pool)),
         m_coll_erase(define("sonata_erase", &ProviderImpl::erase, pool)),
         m_coll_erase_multi(
-            define("sonata_erase_multi", &ProviderImpl::eraseMulti, pool)) {
-    spdlog::trace("[provider:{0}] Registered provider with id {0}", id());
+            define("sonata_erase_multi", &ProviderImpl::eraseMulti, pool)),
+        m_coll_create_index(
+            define("sonata_create_index", &ProviderImpl::createIndex, pool)),
+        m_coll_drop_index(
+            define("sonata_drop_index", &ProviderImpl::dropIndex, pool)),
+        m_coll_query_index(
+            define("sonata_query_index", &ProviderImpl::queryIndex, pool)),
+        m_coll_query_index_json(define("sonata_query_index_json",
+                                       &ProviderImpl::queryIndexJson, pool)),
+        m_cursor_open(
+            define("sonata_cursor_open", &ProviderImpl::cursorOpen, pool)),
+        m_cursor_next(
+            define("sonata_cursor_next", &ProviderImpl::cursorNext, pool)),
+        m_cursor_next_json(define("sonata_cursor_next_json",
+                                  &ProviderImpl::cursorNextJson, pool)),
+        m_cursor_close(
+            define("sonata_cursor_close", &ProviderImpl::cursorClose, pool)),
+        m_batch(define("sonata_batch", &ProviderImpl::batch, pool)) {
+    SONATA_TRACE("[provider:{0}] Registered provider with id {0}", id());
     if (!m_pool)
       m_pool = engine.get_handler_pool();
   }
 
   ~ProviderImpl() {
-    spdlog::trace("[provider:{}] Deregistering provider", id());
+    SONATA_TRACE("[provider:{}] Deregistering provider", id());
     m_create_database.deregister();
     m_attach_database.deregister();
     m_detach_database.deregister();
@@ -168,33 +298,70 @@ public:
     m_coll_store_json.deregister();
     m_coll_store_multi.deregister();
     m_coll_store_multi_json.deregister();
+    m_coll_store_multi_bulk.deregister();
+    m_coll_store_multi_json_bulk.deregister();
     m_coll_fetch.deregister();
     m_coll_fetch_json.deregister();
+    m_coll_fetch_json_projected.deregister();
     m_coll_fetch_multi.deregister();
     m_coll_fetch_multi_json.deregister();
+    m_coll_fetch_multi_json_projected.deregister();
+    m_coll_fetch_multi_bulk.deregister();
     m_coll_filter.deregister();
     m_coll_filter_json.deregister();
+    m_coll_filter_json_projected.deregister();
+    m_coll_filter_predicate.deregister();
+    m_coll_filter_predicate_json.deregister();
+    m_coll_filter_predicate_json_projected.deregister();
+    m_coll_aggregate.deregister();
     m_coll_update.deregister();
     m_coll_update_json.deregister();
     m_coll_update_multi.deregister();
     m_coll_update_multi_json.deregister();
     m_coll_all.deregister();
     m_coll_all_json.deregister();
+    m_coll_all_json_projected.deregister();
+    m_coll_all_bulk.deregister();
+    m_pull_bulk_result.deregister();
     m_coll_last_id.deregister();
     m_coll_size.deregister();
     m_coll_erase.deregister();
     m_coll_erase_multi.deregister();
-    spdlog::trace("[provider:{}]    => done!", id());
+    m_coll_create_index.deregister();
+    m_coll_drop_index.deregister();
+    m_coll_query_index.deregister();
+    m_coll_query_index_json.deregister();
+    m_cursor_open.deregister();
+    m_cursor_next.deregister();
+    m_cursor_next_json.deregister();
+    m_cursor_close.deregister();
+    m_batch.deregister();
+    SONATA_TRACE("[provider:{}]    => done!", id());
+  }
+
+  // Publishes a copy of m_backends for findDatabase
+  // (to be called with m_backends_mtx held).
+  void publishDatabases() {
+    std::atomic_store(&m_backends_snapshot,
+                      std::make_shared<const backend_map>(m_backends));
+  }
+
+  std::shared_ptr<Backend> findDatabase(const std::string &db_name) const {
+    auto snapshot = std::atomic_load(&m_backends_snapshot);
+    auto it = snapshot->find(db_name);
+    if (it == snapshot->end())
+      return nullptr;
+    return it->second;
   }
 
   void createDatabase(const tl::request &req, const std::string &token,
                       const std::string &db_name, const std::string &db_type,
                       const std::string &db_config) {
 
-    spdlog::trace("[provider:{}] Received createDatabase request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => type = {}", id(), db_type);
-    spdlog::trace("[provider:{}]    => config = {}", id(), db_config);
+    SONATA_TRACE("[provider:{}] Received createDatabase request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => type = {}", id(), db_type);
+    SONATA_TRACE("[provider:{}]    => config = {}", id(), db_config);
 
     RequestResult<bool> result;
 
@@ -253,10 +420,11 @@ public:
     } else {
       m_backends[db_name] = std::move(backend);
       m_backend_types[db_name] = db_type;
+      publishDatabases();
     }
 
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully created database {} of type {}",
+    SONATA_TRACE("[provider:{}] Successfully created database {} of type {}",
                   id(), db_name, db_type);
   }
 
@@ -264,10 +432,10 @@ public:
                       const std::string &db_name, const std::string &db_type,
                       const std::string &db_config) {
 
-    spdlog::trace("[provider:{}] Received attachDatabase request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => type = {}", id(), db_type);
-    spdlog::trace("[provider:{}]    => config = {}", id(), db_config);
+    SONATA_TRACE("[provider:{}] Received attachDatabase request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => type = {}", id(), db_type);
+    SONATA_TRACE("[provider:{}]    => config = {}", id(), db_config);
 
     RequestResult<bool> result;
 
@@ -327,16 +495,17 @@ public:
     } else {
       m_backends[db_name] = std::move(backend);
       m_backend_types[db_name] = db_type;
+      publishDatabases();
     }
 
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully attached database {} of type {}",
+    SONATA_TRACE("[provider:{}] Successfully attached database {} of type {}",
                   id(), db_name, db_type);
   }
 
   void detachDatabase(const tl::request &req, const std::string &token,
                       const std::string &db_name) {
-    spdlog::trace(
+    SONATA_TRACE(
         "[provider:{}] Received detachDatabase request for database {}", id(),
         db_name);
     RequestResult<bool> result;
@@ -353,21 +522,20 @@ public:
 
       m_backends.erase(db_name);
       m_backend_types.erase(db_name);
+      publishDatabases();
     }
     req.respond(result);
-    spdlog::trace("[provider:{}] Database {} successfully detached", id(),
+    SONATA_TRACE("[provider:{}] Database {} successfully detached", id(),
                   db_name);
   }
 
   void listDatabases(const tl::request &req, const std::string &token) {
-    spdlog::trace(
+    SONATA_TRACE(
         "[provider:{}] Received listDatabases request", id());
     RequestResult<std::vector<std::string>> result;
-    {
-      std::lock_guard<tl::mutex> lock(m_backends_mtx);
-      for(auto& backend : m_backends) {
-        result.value().push_back(backend.first);
-      }
+    auto snapshot = std::atomic_load(&m_backends_snapshot);
+    for(auto& backend : *snapshot) {
+      result.value().push_back(backend.first);
     }
     req.respond(result);
   }
@@ -375,7 +543,7 @@ public:
   void destroyDatabase(const tl::request &req, const std::string &token,
                        const std::string &db_name) {
     RequestResult<bool> result;
-    spdlog::trace(
+    SONATA_TRACE(
         "[provider:{}] Received destroyDatabase request for database {}", id(),
         db_name);
 
@@ -401,10 +569,11 @@ public:
       result = m_backends[db_name]->destroy();
       m_backends.erase(db_name);
       m_backend_types.erase(db_name);
+      publishDatabases();
     }
 
     req.respond(result);
-    spdlog::trace("[provider:{}] Database {} successfully destroyed", id(),
+    SONATA_TRACE("[provider:{}] Database {} successfully destroyed", id(),
                   db_name);
   }
 
@@ -412,111 +581,111 @@ public:
                       const std::string &code,
                       const std::unordered_set<std::string> &vars,
                       bool commit) {
-    spdlog::trace(
+    SONATA_TRACE(
         "provider:{}] Received execOnDatabase request for database {}", id(),
         db_name);
     RequestResult<std::unordered_map<std::string, std::string>> result;
     FIND_DATABASE(db);
     result = db->execute(code, vars, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Code successfully executed on database {}",
+    SONATA_TRACE("[provider:{}] Code successfully executed on database {}",
                   id(), db_name);
   }
 
   void commit(const tl::request &req, const std::string &db_name) {
-    spdlog::trace("provider:{}] Received commit request for database {}", id(),
+    SONATA_TRACE("provider:{}] Received commit request for database {}", id(),
                   db_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->commit();
     req.respond(result);
-    spdlog::trace("[provider:{}] Commit successfully executed on database {}",
+    SONATA_TRACE("[provider:{}] Commit successfully executed on database {}",
                   id(), db_name);
   }
 
   void openDatabase(const tl::request &req, const std::string &db_name) {
-    spdlog::trace("[provider:{}] Received openDatabase request for database {}",
+    SONATA_TRACE("[provider:{}] Received openDatabase request for database {}",
                   id(), db_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     req.respond(result);
-    spdlog::trace("[provider:{}] Database {} successfully opened", id(),
+    SONATA_TRACE("[provider:{}] Database {} successfully opened", id(),
                   db_name);
   }
 
   void createCollection(const tl::request &req, const std::string &db_name,
                         const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received createCollection request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received createCollection request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->createCollection(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Collection {} successfully created", id(),
+    SONATA_TRACE("[provider:{}] Collection {} successfully created", id(),
                   coll_name);
   }
 
   void openCollection(const tl::request &req, const std::string &db_name,
                       const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received openCollection request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received openCollection request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->openCollection(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Collection {} successfully opened", id(),
+    SONATA_TRACE("[provider:{}] Collection {} successfully opened", id(),
                   coll_name);
   }
 
   void dropCollection(const tl::request &req, const std::string &db_name,
                       const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received dropCollection request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received dropCollection request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->dropCollection(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Collection {} successfully dropped", id(),
+    SONATA_TRACE("[provider:{}] Collection {} successfully dropped", id(),
                   coll_name);
   }
 
   void store(const tl::request &req, const std::string &db_name,
              const std::string &coll_name, const std::string &record,
              bool commit) {
-    spdlog::trace("[provider:{}] Received store request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received store request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<uint64_t> result;
     FIND_DATABASE(db);
     result = db->store(coll_name, record, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Record successfully stored (id = {})", id(),
+    SONATA_TRACE("[provider:{}] Record successfully stored (id = {})", id(),
                   result.value());
   }
 
   void storeJson(const tl::request &req, const std::string &db_name,
                  const std::string &coll_name, const JsonWrapper &record,
                  bool commit) {
-    spdlog::trace("[provider:{}] Received store request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received store request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<uint64_t> result;
     FIND_DATABASE(db);
     result = db->storeJson(coll_name, record, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Record successfully stored (id = {})", id(),
+    SONATA_TRACE("[provider:{}] Record successfully stored (id = {})", id(),
                   result.value());
   }
 
   void storeMulti(const tl::request &req, const std::string &db_name,
                   const std::string &coll_name,
                   const std::vector<std::string> &records, bool commit) {
-    spdlog::trace("[provider:{}] Received store_multi request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received store_multi request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     //spdlog::debug("[provider:{}] Received store_multi request", id());
     RequestResult<std::vector<uint64_t>> result;
     FIND_DATABASE(db);
@@ -524,128 +693,301 @@ public:
     //spdlog::debug("[provider:{}] store_multi executed", id());
     req.respond(result);
     //spdlog::debug("[provider:{}] store_multi response sent", id());
-    spdlog::trace("[provider:{}] Record successfully stored", id());
+    SONATA_TRACE("[provider:{}] Record successfully stored", id());
   }
 
   void storeMultiJson(const tl::request &req, const std::string &db_name,
                       const std::string &coll_name, const JsonWrapper &records,
                       bool commit) {
-    spdlog::trace("[provider:{}] Received store_multi request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received store_multi request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<uint64_t>> result;
     FIND_DATABASE(db);
     result = db->storeMultiJson(coll_name, records, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Record successfully stored", id());
+    SONATA_TRACE("[provider:{}] Record successfully stored", id());
+  }
+
+  void storeMultiBulk(const tl::request &req, const std::string &db_name,
+                      const std::string &coll_name, const tl::bulk &payload,
+                      bool commit) {
+    SONATA_TRACE("[provider:{}] Received store_multi request (bulk)", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => size = {}", id(), payload.size());
+    RequestResult<std::vector<uint64_t>> result;
+    FIND_DATABASE(db);
+    std::vector<std::string> records;
+    {
+      std::vector<char> buffer;
+      if (!pullBulk(req, payload, buffer, result.error())) {
+        result.success() = false;
+        req.respond(result);
+        return;
+      }
+      if (!BulkPayload::unpack(buffer.data(), buffer.size(), records)) {
+        result.success() = false;
+        result.error() = "Invalid bulk payload";
+        req.respond(result);
+        return;
+      }
+    }
+    result = db->storeMulti(coll_name, records, commit);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Record successfully stored", id());
+  }
+
+  void storeMultiJsonBulk(const tl::request &req, const std::string &db_name,
+                          const std::string &coll_name,
+                          const tl::bulk &payload, bool commit) {
+    SONATA_TRACE("[provider:{}] Received store_multi request (bulk)", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => size = {}", id(), payload.size());
+    RequestResult<std::vector<uint64_t>> result;
+    FIND_DATABASE(db);
+    JsonWrapper records;
+    {
+      std::vector<char> buffer;
+      if (!pullBulk(req, payload, buffer, result.error())) {
+        result.success() = false;
+        req.respond(result);
+        return;
+      }
+      records.m_object = json::parse(buffer.begin(), buffer.end(), nullptr,
+                                     false);
+      if (!records->is_array()) {
+        result.success() = false;
+        result.error() = "Invalid bulk payload (expected a JSON array)";
+        req.respond(result);
+        return;
+      }
+    }
+    result = db->storeMultiJson(coll_name, records, commit);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Record successfully stored", id());
   }
 
   void fetch(const tl::request &req, const std::string &db_name,
              const std::string &coll_name, uint64_t record_id) {
-    spdlog::trace("[provider:{}] Received fetch request", id());
-    spdlog::trace("[provider:{}]    => database   = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
-    spdlog::trace("[provider:{}]    => record id  = {}", id(), record_id);
+    SONATA_TRACE("[provider:{}] Received fetch request", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id  = {}", id(), record_id);
     RequestResult<std::string> result;
     FIND_DATABASE(db);
     result = db->fetch(coll_name, record_id);
     req.respond(result);
-    spdlog::trace("[provider:{}] Record {} successfully fetched", id(),
+    SONATA_TRACE("[provider:{}] Record {} successfully fetched", id(),
                   record_id);
   }
 
   void fetchJson(const tl::request &req, const std::string &db_name,
                  const std::string &coll_name, uint64_t record_id) {
-    spdlog::trace("[provider:{}] Received fetch request", id());
-    spdlog::trace("[provider:{}]    => database   = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
-    spdlog::trace("[provider:{}]    => record id  = {}", id(), record_id);
+    SONATA_TRACE("[provider:{}] Received fetch request", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id  = {}", id(), record_id);
     RequestResult<JsonWrapper> result;
     FIND_DATABASE(db);
     result = db->fetchJson(coll_name, record_id);
     req.respond(result);
-    spdlog::trace("[provider:{}] Record {} successfully fetched", id(),
+    SONATA_TRACE("[provider:{}] Record {} successfully fetched", id(),
+                  record_id);
+  }
+
+  void fetchJsonProjected(const tl::request &req, const std::string &db_name,
+                          const std::string &coll_name, uint64_t record_id,
+                          const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received fetch request (projected)", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id  = {}", id(), record_id);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->fetchJsonProjected(coll_name, record_id, fields);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Record {} successfully fetched", id(),
                   record_id);
   }
 
   void fetchMulti(const tl::request &req, const std::string &db_name,
                   const std::string &coll_name,
                   const std::vector<uint64_t> &record_ids) {
-    spdlog::trace("[provider:{}] Received fetch_multi request", id());
-    spdlog::trace("[provider:{}]    => database   = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received fetch_multi request", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<std::string>> result;
     FIND_DATABASE(db);
     result = db->fetchMulti(coll_name, record_ids);
     req.respond(result);
-    spdlog::trace("[provider:{}] Records successfully fetched", id());
+    SONATA_TRACE("[provider:{}] Records successfully fetched", id());
   }
 
   void fetchMultiJson(const tl::request &req, const std::string &db_name,
                       const std::string &coll_name,
                       const std::vector<uint64_t> &record_ids) {
-    spdlog::trace("[provider:{}] Received fetch_multi request", id());
-    spdlog::trace("[provider:{}]    => database   = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received fetch_multi request", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<JsonWrapper> result;
     FIND_DATABASE(db);
     result = db->fetchMultiJson(coll_name, record_ids);
     req.respond(result);
-    spdlog::trace("[provider:{}] Records successfully fetched", id());
+    SONATA_TRACE("[provider:{}] Records successfully fetched", id());
+  }
+
+  void fetchMultiJsonProjected(const tl::request &req,
+                               const std::string &db_name,
+                               const std::string &coll_name,
+                               const std::vector<uint64_t> &record_ids,
+                               const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received fetch_multi request (projected)",
+                 id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->fetchMultiJsonProjected(coll_name, record_ids, fields);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Records successfully fetched", id());
+  }
+
+  void fetchMultiBulk(const tl::request &req, const std::string &db_name,
+                      const std::string &coll_name,
+                      const std::vector<uint64_t> &record_ids,
+                      uint64_t threshold) {
+    SONATA_TRACE("[provider:{}] Received fetch_multi request (bulk)", id());
+    SONATA_TRACE("[provider:{}]    => database   = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<BulkReadResult> result;
+    FIND_DATABASE(db);
+    auto records = db->fetchMulti(coll_name, record_ids);
+    respondBulk(req, records, threshold);
+    SONATA_TRACE("[provider:{}] Records successfully fetched", id());
   }
 
   void filter(const tl::request &req, const std::string &db_name,
               const std::string &coll_name, const std::string &filter_code) {
-    spdlog::trace("[provider:{}] Received filter request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received filter request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<std::string>> result;
     FIND_DATABASE(db);
     result = db->filter(coll_name, filter_code);
     req.respond(result);
-    spdlog::trace("[provider:{}] Filter successfully executed", id());
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
   }
 
   void filterJson(const tl::request &req, const std::string &db_name,
                   const std::string &coll_name,
                   const std::string &filter_code) {
-    spdlog::trace("[provider:{}] Received filter request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received filter request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<JsonWrapper> result;
     FIND_DATABASE(db);
     result = db->filterJson(coll_name, filter_code);
     req.respond(result);
-    spdlog::trace("[provider:{}] Filter successfully executed", id());
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
+  }
+
+  void filterJsonProjected(const tl::request &req, const std::string &db_name,
+                           const std::string &coll_name,
+                           const std::string &filter_code,
+                           const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received filter request (projected)", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->filterJsonProjected(coll_name, filter_code, fields);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
+  }
+
+  void filterPredicate(const tl::request &req, const std::string &db_name,
+                       const std::string &coll_name,
+                       const JsonWrapper &predicate) {
+    SONATA_TRACE("[provider:{}] Received filter_predicate request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<std::vector<std::string>> result;
+    FIND_DATABASE(db);
+    result = db->filterPredicate(coll_name, predicate);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
+  }
+
+  void filterPredicateJson(const tl::request &req, const std::string &db_name,
+                           const std::string &coll_name,
+                           const JsonWrapper &predicate) {
+    SONATA_TRACE("[provider:{}] Received filter_predicate request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->filterPredicateJson(coll_name, predicate);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
+  }
+
+  void filterPredicateJsonProjected(const tl::request &req,
+                                    const std::string &db_name,
+                                    const std::string &coll_name,
+                                    const JsonWrapper &predicate,
+                                    const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received filter_predicate request (projected)",
+                 id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->filterPredicateJsonProjected(coll_name, predicate, fields);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Filter successfully executed", id());
+  }
+
+  void aggregate(const tl::request &req, const std::string &db_name,
+                 const std::string &coll_name, const JsonWrapper &pipeline) {
+    SONATA_TRACE("[provider:{}] Received aggregate request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->aggregate(coll_name, pipeline);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Aggregation successfully executed", id());
   }
 
   void update(const tl::request &req, const std::string &db_name,
               const std::string &coll_name, uint64_t record_id,
               const std::string &new_content, bool commit) {
-    spdlog::trace("[provider:{}] Received update request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
-    spdlog::trace("[provider:{}]    => record id = {}", id(), record_id);
+    SONATA_TRACE("[provider:{}] Received update request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id = {}", id(), record_id);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->update(coll_name, record_id, new_content, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Update successfully applied to record {}",
+    SONATA_TRACE("[provider:{}] Update successfully applied to record {}",
                   id(), record_id);
   }
 
   void updateJson(const tl::request &req, const std::string &db_name,
                   const std::string &coll_name, uint64_t record_id,
                   const JsonWrapper &new_content, bool commit) {
-    spdlog::trace("[provider:{}] Received update request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
-    spdlog::trace("[provider:{}]    => record id = {}", id(), record_id);
+    SONATA_TRACE("[provider:{}] Received update request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id = {}", id(), record_id);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->updateJson(coll_name, record_id, new_content, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Update successfully applied to record {}",
+    SONATA_TRACE("[provider:{}] Update successfully applied to record {}",
                   id(), record_id);
   }
 
@@ -653,107 +995,600 @@ public:
                    const std::string &coll_name,
                    const std::vector<uint64_t> &record_ids,
                    const std::vector<std::string> &new_contents, bool commit) {
-    spdlog::trace("[provider:{}] Received update request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received update request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<bool>> result;
     FIND_DATABASE(db);
     result = db->updateMulti(coll_name, record_ids, new_contents, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Update successfully applied to records", id());
+    SONATA_TRACE("[provider:{}] Update successfully applied to records", id());
   }
 
   void updateMultiJson(const tl::request &req, const std::string &db_name,
                        const std::string &coll_name,
                        const std::vector<uint64_t> &record_ids,
                        const JsonWrapper &new_content, bool commit) {
-    spdlog::trace("[provider:{}] Received update request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received update request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<bool>> result;
     FIND_DATABASE(db);
     result = db->updateMultiJson(coll_name, record_ids, new_content, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Update successfully applied to records", id());
+    SONATA_TRACE("[provider:{}] Update successfully applied to records", id());
   }
 
   void all(const tl::request &req, const std::string &db_name,
            const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received all request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received all request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<std::vector<std::string>> result;
     FIND_DATABASE(db);
     result = db->all(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully returned the full collection {}",
+    SONATA_TRACE("[provider:{}] Successfully returned the full collection {}",
                   id(), coll_name);
   }
 
   void allJson(const tl::request &req, const std::string &db_name,
                const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received all request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received all request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<JsonWrapper> result;
     FIND_DATABASE(db);
     result = db->allJson(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully returned the full collection {}",
+    SONATA_TRACE("[provider:{}] Successfully returned the full collection {}",
+                  id(), coll_name);
+  }
+
+  void allJsonProjected(const tl::request &req, const std::string &db_name,
+                        const std::string &coll_name,
+                        const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received all request (projected)", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->allJsonProjected(coll_name, fields);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Successfully returned the full collection {}",
                   id(), coll_name);
   }
 
+  void allBulk(const tl::request &req, const std::string &db_name,
+               const std::string &coll_name, uint64_t threshold) {
+    SONATA_TRACE("[provider:{}] Received all request (bulk)", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<BulkReadResult> result;
+    FIND_DATABASE(db);
+    auto records = db->all(coll_name);
+    respondBulk(req, records, threshold);
+    SONATA_TRACE("[provider:{}] Successfully returned the full collection {}",
+                  id(), coll_name);
+  }
+
+  void pullBulkResult(const tl::request &req, uint64_t result_id,
+                      const tl::bulk &buffer) {
+    SONATA_TRACE("[provider:{}] Received pull_bulk_result request", id());
+    SONATA_TRACE("[provider:{}]    => result id = {}", id(), result_id);
+    RequestResult<bool> result;
+    std::vector<char> data;
+    {
+      std::lock_guard<tl::mutex> lock(m_bulk_results_mtx);
+      auto it = m_bulk_results.find(result_id);
+      if (it == m_bulk_results.end()) {
+        result.success() = false;
+        result.error() = "Bulk result not found (it may have expired)";
+        req.respond(result);
+        return;
+      }
+      data = std::move(it->second.m_data);
+      m_bulk_results.erase(it);
+    }
+    if (buffer.size() < data.size()) {
+      result.success() = false;
+      result.error() = "Buffer too small for bulk result";
+      req.respond(result);
+      return;
+    }
+    try {
+      std::vector<std::pair<void *, size_t>> segments = {
+          {data.data(), data.size()}};
+      auto local = get_engine().expose(segments, tl::bulk_mode::read_only);
+      buffer(0, data.size()).on(req.get_endpoint()) << local;
+      result.value() = true;
+    } catch (const std::exception &ex) {
+      result.success() = false;
+      result.error() = "Bulk transfer failed: "s + ex.what();
+    }
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Bulk result successfully pulled", id());
+  }
+
   void lastID(const tl::request &req, const std::string &db_name,
               const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received lastID request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received lastID request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<uint64_t> result;
     FIND_DATABASE(db);
     result = db->lastID(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully returned the last id ({})", id(),
+    SONATA_TRACE("[provider:{}] Successfully returned the last id ({})", id(),
                   result.value());
   }
 
   void size(const tl::request &req, const std::string &db_name,
             const std::string &coll_name) {
-    spdlog::trace("[provider:{}] Received size request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received size request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<size_t> result;
     FIND_DATABASE(db);
     result = db->size(coll_name);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully returned collection size ({})",
+    SONATA_TRACE("[provider:{}] Successfully returned collection size ({})",
                   id(), result.value());
   }
 
   void erase(const tl::request &req, const std::string &db_name,
              const std::string &coll_name, uint64_t record_id, bool commit) {
-    spdlog::trace("[provider:{}] Received erase request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
-    spdlog::trace("[provider:{}]    => record id = {}", id(), record_id);
+    SONATA_TRACE("[provider:{}] Received erase request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => record id = {}", id(), record_id);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->erase(coll_name, record_id, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully erased record {}", id(),
+    SONATA_TRACE("[provider:{}] Successfully erased record {}", id(),
                   record_id);
   }
 
   void eraseMulti(const tl::request &req, const std::string &db_name,
                   const std::string &coll_name,
                   const std::vector<uint64_t> &record_ids, bool commit) {
-    spdlog::trace("[provider:{}] Received erase request", id());
-    spdlog::trace("[provider:{}]    => database = {}", id(), db_name);
-    spdlog::trace("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}] Received erase request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
     RequestResult<bool> result;
     FIND_DATABASE(db);
     result = db->eraseMulti(coll_name, record_ids, commit);
     req.respond(result);
-    spdlog::trace("[provider:{}] Successfully erased records", id());
+    SONATA_TRACE("[provider:{}] Successfully erased records", id());
+  }
+
+  void createIndex(const tl::request &req, const std::string &db_name,
+                   const std::string &coll_name, const std::string &field) {
+    SONATA_TRACE("[provider:{}] Received create_index request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => field = {}", id(), field);
+    RequestResult<bool> result;
+    FIND_DATABASE(db);
+    result = db->createIndex(coll_name, field);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Successfully created index on {}", id(),
+                  field);
+  }
+
+  void dropIndex(const tl::request &req, const std::string &db_name,
+                 const std::string &coll_name, const std::string &field) {
+    SONATA_TRACE("[provider:{}] Received drop_index request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => field = {}", id(), field);
+    RequestResult<bool> result;
+    FIND_DATABASE(db);
+    result = db->dropIndex(coll_name, field);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Successfully dropped index on {}", id(),
+                  field);
+  }
+
+  void queryIndex(const tl::request &req, const std::string &db_name,
+                  const std::string &coll_name, const std::string &field,
+                  const JsonWrapper &lower, const JsonWrapper &upper) {
+    SONATA_TRACE("[provider:{}] Received query_index request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => field = {}", id(), field);
+    RequestResult<std::vector<uint64_t>> result;
+    FIND_DATABASE(db);
+    result = db->queryIndex(coll_name, field, lower, upper);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Index query successfully executed", id());
+  }
+
+  void queryIndexJson(const tl::request &req, const std::string &db_name,
+                      const std::string &coll_name, const std::string &field,
+                      const JsonWrapper &lower, const JsonWrapper &upper) {
+    SONATA_TRACE("[provider:{}] Received query_index request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    SONATA_TRACE("[provider:{}]    => field = {}", id(), field);
+    RequestResult<JsonWrapper> result;
+    FIND_DATABASE(db);
+    result = db->queryIndexJson(coll_name, field, lower, upper);
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Index query successfully executed", id());
+  }
+
+  void cursorOpen(const tl::request &req, const std::string &db_name,
+                  const std::string &coll_name, const JsonWrapper &predicate,
+                  const std::vector<std::string> &fields) {
+    SONATA_TRACE("[provider:{}] Received cursor_open request", id());
+    SONATA_TRACE("[provider:{}]    => database = {}", id(), db_name);
+    SONATA_TRACE("[provider:{}]    => collection = {}", id(), coll_name);
+    RequestResult<uint64_t> result;
+    FIND_DATABASE(db);
+    auto cursor = std::make_shared<CursorState>(db_name, coll_name, fields);
+    if (!predicate->is_null()) {
+      try {
+        cursor->m_predicate = JsonPredicate(predicate.m_object);
+        cursor->m_has_predicate = true;
+      } catch (const Exception &e) {
+        result.success() = false;
+        result.error() = e.what();
+        req.respond(result);
+        return;
+      }
+    }
+    auto size = db->size(coll_name);
+    if (!size.success()) {
+      result.success() = false;
+      result.error() = size.error();
+      req.respond(result);
+      return;
+    }
+    if (size.value() != 0) {
+      auto last_id = db->lastID(coll_name);
+      if (!last_id.success()) {
+        result.success() = false;
+        result.error() = last_id.error();
+        req.respond(result);
+        return;
+      }
+      cursor->m_end_id = last_id.value() + 1;
+    }
+    {
+      std::lock_guard<tl::mutex> lock(m_cursors_mtx);
+      cursor->m_last_used = tl::timer::wtime();
+      for (auto it = m_cursors.begin(); it != m_cursors.end();) {
+        if (cursor->m_last_used - it->second->m_last_used > cursor_idle_timeout)
+          it = m_cursors.erase(it);
+        else
+          ++it;
+      }
+      if (m_cursors.size() >= max_cursors) {
+        result.success() = false;
+        result.error() = "Too many open cursors";
+      } else {
+        result.value() = m_next_cursor_id++;
+        m_cursors.emplace(result.value(), std::move(cursor));
+      }
+    }
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Cursor {} successfully opened", id(),
+                  result.value());
+  }
+
+  void cursorNext(const tl::request &req, uint64_t cursor_id,
+                  size_t max_records, size_t max_bytes) {
+    SONATA_TRACE("[provider:{}] Received cursor_next request", id());
+    SONATA_TRACE("[provider:{}]    => cursor = {}", id(), cursor_id);
+    RequestResult<std::vector<std::string>> result;
+    auto cursor = findCursor(cursor_id);
+    if (!cursor) {
+      result.success() = false;
+      result.error() = "Invalid cursor";
+      req.respond(result);
+      return;
+    }
+    std::lock_guard<tl::mutex> cursor_lock(cursor->m_mutex);
+    const std::string &db_name = cursor->m_db_name;
+    FIND_DATABASE(db);
+    bool raw = !cursor->m_has_predicate && cursor->m_projection.empty();
+    result.success() = readCursorPage(
+        *db, *cursor, max_records, max_bytes, raw, result.error(),
+        [&result](std::string &&record) {
+          result.value().push_back(std::move(record));
+          return result.value().back().size();
+        },
+        [&result](json &&record) {
+          result.value().push_back(record.dump());
+          return result.value().back().size();
+        });
+    if (!result.success())
+      result.value().clear();
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Cursor {} returned {} records", id(),
+                  cursor_id, result.value().size());
+  }
+
+  void cursorNextJson(const tl::request &req, uint64_t cursor_id,
+                      size_t max_records, size_t max_bytes) {
+    SONATA_TRACE("[provider:{}] Received cursor_next request", id());
+    SONATA_TRACE("[provider:{}]    => cursor = {}", id(), cursor_id);
+    RequestResult<JsonWrapper> result;
+    auto cursor = findCursor(cursor_id);
+    if (!cursor) {
+      result.success() = false;
+      result.error() = "Invalid cursor";
+      req.respond(result);
+      return;
+    }
+    std::lock_guard<tl::mutex> cursor_lock(cursor->m_mutex);
+    const std::string &db_name = cursor->m_db_name;
+    FIND_DATABASE(db);
+    result.value() = json::array();
+    result.success() = readCursorPage(
+        *db, *cursor, max_records, max_bytes, false, result.error(),
+        [](std::string &&) { return size_t(0); },
+        [&result, max_bytes](json &&record) {
+          size_t size = max_bytes ? record.dump().size() : 0;
+          result.value()->push_back(std::move(record));
+          return size;
+        });
+    if (!result.success())
+      result.value() = json::array();
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Cursor {} returned {} records", id(),
+                  cursor_id, result.value()->size());
+  }
+
+  void cursorClose(const tl::request &req, uint64_t cursor_id) {
+    SONATA_TRACE("[provider:{}] Received cursor_close request", id());
+    SONATA_TRACE("[provider:{}]    => cursor = {}", id(), cursor_id);
+    RequestResult<bool> result;
+    {
+      std::lock_guard<tl::mutex> lock(m_cursors_mtx);
+      if (m_cursors.erase(cursor_id) == 0) {
+        result.success() = false;
+        result.error() = "Invalid cursor";
+      }
+    }
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Cursor {} closed", id(), cursor_id);
+  }
+
+  void batch(const tl::request &req,
+             const std::vector<BatchOperation> &operations, bool commit) {
+    SONATA_TRACE("[provider:{}] Received batch request", id());
+    SONATA_TRACE("[provider:{}]    => operations = {}", id(),
+                  operations.size());
+    RequestResult<std::vector<BatchOperationResult>> result;
+    auto &results = result.value();
+    results.resize(operations.size());
+    // databases are looked up once per batch, and those that were
+    // written to are committed once at the end instead of once per write
+    std::unordered_map<std::string, std::shared_ptr<Backend>> databases;
+    std::unordered_set<std::string> written;
+    for (size_t i = 0; i < operations.size(); i++) {
+      auto &op = operations[i];
+      auto &op_result = results[i];
+      op_result.m_type = op.m_type;
+      auto it = databases.find(op.m_db_name);
+      if (it == databases.end()) {
+        it = databases.emplace(op.m_db_name, findDatabase(op.m_db_name)).first;
+      }
+      if (!it->second) {
+        op_result.m_success = false;
+        op_result.m_error = "Database "s + op.m_db_name + " not found";
+        continue;
+      }
+      executeBatchOperation(*it->second, op, op_result);
+      if (op_result.m_success && op.isWrite())
+        written.insert(op.m_db_name);
+    }
+    if (commit) {
+      for (auto &db_name : written) {
+        auto committed = databases[db_name]->commit();
+        if (!committed.success()) {
+          result.success() = false;
+          result.error() = committed.error();
+        }
+      }
+    }
+    req.respond(result);
+    SONATA_TRACE("[provider:{}] Batch of {} operations executed", id(),
+                  operations.size());
+  }
+
+private:
+  // Pulls the content of a client's bulk handle into the buffer.
+  // Returns false and sets error if the transfer fails.
+  bool pullBulk(const tl::request &req, const tl::bulk &payload,
+                std::vector<char> &buffer, std::string &error) {
+    buffer.resize(payload.size());
+    if (buffer.empty())
+      return true;
+    try {
+      std::vector<std::pair<void *, size_t>> segments = {
+          {buffer.data(), buffer.size()}};
+      auto local = get_engine().expose(segments, tl::bulk_mode::write_only);
+      payload.on(req.get_endpoint()) >> local;
+    } catch (const std::exception &ex) {
+      error = "Bulk transfer failed: "s + ex.what();
+      return false;
+    }
+    return true;
+  }
+
+  // Responds to a bulk read request. Records that take less than threshold
+  // bytes are sent inline. Otherwise they are packed and kept in
+  // m_bulk_results, and their packed size and result id are sent so that
+  // the client can pull them into a buffer of the right size.
+  void respondBulk(const tl::request &req,
+                   RequestResult<std::vector<std::string>> &records,
+                   uint64_t threshold) {
+    RequestResult<BulkReadResult> result;
+    if (!records.success()) {
+      result.success() = false;
+      result.error() = std::move(records.error());
+      req.respond(result);
+      return;
+    }
+    auto &value = result.value();
+    size_t size = BulkPayload::packedSize(records.value());
+    if (size < threshold) {
+      value.m_records = std::move(records.value());
+    } else {
+      BulkResult bulk_result;
+      bulk_result.m_data.resize(size);
+      BulkPayload::pack(records.value(), bulk_result.m_data.data());
+      bulk_result.m_created = tl::timer::wtime();
+      std::lock_guard<tl::mutex> lock(m_bulk_results_mtx);
+      for (auto it = m_bulk_results.begin(); it != m_bulk_results.end();) {
+        if (bulk_result.m_created - it->second.m_created > bulk_result_timeout)
+          it = m_bulk_results.erase(it);
+        else
+          ++it;
+      }
+      value.m_size = size;
+      value.m_result_id = m_next_bulk_result_id++;
+      m_bulk_results.emplace(value.m_result_id, std::move(bulk_result));
+    }
+    req.respond(result);
+  }
+
+  // Executes an operation of a batch (without committing it)
+  // and fills its result.
+  static void executeBatchOperation(Backend &db, const BatchOperation &op,
+                                    BatchOperationResult &op_result) {
+    auto &coll_name = op.m_coll_name;
+    auto check = [&op_result](const auto &result) {
+      op_result.m_success = result.success();
+      if (!result.success())
+        op_result.m_error = result.error();
+      return result.success();
+    };
+    switch (op.m_type) {
+    case BatchOperation::Store: {
+      auto result = db.store(coll_name, op.m_record, false);
+      if (check(result))
+        op_result.m_record_id = result.value();
+    } break;
+    case BatchOperation::StoreJson: {
+      auto result = db.storeJson(coll_name, op.m_json, false);
+      if (check(result))
+        op_result.m_record_id = result.value();
+    } break;
+    case BatchOperation::Update: {
+      auto result = db.update(coll_name, op.m_record_id, op.m_record, false);
+      if (check(result))
+        op_result.m_updated = result.value();
+    } break;
+    case BatchOperation::UpdateJson: {
+      auto result = db.updateJson(coll_name, op.m_record_id, op.m_json, false);
+      if (check(result))
+        op_result.m_updated = result.value();
+    } break;
+    case BatchOperation::Erase:
+      check(db.erase(coll_name, op.m_record_id, false));
+      break;
+    case BatchOperation::Fetch: {
+      auto result = db.fetch(coll_name, op.m_record_id);
+      if (check(result))
+        op_result.m_record = std::move(result.value());
+    } break;
+    case BatchOperation::FetchJson: {
+      auto result = db.fetchJson(coll_name, op.m_record_id);
+      if (check(result))
+        op_result.m_json = std::move(result.value());
+    } break;
+    default:
+      op_result.m_success = false;
+      op_result.m_error = "Invalid batch operation";
+    }
+  }
+
+  std::shared_ptr<CursorState> findCursor(uint64_t cursor_id) {
+    std::lock_guard<tl::mutex> lock(m_cursors_mtx);
+    auto it = m_cursors.find(cursor_id);
+    if (it == m_cursors.end())
+      return nullptr;
+    it->second->m_last_used = tl::timer::wtime();
+    return it->second;
+  }
+
+  // Reads the next page of a cursor by fetching its records in batches of
+  // ids. If raw is true (no predicate or projection), the records are read
+  // as strings and passed to emit_raw, otherwise they are read as JSON,
+  // filtered, projected and passed to emit_json (without a predicate, the
+  // projection is left to the backend). Both functions return the
+  // size of the record they were passed. Records are emitted until the page
+  // has max_records records or max_bytes bytes (0 meaning no limit).
+  // Records that were fetched but did not fit in the page are read again by
+  // the next call. Returns false and sets error if a read fails.
+  template <typename RawFn, typename JsonFn>
+  bool readCursorPage(Backend &db, CursorState &cursor, size_t max_records,
+                      size_t max_bytes, bool raw, std::string &error,
+                      RawFn &&emit_raw, JsonFn &&emit_json) {
+    size_t count = 0, bytes = 0;
+    auto page_full = [&]() {
+      return (max_records && count >= max_records) ||
+             (max_bytes && bytes >= max_bytes);
+    };
+    while (cursor.m_next_id < cursor.m_end_id && !page_full()) {
+      uint64_t batch = cursor.m_end_id - cursor.m_next_id;
+      if (batch > cursor_batch_size)
+        batch = cursor_batch_size;
+      if (!cursor.m_has_predicate && max_records && batch > max_records - count)
+        batch = max_records - count;
+      std::vector<uint64_t> ids(batch);
+      for (uint64_t i = 0; i < batch; i++)
+        ids[i] = cursor.m_next_id + i;
+      uint64_t consumed = 0;
+      if (raw) {
+        auto records = db.fetchMulti(cursor.m_coll_name, ids);
+        if (!records.success()) {
+          error = std::move(records.error());
+          return false;
+        }
+        auto &values = records.value();
+        for (; consumed < values.size() && !page_full(); consumed++) {
+          auto &record = values[consumed];
+          // missing records are returned as empty strings or "null"
+          if (record.empty() || record == "null")
+            continue;
+          bytes += emit_raw(std::move(record));
+          count += 1;
+        }
+      } else {
+        auto records =
+            cursor.m_has_predicate
+                ? db.fetchMultiJson(cursor.m_coll_name, ids)
+                : db.fetchMultiJsonProjected(cursor.m_coll_name, ids,
+                                             cursor.m_fields);
+        if (!records.success()) {
+          error = std::move(records.error());
+          return false;
+        }
+        auto &values = records.value().m_object;
+        for (; consumed < values.size() && !page_full(); consumed++) {
+          auto &record = values[consumed];
+          if (record.is_null())
+            continue;
+          if (cursor.m_has_predicate) {
+            if (!cursor.m_predicate(record))
+              continue;
+            cursor.m_projection.apply(record);
+          }
+          bytes += emit_json(std::move(record));
+          count += 1;
+        }
+      }
+      if (consumed == 0)
+        consumed = batch; // the backend returned no entry for this batch
+      cursor.m_next_id += consumed;
+    }
+    return true;
   }
 };
 
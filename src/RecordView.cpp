@@ -0,0 +1,198 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#include "sonata/RecordView.hpp"
+#include "sonata/Exception.hpp"
+#include "sonata/JsonSerialize.hpp"
+
+#include "JsonPath.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sonata {
+
+namespace {
+
+int compareKeys(const char *a, size_t a_size, const char *b, size_t b_size) {
+  int c = std::memcmp(a, b, std::min(a_size, b_size));
+  if (c != 0)
+    return c;
+  return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+}
+
+} // namespace
+
+RecordView::RecordView() = default;
+
+RecordView::RecordView(const std::shared_ptr<const std::string> &buffer,
+                       size_t offset)
+    : m_buffer(buffer), m_offset(offset) {}
+
+RecordView::RecordView(const RecordView &) = default;
+
+RecordView::RecordView(RecordView &&) = default;
+
+RecordView &RecordView::operator=(const RecordView &) = default;
+
+RecordView &RecordView::operator=(RecordView &&) = default;
+
+RecordView::~RecordView() = default;
+
+RecordView RecordView::fromBuffer(std::string &&buffer) {
+  const char *data = buffer.data();
+  const char *end = data + buffer.size();
+  JsonCompactCodec::skip(data, end);
+  if (data != end)
+    throw Exception("Invalid record received (trailing bytes)");
+  return RecordView(std::make_shared<const std::string>(std::move(buffer)), 0);
+}
+
+bool RecordView::exists() const { return static_cast<bool>(m_buffer); }
+
+json::value_t RecordView::type() const {
+  if (not m_buffer)
+    return json::value_t::discarded;
+  return (json::value_t)(*m_buffer)[m_offset];
+}
+
+bool RecordView::is_number() const {
+  auto t = type();
+  return t == json::value_t::number_integer ||
+         t == json::value_t::number_unsigned ||
+         t == json::value_t::number_float;
+}
+
+size_t RecordView::size() const {
+  if (not is_array() and not is_object())
+    return 0;
+  if (m_entries)
+    return m_entries->size();
+  const char *data = m_buffer->data() + m_offset + 1;
+  return JsonCompactCodec::read<uint64_t>(data,
+                                          m_buffer->data() + m_buffer->size());
+}
+
+const std::vector<RecordView::Entry> &RecordView::entries() const {
+  if (m_entries)
+    return *m_entries;
+  auto entries = std::make_shared<std::vector<Entry>>();
+  bool is_obj = is_object();
+  if (is_obj or is_array()) {
+    const char *begin = m_buffer->data();
+    const char *end = begin + m_buffer->size();
+    const char *data = begin + m_offset + 1;
+    auto count = JsonCompactCodec::readCount(data, end);
+    entries->reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      Entry entry;
+      if (is_obj) {
+        entry.m_key = data - begin;
+        JsonCompactCodec::skipString(data, end);
+      }
+      entry.m_value = data - begin;
+      JsonCompactCodec::skip(data, end);
+      entries->push_back(entry);
+    }
+    if (is_obj) {
+      // objects are encoded with their keys in order, but
+      // binary searches below should not rely on the sender
+      auto less = [begin, end](const Entry &a, const Entry &b) {
+        const char *a_data = begin + a.m_key;
+        const char *b_data = begin + b.m_key;
+        uint64_t a_size, b_size;
+        auto a_key = JsonCompactCodec::skipString(a_data, end, &a_size);
+        auto b_key = JsonCompactCodec::skipString(b_data, end, &b_size);
+        return compareKeys(a_key, a_size, b_key, b_size) < 0;
+      };
+      if (not std::is_sorted(entries->begin(), entries->end(), less))
+        std::sort(entries->begin(), entries->end(), less);
+    }
+  }
+  m_entries = std::move(entries);
+  return *m_entries;
+}
+
+RecordView RecordView::operator[](const std::string &key) const {
+  if (not is_object())
+    return RecordView();
+  auto &entries = this->entries();
+  const char *begin = m_buffer->data();
+  const char *end = begin + m_buffer->size();
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), key,
+      [begin, end](const Entry &entry, const std::string &target) {
+        const char *data = begin + entry.m_key;
+        uint64_t size;
+        auto entry_key = JsonCompactCodec::skipString(data, end, &size);
+        return compareKeys(entry_key, size, target.data(), target.size()) < 0;
+      });
+  if (it == entries.end())
+    return RecordView();
+  const char *data = begin + it->m_key;
+  uint64_t size;
+  auto entry_key = JsonCompactCodec::skipString(data, end, &size);
+  if (compareKeys(entry_key, size, key.data(), key.size()) != 0)
+    return RecordView();
+  return RecordView(m_buffer, it->m_value);
+}
+
+RecordView RecordView::operator[](size_t index) const {
+  if (not is_array())
+    return RecordView();
+  auto &entries = this->entries();
+  if (index >= entries.size())
+    return RecordView();
+  return RecordView(m_buffer, entries[index].m_value);
+}
+
+RecordView RecordView::lookup(const std::string &path) const {
+  JsonPath json_path(path);
+  RecordView view = *this;
+  for (auto &key : json_path.keys()) {
+    view = view[key];
+    if (not view.exists())
+      break;
+  }
+  return view;
+}
+
+bool RecordView::contains(const std::string &key) const {
+  return (*this)[key].exists();
+}
+
+std::vector<std::string> RecordView::keys() const {
+  std::vector<std::string> result;
+  if (not is_object())
+    return result;
+  auto &entries = this->entries();
+  const char *begin = m_buffer->data();
+  const char *end = begin + m_buffer->size();
+  result.reserve(entries.size());
+  for (auto &entry : entries) {
+    const char *data = begin + entry.m_key;
+    uint64_t size;
+    auto key = JsonCompactCodec::skipString(data, end, &size);
+    result.emplace_back(key, size);
+  }
+  return result;
+}
+
+json RecordView::to_json() const {
+  if (not m_buffer)
+    return json(json::value_t::discarded);
+  const char *data = m_buffer->data() + m_offset;
+  json result;
+  JsonCompactCodec::decode(data, m_buffer->data() + m_buffer->size(), result);
+  return result;
+}
+
+json RecordView::checkedJson() const {
+  if (not m_buffer)
+    throw Exception("RecordView does not refer to an existing value");
+  return to_json();
+}
+
+} // namespace sonata
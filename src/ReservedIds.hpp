@@ -0,0 +1,97 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_RESERVED_IDS_HPP
+#define __SONATA_RESERVED_IDS_HPP
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <nlohmann/json.hpp>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief ReservedIds keeps track of the ids of a collection that have
+ * been handed out by reserveIds but have not been used by storeReserved
+ * yet, as a set of disjoint [begin, end) ranges. Ids are removed when a
+ * record is stored with them, so that an id can only be used once, and
+ * an id that has since been erased is not mistaken for a reserved one.
+ */
+class ReservedIds {
+
+public:
+  ReservedIds() = default;
+
+  /**
+   * @brief Builds a ReservedIds from the output of toJson().
+   */
+  explicit ReservedIds(const json &ranges) {
+    for (auto &range : ranges)
+      m_ranges[range[0].get<uint64_t>()] = range[1].get<uint64_t>();
+  }
+
+  bool empty() const { return m_ranges.empty(); }
+
+  /**
+   * @brief Adds the ids [begin, begin+count).
+   */
+  void add(uint64_t begin, uint64_t count) {
+    if (count == 0)
+      return;
+    uint64_t end = begin + count;
+    // merge with the range that ends where this one begins, if any
+    // (reserveIds hands out consecutive blocks)
+    auto next = m_ranges.lower_bound(begin);
+    if (next != m_ranges.begin()) {
+      auto prev = std::prev(next);
+      if (prev->second == begin) {
+        prev->second = end;
+        return;
+      }
+    }
+    m_ranges[begin] = end;
+  }
+
+  bool contains(uint64_t id) const {
+    auto it = m_ranges.upper_bound(id);
+    if (it == m_ranges.begin())
+      return false;
+    return id < std::prev(it)->second;
+  }
+
+  /**
+   * @brief Removes an id, which must be contained.
+   */
+  void remove(uint64_t id) {
+    auto it = std::prev(m_ranges.upper_bound(id));
+    uint64_t begin = it->first;
+    uint64_t end = it->second;
+    m_ranges.erase(it);
+    if (begin < id)
+      m_ranges[begin] = id;
+    if (id + 1 < end)
+      m_ranges[id + 1] = end;
+  }
+
+  /**
+   * @brief Returns the ranges as an array of [begin, end) pairs.
+   */
+  json toJson() const {
+    json ranges = json::array();
+    for (auto &range : m_ranges)
+      ranges.push_back({range.first, range.second});
+    return ranges;
+  }
+
+private:
+  std::map<uint64_t, uint64_t> m_ranges; // begin -> end
+};
+
+} // namespace sonata
+
+#endif
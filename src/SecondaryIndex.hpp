@@ -0,0 +1,317 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_SECONDARY_INDEX_HPP
+#define __SONATA_SECONDARY_INDEX_HPP
+
+#include "JsonPath.hpp"
+#include <sonata/JsonSerialize.hpp>
+#include <algorithm>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief Key/value store in which a SecondaryIndex keeps its entries.
+ */
+class IndexStorage {
+
+public:
+  virtual ~IndexStorage() = default;
+
+  /**
+   * @brief Reads the value of a key into value. Returns false
+   * if the key does not exist.
+   */
+  virtual bool fetch(const std::string &key, std::vector<char> &value) = 0;
+
+  virtual void store(const std::string &key, const std::string &value) = 0;
+
+  virtual void erase(const std::string &key) = 0;
+};
+
+/**
+ * @brief A SecondaryIndex maps the values found at a given field path
+ * (e.g. "rank" or "func.name") in the records of a collection to the
+ * ids of these records, in order, so that equality and range queries
+ * on this field do not require a full scan of the collection.
+ * Records that do not have the field are not indexed.
+ *
+ * Entries are (value, id) pairs ordered following nlohmann::json's
+ * comparison operators (numbers are compared by value regardless of
+ * their representation, values of different types are ordered by type).
+ * They are kept in an IndexStorage, in pages of at most max_page_entries
+ * sorted entries stored under their own key. The directory of the pages
+ * (their order and the first entry of each) is kept in memory and stored
+ * under its own key, and the value indexed for each record is stored so
+ * that the record's entry can be found when it is updated or erased.
+ * Keys are prefixed by the prefix given to the constructor.
+ *
+ * This class is not thread-safe.
+ */
+class SecondaryIndex {
+
+public:
+  static constexpr size_t max_page_entries = 256;
+
+  SecondaryIndex(IndexStorage &storage, const std::string &prefix,
+                 const std::string &field)
+      : m_storage(&storage), m_prefix(prefix), m_path(field) {}
+
+  SecondaryIndex(SecondaryIndex &&) = default;
+  SecondaryIndex(const SecondaryIndex &) = delete;
+  SecondaryIndex &operator=(SecondaryIndex &&) = default;
+  SecondaryIndex &operator=(const SecondaryIndex &) = delete;
+
+  const std::string &field() const { return m_path.str(); }
+
+  /**
+   * @brief Loads the directory of the index from the storage.
+   * Returns false if the index was not stored.
+   */
+  bool load() {
+    std::vector<char> buffer;
+    if (!m_storage->fetch(directoryKey(), buffer))
+      return false;
+    json directory = decode(buffer);
+    m_pages = directory["pages"].get<std::vector<uint64_t>>();
+    m_fences = directory["fences"].get<std::vector<json>>();
+    m_next_page = directory["next"].get<uint64_t>();
+    return true;
+  }
+
+  /**
+   * @brief Replaces the content of the index with the records passed
+   * to the function given to for_each, as f(id, record).
+   */
+  template <typename F> void rebuild(F &&for_each) {
+    clear();
+    std::vector<json> entries;
+    for_each([this, &entries](uint64_t id, const json &record) {
+      const json *value = m_path.lookup(record);
+      if (value)
+        entries.push_back(json::array({*value, id}));
+    });
+    std::sort(entries.begin(), entries.end());
+    // pages are filled to 3/4, leaving room for insertions
+    constexpr size_t fill = max_page_entries * 3 / 4;
+    m_pages.clear();
+    m_fences.clear();
+    for (size_t i = 0; i == 0 || i < entries.size(); i += fill) {
+      size_t end = std::min(entries.size(), i + fill);
+      json page = json::array();
+      for (size_t j = i; j < end; j++) {
+        storeValue(entries[j][1].get<uint64_t>(), entries[j][0]);
+        page.push_back(std::move(entries[j]));
+      }
+      if (!m_pages.empty())
+        m_fences.push_back(page[0]);
+      m_pages.push_back(m_next_page++);
+      storePage(m_pages.back(), page);
+    }
+    storeDirectory();
+  }
+
+  /**
+   * @brief Indexes (or re-indexes) a record.
+   */
+  void insert(uint64_t id, const json &record) {
+    erase(id);
+    const json *value = m_path.lookup(record);
+    if (!value)
+      return;
+    json entry = json::array({*value, id});
+    size_t i = pageIndex(entry);
+    json page = loadPage(m_pages[i]);
+    auto &entries = page.get_ref<json::array_t &>();
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry),
+                   entry);
+    storeValue(id, *value);
+    if (entries.size() <= max_page_entries) {
+      storePage(m_pages[i], page);
+      return;
+    }
+    // the second half of the page moves to a new page
+    json next_page = json::array();
+    auto middle = entries.begin() + entries.size() / 2;
+    next_page.get_ref<json::array_t &>().assign(
+        std::make_move_iterator(middle), std::make_move_iterator(entries.end()));
+    entries.erase(middle, entries.end());
+    m_fences.insert(m_fences.begin() + i, next_page[0]);
+    m_pages.insert(m_pages.begin() + i + 1, m_next_page++);
+    storePage(m_pages[i], page);
+    storePage(m_pages[i + 1], next_page);
+    storeDirectory();
+  }
+
+  /**
+   * @brief Removes a record from the index.
+   */
+  void erase(uint64_t id) {
+    std::vector<char> buffer;
+    if (!m_storage->fetch(valueKey(id), buffer))
+      return;
+    m_storage->erase(valueKey(id));
+    json entry = json::array({decode(buffer), id});
+    size_t i = pageIndex(entry);
+    json page = loadPage(m_pages[i]);
+    auto &entries = page.get_ref<json::array_t &>();
+    auto it = std::lower_bound(entries.begin(), entries.end(), entry);
+    if (it != entries.end() && *it == entry)
+      entries.erase(it);
+    if (!entries.empty() || m_pages.size() == 1) {
+      storePage(m_pages[i], page);
+      return;
+    }
+    // empty pages are removed, except the last one
+    m_storage->erase(pageKey(m_pages[i]));
+    m_fences.erase(m_fences.begin() + (i == 0 ? 0 : i - 1));
+    m_pages.erase(m_pages.begin() + i);
+    storeDirectory();
+  }
+
+  /**
+   * @brief Removes the index from the storage.
+   */
+  void clear() {
+    for (auto page_id : m_pages) {
+      for (auto &entry : loadPage(page_id))
+        m_storage->erase(valueKey(entry[1].get<uint64_t>()));
+      m_storage->erase(pageKey(page_id));
+    }
+    m_storage->erase(directoryKey());
+    m_pages.assign(1, 0);
+    m_fences.clear();
+    m_next_page = 1;
+  }
+
+  /**
+   * @brief Returns the ids, in increasing order, of the records
+   * for which the indexed field is within [lower, upper].
+   * A null bound means that the range is not bounded on that side,
+   * within the type of the other bound (e.g. [5, null] matches numbers
+   * greater than or equal to 5, but no string).
+   */
+  std::vector<uint64_t> query(const json &lower, const json &upper) const {
+    std::vector<uint64_t> ids;
+    if (!lower.is_null() && !upper.is_null() && upper < lower)
+      return ids;
+    bool clamped = lower.is_null() != upper.is_null();
+    const json &typed = lower.is_null() ? upper : lower;
+    json first = json::array(
+        {lower.is_null() ? smallestOfType(upper) : lower, 0});
+    size_t i = lower.is_null() && upper.is_null() ? 0 : pageIndex(first);
+    for (; i < m_pages.size(); i++) {
+      json page = loadPage(m_pages[i]);
+      auto &entries = page.get_ref<const json::array_t &>();
+      auto it = lower.is_null() && upper.is_null()
+                    ? entries.begin()
+                    : std::lower_bound(entries.begin(), entries.end(), first);
+      for (; it != entries.end(); ++it) {
+        auto &value = (*it)[0];
+        if ((!upper.is_null() && upper < value) ||
+            (clamped && !sameType(value, typed))) {
+          std::sort(ids.begin(), ids.end());
+          return ids;
+        }
+        ids.push_back((*it)[1].get<uint64_t>());
+      }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+  }
+
+private:
+  static bool sameType(const json &a, const json &b) {
+    return (a.is_number() && b.is_number()) || a.type() == b.type();
+  }
+
+  // Smallest value of the type of value.
+  static json smallestOfType(const json &value) {
+    switch (value.type()) {
+    case json::value_t::number_integer:
+    case json::value_t::number_unsigned:
+    case json::value_t::number_float:
+      return -std::numeric_limits<double>::infinity();
+    case json::value_t::boolean:
+      return false;
+    case json::value_t::string:
+      return "";
+    case json::value_t::array:
+      return json::array();
+    case json::value_t::object:
+      return json::object();
+    default:
+      return nullptr;
+    }
+  }
+
+  // Position in m_pages of the page in which an entry belongs.
+  size_t pageIndex(const json &entry) const {
+    return std::upper_bound(m_fences.begin(), m_fences.end(), entry) -
+           m_fences.begin();
+  }
+
+  std::string directoryKey() const { return m_prefix + "d"; }
+
+  std::string pageKey(uint64_t page_id) const {
+    return m_prefix + "p" + std::to_string(page_id);
+  }
+
+  std::string valueKey(uint64_t id) const {
+    return m_prefix + "v" + std::to_string(id);
+  }
+
+  static json decode(const std::vector<char> &buffer) {
+    json value;
+    const char *data = buffer.data();
+    JsonCompactCodec::decode(data, data + buffer.size(), value);
+    return value;
+  }
+
+  static std::string encode(const json &value) {
+    std::string buffer;
+    JsonCompactCodec::encode(value, buffer);
+    return buffer;
+  }
+
+  json loadPage(uint64_t page_id) const {
+    std::vector<char> buffer;
+    if (!m_storage->fetch(pageKey(page_id), buffer))
+      return json::array();
+    return decode(buffer);
+  }
+
+  void storePage(uint64_t page_id, const json &page) {
+    m_storage->store(pageKey(page_id), encode(page));
+  }
+
+  void storeValue(uint64_t id, const json &value) {
+    m_storage->store(valueKey(id), encode(value));
+  }
+
+  void storeDirectory() {
+    json directory = {{"pages", m_pages},
+                      {"fences", m_fences},
+                      {"next", m_next_page}};
+    m_storage->store(directoryKey(), encode(directory));
+  }
+
+  IndexStorage *m_storage;
+  std::string m_prefix;
+  JsonPath m_path;
+  std::vector<uint64_t> m_pages = {0}; // in the order of their entries
+  std::vector<json> m_fences; // m_fences[i] is the first entry of page i+1
+  uint64_t m_next_page = 1;
+};
+
+} // namespace sonata
+
+#endif
@@ -29,6 +29,9 @@ std::unique_ptr<Backend> UnQLiteBackend::create(const tl::engine &engine,
   bool temporary = config.value("temporary", false);
   bool inmemory = config.value("in-memory", false);
   bool bypass = config.value("bypass", false);
+  size_t vm_pool_size = config.value("vm_pool_size", 16);
+  uint64_t group_commit_window_ms = config.value("group_commit_window_ms", 0);
+  size_t group_commit_max_size = config.value("group_commit_max_size", 0);
   std::string mutex_mode = config.value("mutex", unqlite_mutex_mode);
   if(mutex_mode != "none"
   && mutex_mode != "global"
@@ -103,6 +106,11 @@ std::unique_ptr<Backend> UnQLiteBackend::create(const tl::engine &engine,
   backend->m_client = Client(engine);
   backend->m_admin = Admin(engine);
   backend->m_mutex_mode = getMutexMode(unqlite_mutex_mode);
+  backend->m_vm_pool = std::make_unique<UnQLiteVMPool>(pDB, backend.get(),
+                                                       vm_pool_size);
+  backend->m_group_commit_window_ms = group_commit_window_ms;
+  backend->m_group_commit_max_size = group_commit_max_size;
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[unqlite] Successfully created database at {}", db_path);
   return backend;
 }
@@ -111,6 +119,9 @@ std::unique_ptr<Backend> UnQLiteBackend::attach(const tl::engine &engine,
                                                 const tl::pool &pool,
                                                 const json &config) {
   bool bypass = config.value("bypass", false);
+  size_t vm_pool_size = config.value("vm_pool_size", 16);
+  uint64_t group_commit_window_ms = config.value("group_commit_window_ms", 0);
+  size_t group_commit_max_size = config.value("group_commit_max_size", 0);
   std::string mutex_mode = config.value("mutex", unqlite_mutex_mode);
   if(mutex_mode != "none"
   && mutex_mode != "global"
@@ -172,6 +183,11 @@ std::unique_ptr<Backend> UnQLiteBackend::attach(const tl::engine &engine,
   backend->m_client = Client(engine);
   backend->m_admin = Admin(engine);
   backend->m_mutex_mode = getMutexMode(unqlite_mutex_mode);
+  backend->m_vm_pool = std::make_unique<UnQLiteVMPool>(pDB, backend.get(),
+                                                       vm_pool_size);
+  backend->m_group_commit_window_ms = group_commit_window_ms;
+  backend->m_group_commit_max_size = group_commit_max_size;
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[unqlite] Successfully opened database at {}", db_path);
   return backend;
 }
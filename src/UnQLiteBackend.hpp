@@ -13,14 +13,26 @@
 
 #include "UnQLiteMutex.hpp"
 #include "UnQLiteVM.hpp"
+#include "UnQLiteVMPool.hpp"
 #include "UnQLiteJsonEncoder.hpp"
+#include "UnQLiteJsonDecoder.hpp"
+#include "JsonAggregation.hpp"
+#include "JsonPredicate.hpp"
+#include "JsonProjection.hpp"
+#include "ParallelScan.hpp"
+#include "ReservedIds.hpp"
+#include "SecondaryIndex.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <ctime>
 #include <fstream>
+#include <map>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 #include <sstream>
 #include <thallium.hpp>
+#include <unordered_set>
 
 namespace sonata {
 
@@ -62,6 +74,7 @@ public:
                                          const json &config);
 
   virtual ~UnQLiteBackend() {
+    m_vm_pool.reset();
     if (m_db)
       unqlite_commit(m_db);
     // if(m_db) unqlite_close(m_db); // XXX commented because of bug
@@ -82,17 +95,24 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("collection", coll_name);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          // a collection of the same name dropped by execute() may
+          // have left reserved ids behind
+          storeReservedIds(coll_name, ReservedIds());
+        }
       }
-      unqlite_commit(m_db);
+      commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -111,13 +131,14 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
+      auto guard = readCollection(coll_name, true);
       std::unique_lock<tl::mutex> lock;
       if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
+      auto vm = m_vm_pool->acquire(script);
+      vm->set("collection", coll_name);
+      vm->execute();
+      result.success() = vm->get<bool>("ret");
       result.error() = "Collection"s + coll_name + " does not exist";
     } catch (const Exception &e) {
       result.success() = false;
@@ -141,17 +162,23 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("collection", coll_name);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          dropIndexes(coll_name);
+          storeReservedIds(coll_name, ReservedIds());
+        }
       }
-      unqlite_commit(m_db);
+      commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -162,45 +189,18 @@ public:
   virtual RequestResult<uint64_t> store(const std::string &coll_name,
                                         const std::string &record,
                                         bool commit) override {
-    if(m_bypass) {
-        return storeDirect(coll_name, json::parse(record), commit);
-    }
-    std::ostringstream ss;
-    ss << "$input = " << record << ";"
-       << R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $ret = db_store($collection,$input);
-            if(!$ret) {
-                $err = db_errlog();
-            } else {
-                $id = $input.__id;
-            }
-        }
-        )jx9";
-    RequestResult<uint64_t> result;
+    // the record is parsed here and bound to the VM rather than spliced
+    // into the script, so the script can be taken from the VM pool
+    JsonWrapper json_record;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, ss.str().c_str(), this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<uint64_t>("id");
-      }
-      if (commit)
-        unqlite_commit(m_db);
-    } catch (const Exception &e) {
+      json_record = json::parse(record);
+    } catch (const json::exception &e) {
+      RequestResult<uint64_t> result;
       result.success() = false;
       result.error() = e.what();
+      return result;
     }
-    return result;
+    return storeJson(coll_name, json_record, commit);
   }
 
   virtual RequestResult<uint64_t> storeJson(const std::string &coll_name,
@@ -224,21 +224,27 @@ public:
         )jx9";
     RequestResult<uint64_t> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("input", record.m_object);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<uint64_t>("id");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("input", record.m_object);
+        vm->set("collection", coll_name);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          result.value() = vm->get<uint64_t>("id");
+          updateIndexes(coll_name, [&](SecondaryIndex &index) {
+            index.insert(result.value(), record.m_object);
+          });
+        }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -258,6 +264,7 @@ public:
     auto value = UnQLiteJsonEncoder::encode(record.m_object);
     std::vector<char> header(24);
     unqlite_int64 header_size = 24;
+    auto guard = writeCollection(coll_name);
     std::unique_lock<tl::mutex> lock;
     if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
@@ -276,9 +283,9 @@ public:
     // add the id to the record (it's kind of a hack)
     json id_rec = json::object();
     if(Endian::little)
-        id_rec["__id"] = last_record_id;
-    else
         id_rec["__id"] = Endian::swap(last_record_id);
+    else
+        id_rec["__id"] = last_record_id;
     auto id_rec_buf = UnQLiteJsonEncoder::encode(id_rec);
     value.resize(value.size()+id_rec_buf.size()-2);
     std::memcpy(value.data()+value.size()-id_rec_buf.size()+1,
@@ -308,72 +315,38 @@ public:
     // write the header
     rc = unqlite_kv_store(m_db, coll_name.c_str(), coll_name.size(),
                           header.data(), header_size);
+    updateIndexes(coll_name, [&](SecondaryIndex &index) {
+      index.insert(result.value(), record.m_object);
+    });
+    if (commit) {
+      if (lock)
+        lock.unlock();
+      guard.unlock();
+      commitDatabase();
+    }
     return result;
   }
 
   virtual RequestResult<std::vector<uint64_t>>
   storeMulti(const std::string &coll_name,
              const std::vector<std::string> &records, bool commit) override {
-    if(m_bypass) {
-        auto json_records = json::array();
-        for(auto& r : records)
-            json_records.push_back(json::parse(r));
-        return storeMultiDirect(coll_name, std::move(json_records), commit);
-    }
-    std::ostringstream ss;
-    ss << "$input = [";
-    for (unsigned i = 0; i < records.size(); i++) {
-      ss << records[i];
-      if (i != records.size() - 1)
-        ss << ",";
-    }
-    ss << "];"
-       << R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $ids = [];
-            $ret = db_store($collection,$input);
-            if($ret) {
-                foreach($input as $x) {
-                    array_push($ids,$x.__id);
-                }
-            } else {
-                $err = "Some records could not be stored";
-            }
-        }
-        )jx9";
-    RequestResult<std::vector<uint64_t>> result;
+    JsonWrapper json_records = json::array();
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, ss.str().c_str(), this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<std::vector<uint64_t>>("ids");
-      }
-      if (commit)
-        unqlite_commit(m_db);
-    } catch (const Exception &e) {
+      for (auto &r : records)
+        json_records->push_back(json::parse(r));
+    } catch (const json::exception &e) {
+      RequestResult<std::vector<uint64_t>> result;
       result.success() = false;
       result.error() = e.what();
+      return result;
     }
-    return result;
+    return storeMultiJson(coll_name, json_records, commit);
   }
 
   virtual RequestResult<bool> commit() override {
     RequestResult<bool> result;
     result.success() = true;
-    std::unique_lock<tl::mutex> lock;
-    if (m_mutex_mode == MutexMode::global)
-      lock = std::unique_lock<tl::mutex>(m_mutex);
-    unqlite_commit(m_db);
+    commitDatabase();
     return result;
   }
 
@@ -405,21 +378,28 @@ public:
         }
         )jx9";
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("input", records.m_object);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<std::vector<uint64_t>>("ids");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("input", records.m_object);
+        vm->set("collection", coll_name);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          result.value() = vm->get<std::vector<uint64_t>>("ids");
+          updateIndexes(coll_name, [&](SecondaryIndex &index) {
+            for (size_t i = 0; i < result.value().size(); i++)
+              index.insert(result.value()[i], records.m_object[i]);
+          });
+        }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -450,6 +430,7 @@ public:
     std::vector<char> header(24);
     unqlite_int64 header_size = 24;
 
+    auto guard = writeCollection(coll_name);
     std::unique_lock<tl::mutex> lock;
     if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
@@ -508,42 +489,137 @@ public:
     // write the header
     rc = unqlite_kv_store(m_db, coll_name.c_str(), coll_name.size(),
             header.data(), header_size);
+    updateIndexes(coll_name, [&](SecondaryIndex &index) {
+      for (size_t i = 0; i < result.value().size(); i++)
+        index.insert(result.value()[i], records.m_object[i]);
+    });
+    if (commit) {
+      if (lock)
+        lock.unlock();
+      guard.unlock();
+      commitDatabase();
+    }
+    return result;
+  }
+
+  // Reserves ids by bumping the last_record_id of the collection header,
+  // which db_store (and storeDirect) use to assign the next id.
+  virtual RequestResult<uint64_t> reserveIds(const std::string &coll_name,
+                                             size_t count) override {
+    RequestResult<uint64_t> result;
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = writeCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if(!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    result.value() = last_record_id;
+    storeHeaderDirect(coll_name, header, last_record_id + count,
+                      total_records);
+    auto reserved = fetchReservedIds(coll_name);
+    reserved.add(last_record_id, count);
+    storeReservedIds(coll_name, reserved);
+    return result;
+  }
+
+  virtual RequestResult<bool>
+  storeReserved(const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const JsonWrapper &records, bool commit) override {
+    RequestResult<bool> result;
+    if(!records->is_array() || records->size() != record_ids.size()) {
+        result.success() = false;
+        result.error() = "Invalid number of records";
+        return result;
+    }
+    std::vector<std::vector<char>> values;
+    json id_rec = json::object();
+    for(size_t i = 0; i < record_ids.size(); i++) {
+        auto& obj = records.m_object[i];
+        if(!obj.is_object()) {
+            result.success() = false;
+            result.error() = "One of the records is not an object";
+            return result;
+        }
+        values.push_back(UnQLiteJsonEncoder::encode(obj));
+        // add the id to the record (same hack as storeMultiDirect)
+        auto& value = values.back();
+        id_rec["__id"] = record_ids[i];
+        auto id_rec_buf = UnQLiteJsonEncoder::encode(id_rec);
+        value.resize(value.size()+id_rec_buf.size()-2);
+        std::memcpy(value.data()+value.size()-id_rec_buf.size()+1,
+                    id_rec_buf.data()+1, id_rec_buf.size()-1);
+    }
+
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = writeCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+        lock = std::unique_lock<tl::mutex>(m_mutex);
+    if(!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+    }
+    // ids are checked on a copy of the reserved ones, from which they
+    // are removed, so that an id used twice in this call is rejected
+    auto reserved = fetchReservedIds(coll_name);
+    auto remaining = reserved;
+    for(auto id : record_ids) {
+        if(!remaining.contains(id)) {
+            result.success() = false;
+            result.error() = "Record id " + std::to_string(id)
+                           + " was not reserved";
+            return result;
+        }
+        remaining.remove(id);
+    }
+    for(size_t i = 0; i < values.size(); i++) {
+        std::string key = coll_name + "_" + std::to_string(record_ids[i]);
+        int rc = unqlite_kv_store(m_db, key.c_str(), key.size(),
+                                  values[i].data(), values[i].size());
+        if(rc != UNQLITE_OK) {
+            // the records written so far are accounted for
+            values.resize(i);
+            result.success() = false;
+            result.error() = "Failed to store record";
+            break;
+        }
+    }
+    for(size_t i = 0; i < values.size(); i++)
+        reserved.remove(record_ids[i]);
+    storeReservedIds(coll_name, reserved);
+    storeHeaderDirect(coll_name, header, last_record_id,
+                      total_records + values.size());
+    updateIndexes(coll_name, [&](SecondaryIndex &index) {
+      for (size_t i = 0; i < values.size(); i++)
+        index.insert(record_ids[i], records.m_object[i]);
+    });
+    if (commit) {
+      if (lock)
+        lock.unlock();
+      guard.unlock();
+      commitDatabase();
+    }
     return result;
   }
 
+  bool addsRecordIds() const override { return true; }
+
   virtual RequestResult<std::string> fetch(const std::string &coll_name,
                                            uint64_t record_id) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $output = db_fetch_by_id($collection,$id);
-            if($output == NULL) {
-                $ret = false;
-                $err = "Record does not exist";
-            } else {
-                $ret = true;
-            }
-        }
-        )jx9";
     RequestResult<std::string> result;
+    std::vector<char> buffer;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("id", record_id);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        std::ostringstream ss;
-        vm["output"].printToStream(ss);
-        result.value() = ss.str();
-      }
+      if (!fetchRecordOrError(coll_name, record_id, buffer, result))
+        return result;
+      result.value() = UnQLiteJsonDecoder::decodeToString(buffer);
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -553,35 +629,20 @@ public:
 
   virtual RequestResult<JsonWrapper> fetchJson(const std::string &coll_name,
                                                uint64_t record_id) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $output = db_fetch_by_id($collection,$id);
-            if($output == NULL) {
-                $ret = false;
-                $err = "Record does not exist";
-            } else {
-                $ret = true;
-            }
-        }
-        )jx9";
+    return fetchJsonProjected(coll_name, record_id, {});
+  }
+
+  // The fields that are not requested are skipped while decoding records.
+  virtual RequestResult<JsonWrapper>
+  fetchJsonProjected(const std::string &coll_name, uint64_t record_id,
+                     const std::vector<std::string> &fields) override {
     RequestResult<JsonWrapper> result;
+    std::vector<char> buffer;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("id", record_id);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm["output"].as<json>();
-      }
+      if (!fetchRecordOrError(coll_name, record_id, buffer, result))
+        return result;
+      result.value() =
+          UnQLiteJsonDecoder::decode(buffer, JsonProjection(fields));
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -592,38 +653,17 @@ public:
   virtual RequestResult<std::vector<std::string>>
   fetchMulti(const std::string &coll_name,
              const std::vector<uint64_t> &record_ids) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $output = [];
-            $ret = true;
-            foreach($ids as $id) {
-                $x = db_fetch_by_id($collection,$id);
-                array_push($output, $x);
-            }
-        }
-        )jx9";
     RequestResult<std::vector<std::string>> result;
+    std::vector<std::vector<char>> buffers;
+    std::vector<bool> found;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("ids", record_ids);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        UnQLiteValue output = vm["output"];
-        output.foreach ([&result](unsigned, const UnQLiteValue &v) {
-          std::ostringstream ss;
-          v.printToStream(ss);
-          result.value().push_back(std::move(ss.str()));
-        });
+      if (!fetchRecordsOrError(coll_name, record_ids, buffers, found, result))
+        return result;
+      result.value().resize(record_ids.size());
+      for (size_t i = 0; i < record_ids.size(); i++) {
+        if (found[i])
+          UnQLiteJsonDecoder::decodeToString(
+              buffers[i].data(), buffers[i].size(), result.value()[i]);
       }
     } catch (const Exception &e) {
       result.success() = false;
@@ -635,33 +675,27 @@ public:
   virtual RequestResult<JsonWrapper>
   fetchMultiJson(const std::string &coll_name,
                  const std::vector<uint64_t> &record_ids) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $output = [];
-            $ret = true;
-            foreach($ids as $id) {
-                $x = db_fetch_by_id($collection,$id);
-                array_push($output, $x);
-            }
-        }
-        )jx9";
+    return fetchMultiJsonProjected(coll_name, record_ids, {});
+  }
+
+  virtual RequestResult<JsonWrapper>
+  fetchMultiJsonProjected(const std::string &coll_name,
+                          const std::vector<uint64_t> &record_ids,
+                          const std::vector<std::string> &fields) override {
     RequestResult<JsonWrapper> result;
+    std::vector<std::vector<char>> buffers;
+    std::vector<bool> found;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("ids", record_ids);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm["output"].as<json>();
+      if (!fetchRecordsOrError(coll_name, record_ids, buffers, found, result))
+        return result;
+      JsonProjection projection(fields);
+      result.value() = json::array();
+      for (size_t i = 0; i < record_ids.size(); i++) {
+        if (found[i])
+          result.value()->push_back(
+              UnQLiteJsonDecoder::decode(buffers[i], projection));
+        else
+          result.value()->push_back(nullptr);
       }
     } catch (const Exception &e) {
       result.success() = false;
@@ -696,6 +730,7 @@ public:
         )jx9";
     RequestResult<std::vector<std::string>> result;
     try {
+      auto guard = readCollection(coll_name, true);
       std::unique_lock<tl::mutex> lock;
       if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
@@ -716,7 +751,6 @@ public:
         });
         result.value() = std::move(array);
       }
-      unqlite_commit(m_db);
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -751,6 +785,7 @@ public:
         )jx9";
     RequestResult<JsonWrapper> result;
     try {
+      auto guard = readCollection(coll_name, true);
       std::unique_lock<tl::mutex> lock;
       if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
@@ -764,7 +799,104 @@ public:
       } else {
         result.value() = vm["data"].as<json>();
       }
-      unqlite_commit(m_db);
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name,
+                  const JsonWrapper &predicate) override {
+    RequestResult<std::vector<std::string>> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      auto &records = result.value();
+      // records are read under the lock by chunks, each of which is then
+      // decoded and evaluated outside of it, in parallel if it is large
+      forEachCandidateChunkOrError(
+          coll_name, pred, result,
+          [this, &pred, &records](std::vector<std::vector<char>> &buffers) {
+            auto matches = m_scan.run<std::string>(
+                buffers.size(),
+                [&buffers, &pred](size_t begin, size_t end,
+                                  std::vector<std::string> &matches) {
+                  for (size_t i = begin; i < end; i++) {
+                    if (pred(UnQLiteJsonDecoder::decode(buffers[i])))
+                      matches.push_back(
+                          UnQLiteJsonDecoder::decodeToString(buffers[i]));
+                  }
+                });
+            std::move(matches.begin(), matches.end(),
+                      std::back_inserter(records));
+          });
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate) override {
+    return filterPredicateJsonProjected(coll_name, predicate, {});
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJsonProjected(const std::string &coll_name,
+                               const JsonWrapper &predicate,
+                               const std::vector<std::string> &fields) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      JsonProjection projection(fields);
+      std::vector<json> records;
+      // the predicate needs the full records, matching ones are
+      // projected in the scanning threads
+      if (!forEachCandidateChunkOrError(
+              coll_name, pred, result,
+              [this, &pred, &projection,
+               &records](std::vector<std::vector<char>> &buffers) {
+                auto matches = m_scan.run<json>(
+                    buffers.size(),
+                    [&buffers, &pred, &projection](
+                        size_t begin, size_t end, std::vector<json> &matches) {
+                      for (size_t i = begin; i < end; i++) {
+                        json record = UnQLiteJsonDecoder::decode(buffers[i]);
+                        if (pred(record)) {
+                          projection.apply(record);
+                          matches.push_back(std::move(record));
+                        }
+                      }
+                    });
+                std::move(matches.begin(), matches.end(),
+                          std::back_inserter(records));
+              }))
+        return result;
+      result.value() = json(std::move(records));
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name,
+            const JsonWrapper &pipeline) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      // records are decoded and aggregated one by one as they are read
+      JsonAggregation aggregation(pipeline.m_object);
+      if (!forEachCandidateOrError(coll_name, aggregation.predicate(), result,
+                                   [&aggregation](std::vector<char> &buffer) {
+                                     aggregation.add(
+                                         UnQLiteJsonDecoder::decode(buffer));
+                                   }))
+        return result;
+      result.value() = aggregation.result();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -776,37 +908,16 @@ public:
                                      uint64_t record_id,
                                      const std::string &new_content,
                                      bool commit) override {
-    const std::string script = "$input = "s + new_content + ";" + R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            $ret = db_update_record($collection,$record_id,$input);
-            if(!$ret) {
-                $err = db_errlog();
-            }
-        }
-        )jx9";
-    RequestResult<bool> result;
+    JsonWrapper json_content;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script.c_str(), this);
-      vm.set("collection", coll_name);
-      vm.set("record_id", record_id);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      }
-      if (commit)
-        unqlite_commit(m_db);
-    } catch (const Exception &e) {
+      json_content = json::parse(new_content);
+    } catch (const json::exception &e) {
+      RequestResult<bool> result;
       result.success() = false;
       result.error() = e.what();
+      return result;
     }
-    return result;
+    return updateJson(coll_name, record_id, json_content, commit);
   }
 
   virtual RequestResult<bool> updateJson(const std::string &coll_name,
@@ -826,20 +937,27 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("input", new_content.m_object);
-      vm.set("collection", coll_name);
-      vm.set("record_id", record_id);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("input", new_content.m_object);
+        vm->set("collection", coll_name);
+        vm->set("record_id", record_id);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          updateIndexes(coll_name, [&](SecondaryIndex &index) {
+            index.insert(record_id, new_content.m_object);
+          });
+        }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -850,56 +968,17 @@ public:
   virtual RequestResult<std::vector<bool>> updateMulti(
       const std::string &coll_name, const std::vector<uint64_t> &record_ids,
       const std::vector<std::string> &new_contents, bool commit) override {
-    std::ostringstream ss;
-    ss << "$input = [";
-    for (unsigned i = 0; i < new_contents.size(); i++) {
-      ss << new_contents[i];
-      if (i != new_contents.size() - 1)
-        ss << ",";
-    }
-    ss << "];"
-       << R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            //while(!db_begin()) {}
-            $ret = true;
-            $result = [];
-            for($i = 0; $i < count($record_ids); $i++) {
-                $ret = db_update_record($collection, $record_ids[$i], $input[$i]);
-                array_push($result, $ret);
-              //  if(!$ret) {
-              //      $err = db_errlog();
-              //      db_rollback();
-              //  }
-            }
-            $ret = true;
-            //if($ret) { db_commit(); }
-        }
-        )jx9";
-    RequestResult<std::vector<bool>> result;
+    JsonWrapper json_contents = json::array();
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, ss.str().c_str(), this);
-      vm.set("collection", coll_name);
-      vm.set("record_ids", record_ids);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<std::vector<bool>>("result");
-      }
-      if (commit)
-        unqlite_commit(m_db);
-    } catch (const Exception &e) {
+      for (auto &c : new_contents)
+        json_contents->push_back(json::parse(c));
+    } catch (const json::exception &e) {
+      RequestResult<std::vector<bool>> result;
       result.success() = false;
       result.error() = e.what();
+      return result;
     }
-    return result;
+    return updateMultiJson(coll_name, record_ids, json_contents, commit);
   }
 
   virtual RequestResult<std::vector<bool>>
@@ -928,22 +1007,30 @@ public:
         )jx9";
     RequestResult<std::vector<bool>> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("input", new_contents.m_object);
-      vm.set("collection", coll_name);
-      vm.set("record_ids", record_ids);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm.get<std::vector<bool>>("result");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("input", new_contents.m_object);
+        vm->set("collection", coll_name);
+        vm->set("record_ids", record_ids);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          result.value() = vm->get<std::vector<bool>>("result");
+          updateIndexes(coll_name, [&](SecondaryIndex &index) {
+            for (size_t i = 0; i < result.value().size(); i++)
+              if (result.value()[i])
+                index.insert(record_ids[i], new_contents.m_object[i]);
+          });
+        }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -953,45 +1040,16 @@ public:
 
   virtual RequestResult<std::vector<std::string>>
   all(const std::string &coll_name) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            if(0 == db_total_records($collection)) {
-                $ret = TRUE;
-                $data = [];
-            } else {
-                $ret = db_fetch_all($collection);
-                if($ret == FALSE) {
-                    $err = db_errlog();
-                } else {
-                    $data = $ret;
-                    $ret = TRUE;
-                }
-            }
-        }
-        )jx9";
     RequestResult<std::vector<std::string>> result;
+    std::vector<std::vector<char>> buffers;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        std::vector<std::string> array;
-        UnQLiteValue uql_values = vm["data"];
-        uql_values.foreach ([&array](unsigned index, const UnQLiteValue &val) {
-          std::ostringstream ss;
-          val.printToStream(ss);
-          array.push_back(ss.str());
-        });
-        result.value() = std::move(array);
+      if (!fetchAllOrError(coll_name, buffers, result))
+        return result;
+      result.value().resize(buffers.size());
+      for (size_t i = 0; i < buffers.size(); i++) {
+        UnQLiteJsonDecoder::decodeToString(buffers[i].data(),
+                                           buffers[i].size(),
+                                           result.value()[i]);
       }
     } catch (const Exception &e) {
       result.success() = false;
@@ -1002,39 +1060,21 @@ public:
 
   virtual RequestResult<JsonWrapper>
   allJson(const std::string &coll_name) override {
-    constexpr static const char *script = R"jx9(
-        if(!db_exists($collection)) {
-            $ret = false;
-            $err = "Collection does not exist";
-        } else {
-            if(0 == db_total_records($collection)) {
-                $ret = TRUE;
-                $data = [];
-            } else {
-                $ret = db_fetch_all($collection);
-                if($ret == FALSE) {
-                    $err = db_errlog();
-                } else {
-                    $data = $ret;
-                    $ret = TRUE;
-                }
-            }
-        }
-        )jx9";
+    return allJsonProjected(coll_name, {});
+  }
+
+  virtual RequestResult<JsonWrapper>
+  allJsonProjected(const std::string &coll_name,
+                   const std::vector<std::string> &fields) override {
     RequestResult<JsonWrapper> result;
+    std::vector<std::vector<char>> buffers;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
-      } else {
-        result.value() = vm["data"].as<json>();
-      }
+      if (!fetchAllOrError(coll_name, buffers, result))
+        return result;
+      JsonProjection projection(fields);
+      result.value() = json::array();
+      for (auto &buffer : buffers)
+        result.value()->push_back(UnQLiteJsonDecoder::decode(buffer, projection));
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -1044,13 +1084,16 @@ public:
 
   virtual RequestResult<uint64_t>
   lastID(const std::string &coll_name) override {
+    if(m_bypass) {
+        return lastIDDirect(coll_name);
+    }
     constexpr static const char *script = R"jx9(
         if(!db_exists($collection)) {
             $ret = false;
             $err = "Collection does not exist";
         } else {
             $id = db_last_record_id($collection);
-            if($id == FALSE) {
+            if($id === FALSE) {
                 $ret = false;
                 $err = db_errlog();
             } else {
@@ -1060,17 +1103,18 @@ public:
         )jx9";
     RequestResult<uint64_t> result;
     try {
+      auto guard = readCollection(coll_name, true);
       std::unique_lock<tl::mutex> lock;
       if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
+      auto vm = m_vm_pool->acquire(script);
+      vm->set("collection", coll_name);
+      vm->execute();
+      result.success() = vm->get<bool>("ret");
       if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+        result.error() = vm->get<std::string>("err");
       } else {
-        result.value() = vm["id"];
+        result.value() = (*vm)["id"];
       }
     } catch (const Exception &e) {
       result.success() = false;
@@ -1079,14 +1123,35 @@ public:
     return result;
   }
 
+  RequestResult<uint64_t> lastIDDirect(const std::string &coll_name) {
+    RequestResult<uint64_t> result;
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if(!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    // same as db_last_record_id, which returns 0 for an empty collection
+    result.value() = last_record_id == 0 ? 0 : last_record_id - 1;
+    return result;
+  }
+
   virtual RequestResult<size_t> size(const std::string &coll_name) override {
+    if(m_bypass) {
+        return sizeDirect(coll_name);
+    }
     constexpr static const char *script = R"jx9(
         if(!db_exists($collection)) {
             $ret = false;
             $err = "Collection does not exist";
         } else {
             $size = db_total_records($collection);
-            if($size == FALSE) {
+            if($size === FALSE) {
                 $ret = false;
                 $err = db_errlog();
             } else {
@@ -1096,17 +1161,18 @@ public:
         )jx9";
     RequestResult<size_t> result;
     try {
+      auto guard = readCollection(coll_name, true);
       std::unique_lock<tl::mutex> lock;
       if (m_mutex_mode == MutexMode::global)
         lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
+      auto vm = m_vm_pool->acquire(script);
+      vm->set("collection", coll_name);
+      vm->execute();
+      result.success() = vm->get<bool>("ret");
       if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+        result.error() = vm->get<std::string>("err");
       } else {
-        result.value() = vm["size"];
+        result.value() = (*vm)["size"];
       }
     } catch (const Exception &e) {
       result.success() = false;
@@ -1115,8 +1181,28 @@ public:
     return result;
   }
 
+  RequestResult<size_t> sizeDirect(const std::string &coll_name) {
+    RequestResult<size_t> result;
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if(!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    result.value() = total_records;
+    return result;
+  }
+
   virtual RequestResult<bool> erase(const std::string &coll_name,
                                     uint64_t record_id, bool commit) override {
+    if(m_bypass) {
+        return eraseDirect(coll_name, record_id, commit);
+    }
     constexpr static const char *script = R"jx9(
         if(!db_exists($collection)) {
             $ret = false;
@@ -1133,19 +1219,26 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("id", record_id);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("collection", coll_name);
+        vm->set("id", record_id);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success()) {
+          result.error() = vm->get<std::string>("err");
+        } else {
+          updateIndexes(coll_name, [&](SecondaryIndex &index) {
+            index.erase(record_id);
+          });
+        }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -1156,16 +1249,20 @@ public:
   virtual RequestResult<bool>
   eraseMulti(const std::string &coll_name,
              const std::vector<uint64_t> &record_ids, bool commit) override {
+    if(m_bypass) {
+        return eraseMultiDirect(coll_name, record_ids, commit);
+    }
     constexpr static const char *script = R"jx9(
         if(!db_exists($collection)) {
             $ret = false;
             $err = "Collection does not exist";
         } else {
             $ret = true;
+            $erased = 0;
             foreach($ids as $id) {
                 $rc = db_drop_record($collection, $id);
                 if($rc) {
-                    $ret = true;
+                    $erased++;
                 } else {
                     $ret = false;
                     $err = "Failed to erase record";
@@ -1176,19 +1273,28 @@ public:
         )jx9";
     RequestResult<bool> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, script, this);
-      vm.set("collection", coll_name);
-      vm.set("ids", record_ids);
-      vm.execute();
-      result.success() = vm.get<bool>("ret");
-      if (!result.success()) {
-        result.error() = vm.get<std::string>("err");
+      {
+        auto guard = writeCollection(coll_name, true);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        auto vm = m_vm_pool->acquire(script);
+        vm->set("collection", coll_name);
+        vm->set("ids", record_ids);
+        vm->execute();
+        result.success() = vm->get<bool>("ret");
+        if (!result.success())
+          result.error() = vm->get<std::string>("err");
+        // only the records erased before a failure leave the indexes
+        auto erased = result.success() ? record_ids.size()
+                                       : vm->get<uint64_t>("erased");
+        updateIndexes(coll_name, [&](SecondaryIndex &index) {
+          for (size_t i = 0; i < erased; i++)
+            index.erase(record_ids[i]);
+        });
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -1196,30 +1302,87 @@ public:
     return result;
   }
 
+  RequestResult<bool> eraseDirect(const std::string &coll_name,
+                                  uint64_t record_id, bool commit) {
+    return eraseMultiDirect(coll_name, {record_id}, commit);
+  }
+
+  RequestResult<bool> eraseMultiDirect(const std::string &coll_name,
+                                       const std::vector<uint64_t> &record_ids,
+                                       bool commit) {
+    RequestResult<bool> result;
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = writeCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if(!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    uint64_t erased = 0;
+    for(auto id : record_ids) {
+      std::string key = coll_name + "_" + std::to_string(id);
+      int rc = unqlite_kv_delete(m_db, key.c_str(), key.size());
+      if(rc != UNQLITE_OK) {
+        result.success() = false;
+        result.error() = "Failed to erase record";
+        break;
+      }
+      erased += 1;
+    }
+    if(erased != 0) {
+      // update the total number of records in the header
+      total_records -= erased;
+      if(Endian::little) total_records = Endian::swap(total_records);
+      std::memcpy(header.data()+10, &total_records, 8);
+      unqlite_kv_store(m_db, coll_name.c_str(), coll_name.size(),
+                       header.data(), header.size());
+      updateIndexes(coll_name, [&](SecondaryIndex &index) {
+        for (size_t i = 0; i < erased; i++)
+          index.erase(record_ids[i]);
+      });
+    }
+    if (commit) {
+      if (lock)
+        lock.unlock();
+      guard.unlock();
+      commitDatabase();
+    }
+    return result;
+  }
+
   virtual RequestResult<std::unordered_map<std::string, std::string>>
   execute(const std::string &code, const std::unordered_set<std::string> &vars,
           bool commit) override {
     RequestResult<std::unordered_map<std::string, std::string>> result;
     try {
-      std::unique_lock<tl::mutex> lock;
-      if (m_mutex_mode == MutexMode::global)
-        lock = std::unique_lock<tl::mutex>(m_mutex);
-      UnQLiteVM vm(m_db, code.c_str(), this);
-      vm.registerSonataFunctions();
-      vm.execute();
-      result.success() = true;
-      for (auto &name : vars) {
-        if (name != "__output__") {
-          auto val = vm[name];
-          std::ostringstream ss;
-          val.printToStream(ss);
-          result.value().emplace(name, ss.str());
-        } else {
-          result.value().emplace("__output__", vm.output());
+      {
+        auto guard = lockDatabase();
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        UnQLiteVM vm(m_db, code.c_str(), this);
+        vm.registerSonataFunctions();
+        vm.execute();
+        // the code may have modified any collection
+        invalidateIndexes();
+        result.success() = true;
+        for (auto &name : vars) {
+          if (name != "__output__") {
+            auto val = vm[name];
+            std::ostringstream ss;
+            val.printToStream(ss);
+            result.value().emplace(name, ss.str());
+          } else {
+            result.value().emplace("__output__", vm.output());
+          }
         }
       }
       if (commit)
-        unqlite_commit(m_db);
+        commitDatabase();
     } catch (const Exception &e) {
       result.success() = false;
       result.error() = e.what();
@@ -1228,8 +1391,110 @@ public:
     return result;
   }
 
+  virtual RequestResult<bool> createIndex(const std::string &coll_name,
+                                          const std::string &field) override {
+    RequestResult<bool> result;
+    try {
+      {
+        auto guard = writeCollection(coll_name);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        if (!collectionExistsDirect(coll_name)) {
+          result.success() = false;
+          result.error() = "Collection does not exist";
+          return result;
+        }
+        std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+        auto &indexes = loadIndexes(coll_name);
+        if (indexes.m_by_field.count(field)) {
+          result.success() = false;
+          result.error() = "Index already exists";
+          return result;
+        }
+        auto &index = indexes.m_by_field
+                          .emplace(field, SecondaryIndex(m_index_kv,
+                                                         indexPrefix(coll_name, field),
+                                                         field))
+                          .first->second;
+        rebuildIndex(coll_name, index);
+        storeIndexList(coll_name, indexes);
+      }
+      commitDatabase();
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<bool> dropIndex(const std::string &coll_name,
+                                        const std::string &field) override {
+    RequestResult<bool> result;
+    try {
+      {
+        auto guard = writeCollection(coll_name);
+        std::unique_lock<tl::mutex> lock;
+        if (m_mutex_mode == MutexMode::global)
+          lock = std::unique_lock<tl::mutex>(m_mutex);
+        if (!collectionExistsDirect(coll_name)) {
+          result.success() = false;
+          result.error() = "Collection does not exist";
+          return result;
+        }
+        std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+        auto &indexes = loadIndexes(coll_name);
+        auto it = indexes.m_by_field.find(field);
+        if (it == indexes.m_by_field.end()) {
+          result.success() = false;
+          result.error() = "Index does not exist";
+          return result;
+        }
+        it->second.clear();
+        indexes.m_by_field.erase(it);
+        storeIndexList(coll_name, indexes);
+      }
+      commitDatabase();
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
+  virtual RequestResult<std::vector<uint64_t>>
+  queryIndex(const std::string &coll_name, const std::string &field,
+             const JsonWrapper &lower, const JsonWrapper &upper) override {
+    RequestResult<std::vector<uint64_t>> result;
+    try {
+      auto guard = readCollection(coll_name);
+      std::unique_lock<tl::mutex> lock;
+      if (m_mutex_mode == MutexMode::global)
+        lock = std::unique_lock<tl::mutex>(m_mutex);
+      if (!collectionExistsDirect(coll_name)) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+      auto &indexes = loadIndexes(coll_name);
+      auto it = indexes.m_by_field.find(field);
+      if (it == indexes.m_by_field.end()) {
+        result.success() = false;
+        result.error() = "No index on field "s + field;
+        return result;
+      }
+      result.value() = it->second.query(lower.m_object, upper.m_object);
+    } catch (const Exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
   virtual RequestResult<bool> destroy() override {
     RequestResult<bool> result;
+    m_vm_pool.reset();
     if (m_db)
       unqlite_close(m_db);
     m_db = nullptr;
@@ -1241,12 +1506,652 @@ public:
   }
 
   std::string getConfig() const override {
+    std::lock_guard<tl::mutex> lock(m_group_commit_mtx);
     return "{\"path\": \""s + m_filename + "\"" +
            ", \"temporary\": " + (m_is_temporary ? "true" : "false") +
-           ", \"in-memory\": " + (m_is_in_memory ? "true" : "false") + "}";
+           ", \"in-memory\": " + (m_is_in_memory ? "true" : "false") +
+           ", \"stats\": {\"commit_requests\": " +
+           std::to_string(m_group_commit_requests) +
+           ", \"commits\": " + std::to_string(m_group_commit_count) + "}}";
   }
 
 private:
+  static int appendToBuffer(const void *data, unsigned int size,
+                            void *uargs) {
+    auto buffer = static_cast<std::vector<char> *>(uargs);
+    auto ptr = static_cast<const char *>(data);
+    buffer->insert(buffer->end(), ptr, ptr + size);
+    return UNQLITE_OK;
+  }
+
+  // Checks that a collection exists by looking up its header
+  bool collectionExistsDirect(const std::string &coll_name) {
+    unqlite_int64 size = 0;
+    return unqlite_kv_fetch(m_db, coll_name.c_str(), coll_name.size(),
+                            nullptr, &size) == UNQLITE_OK;
+  }
+
+  // Reads the 24-byte header of a collection, returning false if the
+  // collection does not exist. The last record id and the total number of
+  // records are returned in host byte order.
+  bool fetchHeaderDirect(const std::string &coll_name,
+                         std::vector<char> &header, uint64_t &last_record_id,
+                         uint64_t &total_records) {
+    header.resize(24);
+    unqlite_int64 header_size = 24;
+    int rc = unqlite_kv_fetch(m_db, coll_name.c_str(), coll_name.size(),
+                              header.data(), &header_size);
+    if (rc != UNQLITE_OK)
+      return false;
+    std::memcpy(&last_record_id, header.data()+2, 8);
+    std::memcpy(&total_records, header.data()+10, 8);
+    if(Endian::little) {
+      last_record_id = Endian::swap(last_record_id);
+      total_records = Endian::swap(total_records);
+    }
+    return true;
+  }
+
+  // Writes the header of a collection (as read by fetchHeaderDirect) with
+  // the provided last record id and total number of records.
+  void storeHeaderDirect(const std::string &coll_name,
+                         std::vector<char> &header, uint64_t last_record_id,
+                         uint64_t total_records) {
+    if(Endian::little) {
+      last_record_id = Endian::swap(last_record_id);
+      total_records = Endian::swap(total_records);
+    }
+    std::memcpy(header.data()+2, &last_record_id, 8);
+    std::memcpy(header.data()+10, &total_records, 8);
+    unqlite_kv_store(m_db, coll_name.c_str(), coll_name.size(),
+                     header.data(), header.size());
+  }
+
+  // Reads the binary content of a record, returning false if the
+  // record does not exist
+  bool fetchRecordDirect(const std::string &coll_name, uint64_t record_id,
+                         std::vector<char> &buffer) {
+    std::string key = coll_name + "_" + std::to_string(record_id);
+    buffer.clear();
+    int rc = unqlite_kv_fetch_callback(m_db, key.c_str(), key.size(),
+                                       appendToBuffer, &buffer);
+    return rc == UNQLITE_OK;
+  }
+
+  // Reads the binary content of a record under the global lock (if any).
+  // If the record cannot be found, sets the error in the result and
+  // returns false.
+  template <typename T>
+  bool fetchRecordOrError(const std::string &coll_name, uint64_t record_id,
+                          std::vector<char> &buffer,
+                          RequestResult<T> &result) {
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if (fetchRecordDirect(coll_name, record_id, buffer))
+      return true;
+    result.success() = false;
+    if (collectionExistsDirect(coll_name))
+      result.error() = "Record does not exist";
+    else
+      result.error() = "Collection does not exist";
+    return false;
+  }
+
+  // Reads the binary content of a list of records under the global lock
+  // (if any). found[i] is set to false for records that do not exist.
+  // If the collection does not exist, sets the error in the result and
+  // returns false.
+  template <typename T>
+  bool fetchRecordsOrError(const std::string &coll_name,
+                           const std::vector<uint64_t> &record_ids,
+                           std::vector<std::vector<char>> &buffers,
+                           std::vector<bool> &found,
+                           RequestResult<T> &result) {
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if (!collectionExistsDirect(coll_name)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return false;
+    }
+    buffers.resize(record_ids.size());
+    found.resize(record_ids.size());
+    for (size_t i = 0; i < record_ids.size(); i++)
+      found[i] = fetchRecordDirect(coll_name, record_ids[i], buffers[i]);
+    return true;
+  }
+
+  // Reads the binary content of all the records of a collection, in
+  // increasing order of ids, under the global lock (if any).
+  // If the collection does not exist, sets the error in the result and
+  // returns false.
+  template <typename T>
+  bool fetchAllOrError(const std::string &coll_name,
+                       std::vector<std::vector<char>> &buffers,
+                       RequestResult<T> &result) {
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if (!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return false;
+    }
+    buffers.reserve(total_records);
+    std::vector<char> buffer;
+    for (uint64_t id = 0;
+         id < last_record_id && buffers.size() < total_records; id++) {
+      if (fetchRecordDirect(coll_name, id, buffer))
+        buffers.push_back(std::move(buffer));
+    }
+    return true;
+  }
+
+  // Calls f(buffers) on chunks of the binary content of the records that
+  // may match a predicate, in increasing order of ids (see
+  // forEachCandidateOrError). Each chunk holds at most m_scan.chunkSize()
+  // records, read under the locks, which are released while f processes
+  // the chunk, so that a scan holds one chunk in memory at a time and does
+  // not block other operations while evaluating it.
+  // If the collection does not exist, sets the error in the result and
+  // returns false.
+  template <typename T, typename F>
+  bool forEachCandidateChunkOrError(const std::string &coll_name,
+                                    const JsonPredicate &predicate,
+                                    RequestResult<T> &result, F &&f) {
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if (!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return false;
+    }
+    std::vector<uint64_t> ids;
+    bool use_index = indexedCandidates(coll_name, predicate, ids);
+    const size_t chunk_size = m_scan.chunkSize();
+    std::vector<std::vector<char>> buffers;
+    size_t next = 0;    // next position in ids, or next id to read
+    uint64_t count = 0; // records found by a full scan
+    while (true) {
+      buffers.clear();
+      bool done;
+      if (use_index) {
+        for (; next < ids.size() && buffers.size() < chunk_size; next++) {
+          buffers.emplace_back();
+          if (!fetchRecordDirect(coll_name, ids[next], buffers.back()))
+            buffers.pop_back();
+        }
+        done = next == ids.size();
+      } else {
+        for (; next < last_record_id && count < total_records &&
+               buffers.size() < chunk_size;
+             next++) {
+          buffers.emplace_back();
+          if (fetchRecordDirect(coll_name, next, buffers.back()))
+            count += 1;
+          else
+            buffers.pop_back();
+        }
+        done = next == last_record_id || count == total_records;
+      }
+      if (lock)
+        lock.unlock();
+      guard.unlock();
+      if (!buffers.empty())
+        f(buffers);
+      if (done)
+        return true;
+      guard = readCollection(coll_name);
+      if (m_mutex_mode == MutexMode::global)
+        lock = std::unique_lock<tl::mutex>(m_mutex);
+    }
+  }
+
+  // If a predicate constrains an indexed field of a collection, sets ids
+  // to the ids found in the corresponding index range and returns true.
+  // Must be called with the collection locked.
+  bool indexedCandidates(const std::string &coll_name,
+                         const JsonPredicate &predicate,
+                         std::vector<uint64_t> &ids) {
+    std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+    auto &indexes = loadIndexes(coll_name);
+    std::string field;
+    json lower, upper;
+    bool use_index = predicate.indexRange(
+        [&indexes](const std::string &f) {
+          return indexes.m_by_field.count(f) != 0;
+        },
+        field, lower, upper);
+    if (use_index)
+      ids = indexes.m_by_field.at(field).query(lower, upper);
+    return use_index;
+  }
+
+  // Calls f(buffer) with the binary content of each record that may match
+  // a predicate, in increasing order of ids, under the global lock (if any).
+  // If the predicate constrains an indexed field, only the records found in
+  // the corresponding index range are read, otherwise all the records are.
+  // If the collection does not exist, sets the error in the result and
+  // returns false.
+  template <typename T, typename F>
+  bool forEachCandidateOrError(const std::string &coll_name,
+                               const JsonPredicate &predicate,
+                               RequestResult<T> &result, F &&f) {
+    std::vector<char> header;
+    uint64_t last_record_id, total_records;
+    auto guard = readCollection(coll_name);
+    std::unique_lock<tl::mutex> lock;
+    if (m_mutex_mode == MutexMode::global)
+      lock = std::unique_lock<tl::mutex>(m_mutex);
+    if (!fetchHeaderDirect(coll_name, header, last_record_id, total_records)) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return false;
+    }
+    std::vector<uint64_t> ids;
+    bool use_index = indexedCandidates(coll_name, predicate, ids);
+    std::vector<char> buffer;
+    if (use_index) {
+      for (auto id : ids) {
+        if (fetchRecordDirect(coll_name, id, buffer))
+          f(buffer);
+      }
+      return true;
+    }
+    uint64_t count = 0;
+    for (uint64_t id = 0; id < last_record_id && count < total_records;
+         id++) {
+      if (fetchRecordDirect(coll_name, id, buffer)) {
+        f(buffer);
+        count += 1;
+      }
+    }
+    return true;
+  }
+
+  // Secondary indexes are stored in the database, next to the records
+  // (see SecondaryIndex), and updated in the same transactions as them.
+  // The list of indexed fields of a collection is stored under
+  // indexListKey(coll_name), along with the index generation at which the
+  // indexes were built. execute() increments the generation, since
+  // arbitrary Jx9 code may have modified the collections, so that indexes
+  // are rebuilt from the content of their collection the first time they
+  // are needed afterwards.
+  // m_indexes_mtx protects m_indexes and is acquired after m_mutex.
+  struct CollectionIndexes {
+    bool m_loaded = false;
+    std::map<std::string, SecondaryIndex> m_by_field;
+  };
+
+  class IndexKVStorage : public IndexStorage {
+
+  public:
+    explicit IndexKVStorage(unqlite *&db) : m_db(db) {}
+
+    bool fetch(const std::string &key, std::vector<char> &value) override {
+      value.clear();
+      return unqlite_kv_fetch_callback(m_db, key.c_str(), key.size(),
+                                       appendToBuffer, &value) == UNQLITE_OK;
+    }
+
+    void store(const std::string &key, const std::string &value) override {
+      unqlite_kv_store(m_db, key.c_str(), key.size(), value.data(),
+                       value.size());
+    }
+
+    void erase(const std::string &key) override {
+      unqlite_kv_delete(m_db, key.c_str(), key.size());
+    }
+
+  private:
+    unqlite *&m_db;
+  };
+
+  static std::string indexListKey(const std::string &coll_name) {
+    return "__sonata_indexes__"s + coll_name;
+  }
+
+  // Ids handed out by reserveIds and not used by storeReserved yet are
+  // stored under reservedIdsKey(coll_name) (see ReservedIds), so that
+  // they are committed along with the records and the header.
+  static std::string reservedIdsKey(const std::string &coll_name) {
+    return "__sonata_reserved__"s + coll_name;
+  }
+
+  ReservedIds fetchReservedIds(const std::string &coll_name) {
+    std::vector<char> buffer;
+    auto key = reservedIdsKey(coll_name);
+    if (unqlite_kv_fetch_callback(m_db, key.c_str(), key.size(),
+                                  appendToBuffer, &buffer) != UNQLITE_OK)
+      return ReservedIds();
+    return ReservedIds(json::parse(buffer.begin(), buffer.end()));
+  }
+
+  void storeReservedIds(const std::string &coll_name,
+                        const ReservedIds &reserved) {
+    auto key = reservedIdsKey(coll_name);
+    if (reserved.empty()) {
+      unqlite_kv_delete(m_db, key.c_str(), key.size());
+      return;
+    }
+    auto value = reserved.toJson().dump();
+    unqlite_kv_store(m_db, key.c_str(), key.size(), value.data(),
+                     value.size());
+  }
+
+  static std::string indexPrefix(const std::string &coll_name,
+                                 const std::string &field) {
+    return "__sonata_index__"s + coll_name + "\n" + field + "\n";
+  }
+
+  // Calls f(id, record) on each record of the collection.
+  template <typename F>
+  void forEachRecordDirect(const std::string &coll_name, F &&f) {
+    std::vector<char> header, buffer;
+    uint64_t last_record_id, total_records;
+    if (!fetchHeaderDirect(coll_name, header, last_record_id, total_records))
+      return;
+    uint64_t count = 0;
+    for (uint64_t id = 0; id < last_record_id && count < total_records;
+         id++) {
+      if (!fetchRecordDirect(coll_name, id, buffer))
+        continue;
+      f(id, UnQLiteJsonDecoder::decode(buffer));
+      count += 1;
+    }
+  }
+
+  // Rebuilds an index from the content of its collection.
+  void rebuildIndex(const std::string &coll_name, SecondaryIndex &index) {
+    index.rebuild(
+        [this, &coll_name](auto &&f) { forEachRecordDirect(coll_name, f); });
+  }
+
+  // Returns the current index generation.
+  // Must be called with m_indexes_mtx held.
+  uint64_t indexGeneration() {
+    if (m_index_generation_loaded)
+      return m_index_generation;
+    std::vector<char> buffer;
+    static const std::string key = "__sonata_index_generation__";
+    if (m_index_kv.fetch(key, buffer))
+      m_index_generation = json::parse(buffer.begin(), buffer.end());
+    m_index_generation_loaded = true;
+    return m_index_generation;
+  }
+
+  // Returns the indexes of a collection, loading them if needed and
+  // rebuilding them if they are out of date.
+  // Must be called with m_indexes_mtx held.
+  CollectionIndexes &loadIndexes(const std::string &coll_name) {
+    auto &indexes = m_indexes[coll_name];
+    if (indexes.m_loaded)
+      return indexes;
+    indexes.m_by_field.clear();
+    std::vector<char> buffer;
+    if (m_index_kv.fetch(indexListKey(coll_name), buffer)) {
+      auto list = json::parse(buffer.begin(), buffer.end());
+      // lists stored as an array of fields predate stored indexes
+      bool up_to_date = list.is_object() &&
+                        list["generation"].get<uint64_t>() == indexGeneration();
+      auto &fields = list.is_object() ? list["fields"] : list;
+      for (auto &field : fields) {
+        auto name = field.get<std::string>();
+        auto &index = indexes.m_by_field
+                          .emplace(name, SecondaryIndex(m_index_kv,
+                                                        indexPrefix(coll_name, name),
+                                                        name))
+                          .first->second;
+        if (!up_to_date || !index.load())
+          rebuildIndex(coll_name, index);
+      }
+      if (!up_to_date)
+        storeIndexList(coll_name, indexes);
+    }
+    indexes.m_loaded = true;
+    return indexes;
+  }
+
+  // Stores the list of indexed fields of a collection.
+  // Must be called with m_indexes_mtx held.
+  void storeIndexList(const std::string &coll_name,
+                      const CollectionIndexes &indexes) {
+    auto key = indexListKey(coll_name);
+    if (indexes.m_by_field.empty()) {
+      m_index_kv.erase(key);
+      return;
+    }
+    auto fields = json::array();
+    for (auto &p : indexes.m_by_field)
+      fields.push_back(p.first);
+    json list = {{"fields", std::move(fields)},
+                 {"generation", indexGeneration()}};
+    m_index_kv.store(key, list.dump());
+  }
+
+  // Calls f on each index of the collection, after records have
+  // been stored, updated or erased.
+  template <typename F>
+  void updateIndexes(const std::string &coll_name, F &&f) {
+    std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+    auto &indexes = loadIndexes(coll_name);
+    for (auto &p : indexes.m_by_field)
+      f(p.second);
+  }
+
+  // Removes all the indexes of a collection that has been dropped.
+  void dropIndexes(const std::string &coll_name) {
+    std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+    auto &indexes = loadIndexes(coll_name);
+    for (auto &p : indexes.m_by_field)
+      p.second.clear();
+    m_index_kv.erase(indexListKey(coll_name));
+    m_indexes.erase(coll_name);
+  }
+
+  // Forces all the indexes to be rebuilt next time they are needed.
+  void invalidateIndexes() {
+    std::lock_guard<tl::mutex> indexes_lock(m_indexes_mtx);
+    m_index_generation = indexGeneration() + 1;
+    m_index_kv.store("__sonata_index_generation__",
+                     std::to_string(m_index_generation));
+    for (auto &p : m_indexes)
+      p.second.m_loaded = false;
+  }
+
+  // When mutex_mode is "global", m_mutex serializes all the calls into
+  // the UnQLite engine, which is then not thread-safe (even lookups
+  // modify its page cache), and no other lock is needed.
+  // When mutex_mode is "posix" or "abt", the engine serializes each of
+  // its key/value calls, but not the execution of Jx9 VMs (which only
+  // lock the VM itself), and an operation is usually made of several
+  // calls (e.g. reading a collection's header, then writing a record and
+  // the header back), so the following locks are used:
+  // - a reader/writer lock per collection is held for the duration of an
+  //   operation on that collection, shared by readers and exclusive for
+  //   writers, so that operations on distinct collections and concurrent
+  //   reads of the same collection can interleave;
+  // - m_commit_lock is held shared by writers and exclusively around
+  //   unqlite_commit, so that a commit never persists a partial write;
+  // - m_engine_lock is held shared by operations that call the engine
+  //   directly, and exclusively by operations that run a Jx9 VM and
+  //   around unqlite_commit.
+  // Locks are always acquired in this order: m_commit_lock, collection
+  // lock, m_engine_lock, m_mutex.
+  class RWLockGuard {
+
+  public:
+    RWLockGuard() = default;
+
+    RWLockGuard(tl::rwlock &lock, bool exclusive) : m_lock(&lock) {
+      if (exclusive)
+        m_lock->wrlock();
+      else
+        m_lock->rdlock();
+    }
+
+    RWLockGuard(RWLockGuard &&other) : m_lock(other.m_lock) {
+      other.m_lock = nullptr;
+    }
+
+    RWLockGuard(const RWLockGuard &) = delete;
+    RWLockGuard &operator=(const RWLockGuard &) = delete;
+
+    RWLockGuard &operator=(RWLockGuard &&other) {
+      unlock();
+      m_lock = other.m_lock;
+      other.m_lock = nullptr;
+      return *this;
+    }
+
+    ~RWLockGuard() { unlock(); }
+
+    void unlock() {
+      if (m_lock)
+        m_lock->unlock();
+      m_lock = nullptr;
+    }
+
+  private:
+    tl::rwlock *m_lock = nullptr;
+  };
+
+  struct CollectionGuard {
+    RWLockGuard m_commit_guard;
+    RWLockGuard m_collection_guard;
+    RWLockGuard m_engine_guard;
+
+    void unlock() {
+      m_engine_guard.unlock();
+      m_collection_guard.unlock();
+      m_commit_guard.unlock();
+    }
+  };
+
+  bool lockCollections() const {
+    return m_mutex_mode == MutexMode::posix || m_mutex_mode == MutexMode::abt;
+  }
+
+  tl::rwlock &collectionLock(const std::string &coll_name) {
+    std::lock_guard<tl::mutex> lock(m_coll_locks_mutex);
+    auto &coll_lock = m_coll_locks[coll_name];
+    if (!coll_lock)
+      coll_lock = std::make_unique<tl::rwlock>();
+    return *coll_lock;
+  }
+
+  // Locks a collection for an operation that only reads it.
+  // vm indicates whether the operation runs a Jx9 VM.
+  CollectionGuard readCollection(const std::string &coll_name,
+                                 bool vm = false) {
+    CollectionGuard guard;
+    if (lockCollections()) {
+      guard.m_collection_guard = RWLockGuard(collectionLock(coll_name), false);
+      guard.m_engine_guard = RWLockGuard(m_engine_lock, vm);
+    }
+    return guard;
+  }
+
+  // Locks a collection for an operation that modifies it.
+  // vm indicates whether the operation runs a Jx9 VM.
+  CollectionGuard writeCollection(const std::string &coll_name,
+                                  bool vm = false) {
+    CollectionGuard guard;
+    if (lockCollections()) {
+      guard.m_commit_guard = RWLockGuard(m_commit_lock, false);
+      guard.m_collection_guard = RWLockGuard(collectionLock(coll_name), true);
+      guard.m_engine_guard = RWLockGuard(m_engine_lock, vm);
+    }
+    return guard;
+  }
+
+  // Locks the whole database, for operations that run arbitrary Jx9
+  // code, which may read or modify any collection.
+  CollectionGuard lockDatabase() {
+    CollectionGuard guard;
+    if (lockCollections()) {
+      guard.m_commit_guard = RWLockGuard(m_commit_lock, true);
+      guard.m_engine_guard = RWLockGuard(m_engine_lock, true);
+    }
+    return guard;
+  }
+
+  // Commits the database. Must not be called while holding any of
+  // the locks above.
+  // Concurrent callers are grouped into batches sharing a single
+  // unqlite_commit. The first caller of a batch (its leader) waits for up
+  // to m_group_commit_window_ms milliseconds, or until
+  // m_group_commit_max_size callers have joined, then for any commit in
+  // progress to complete, and finally closes the batch and commits on
+  // behalf of all of its members. Hence even with a window of 0, callers
+  // arriving while a commit is in progress wait for it and then share a
+  // single follow-up commit. Each caller returns only once a commit that
+  // started after its request has completed.
+  void commitDatabase() {
+    std::unique_lock<tl::mutex> lock(m_group_commit_mtx);
+    uint64_t batch = m_group_commit_open_batch;
+    m_group_commit_pending += 1;
+    m_group_commit_requests += 1;
+    if (m_group_commit_pending > 1) {
+      if (m_group_commit_max_size != 0 &&
+          m_group_commit_pending >= m_group_commit_max_size)
+        m_group_commit_leader_cv.notify_one();
+      m_group_commit_done_cv.wait(lock, [this, batch]() {
+        return m_group_commit_durable_batch >= batch;
+      });
+      return;
+    }
+    if (m_group_commit_window_ms != 0) {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += m_group_commit_window_ms / 1000;
+      deadline.tv_nsec += (m_group_commit_window_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+      }
+      while (m_group_commit_max_size == 0 ||
+             m_group_commit_pending < m_group_commit_max_size) {
+        if (!m_group_commit_leader_cv.wait_until(lock, &deadline))
+          break;
+      }
+    }
+    m_group_commit_done_cv.wait(
+        lock, [this]() { return !m_group_commit_in_progress; });
+    m_group_commit_open_batch += 1;
+    m_group_commit_pending = 0;
+    m_group_commit_in_progress = true;
+    m_group_commit_count += 1;
+    lock.unlock();
+    {
+      RWLockGuard commit_guard;
+      RWLockGuard engine_guard;
+      std::unique_lock<tl::mutex> db_lock;
+      if (lockCollections()) {
+        commit_guard = RWLockGuard(m_commit_lock, true);
+        engine_guard = RWLockGuard(m_engine_lock, true);
+      }
+      if (m_mutex_mode == MutexMode::global)
+        db_lock = std::unique_lock<tl::mutex>(m_mutex);
+      unqlite_commit(m_db);
+    }
+    lock.lock();
+    m_group_commit_in_progress = false;
+    m_group_commit_durable_batch = batch;
+    m_group_commit_done_cv.notify_all();
+  }
+
   unqlite *m_db = nullptr;
   std::string m_filename;
   bool m_is_temporary;
@@ -1254,6 +2159,30 @@ private:
   bool m_bypass;
   MutexMode m_mutex_mode = MutexMode::global;
   tl::mutex m_mutex; // used only if mutex_mode is "global"
+  // used only if mutex_mode is "posix" or "abt"
+  tl::rwlock m_commit_lock;
+  tl::rwlock m_engine_lock;
+  tl::mutex m_coll_locks_mutex;
+  std::unordered_map<std::string, std::unique_ptr<tl::rwlock>> m_coll_locks;
+  tl::mutex m_indexes_mtx;
+  std::unordered_map<std::string, CollectionIndexes> m_indexes;
+  IndexKVStorage m_index_kv{m_db};
+  uint64_t m_index_generation = 0;
+  bool m_index_generation_loaded = false;
+  // group commit (see commitDatabase)
+  uint64_t m_group_commit_window_ms = 0;
+  size_t m_group_commit_max_size = 0;
+  mutable tl::mutex m_group_commit_mtx;
+  tl::condition_variable m_group_commit_leader_cv;
+  tl::condition_variable m_group_commit_done_cv;
+  uint64_t m_group_commit_open_batch = 1;
+  uint64_t m_group_commit_durable_batch = 0;
+  size_t m_group_commit_pending = 0;
+  bool m_group_commit_in_progress = false;
+  uint64_t m_group_commit_requests = 0; // calls to commitDatabase
+  uint64_t m_group_commit_count = 0;    // calls to unqlite_commit
+  std::unique_ptr<UnQLiteVMPool> m_vm_pool; // compiled VMs for fixed scripts
+  ParallelScan m_scan; // evaluates predicates in filterPredicate(Json)
 
   Client m_client;
   Admin m_admin;
@@ -0,0 +1,358 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_UNQLITE_JSON_DECODE_HPP
+#define __SONATA_UNQLITE_JSON_DECODE_HPP
+
+#include <sonata/Exception.hpp>
+#include <nlohmann/json.hpp>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Endian.hpp"
+#include "JsonProjection.hpp"
+
+namespace sonata {
+
+using nlohmann::json;
+
+/**
+ * @brief Decodes records stored by UnQLite (in its binary "FastJson"
+ * format, see UnQLiteJsonEncoder) without going through a Jx9 VM,
+ * either into a json object or directly into JSON text. When decoding
+ * into a json object, a JsonProjection can be provided, in which case
+ * the fields that it does not request are skipped without being decoded.
+ */
+class UnQLiteJsonDecoder {
+
+    template<typename T>
+    static T read_number(const char*& ptr, const char* end) {
+        T val;
+        if(end - ptr < (ptrdiff_t)sizeof(val))
+            throw Exception("Corrupted UnQLite record");
+        std::memcpy(&val, ptr, sizeof(val));
+        ptr += sizeof(val);
+        if(Endian::little) val = Endian::swap(val);
+        return val;
+    }
+
+    static void skip_commas(const char*& ptr, const char* end) {
+        while(ptr < end && *ptr == 6) ptr += 1;
+    }
+
+    static const char* do_decode(const char* ptr, const char* end, json& obj) {
+        if(ptr >= end)
+            throw Exception("Corrupted UnQLite record");
+        char type = *ptr;
+        ptr += 1;
+        switch(type) {
+        case 23:
+            obj = nullptr;
+            break;
+        case 24:
+            obj = true;
+            break;
+        case 25:
+            obj = false;
+            break;
+        case 10:
+            obj = read_number<int64_t>(ptr, end);
+            break;
+        case 18:
+            {
+                uint16_t len = read_number<uint16_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                obj = std::strtod(std::string(ptr, len).c_str(), nullptr);
+                ptr += len;
+            }
+            break;
+        case 8:
+            {
+                uint32_t len = read_number<uint32_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                obj = std::string(ptr, len);
+                ptr += len;
+            }
+            break;
+        case 3:
+            obj = json::array();
+            while(true) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 4) break;
+                json elem;
+                ptr = do_decode(ptr, end, elem);
+                obj.push_back(std::move(elem));
+            }
+            if(ptr < end) ptr += 1;
+            break;
+        case 1:
+            obj = json::object();
+            while(true) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 2) break;
+                json key;
+                ptr = do_decode(ptr, end, key);
+                if(ptr >= end || *ptr != 5)
+                    throw Exception("Corrupted UnQLite record");
+                ptr += 1;
+                json val;
+                ptr = do_decode(ptr, end, val);
+                // Jx9 may store numeric keys as integers
+                if(key.is_string())
+                    obj[key.get_ref<const std::string&>()] = std::move(val);
+                else
+                    obj[key.dump()] = std::move(val);
+            }
+            if(ptr < end) ptr += 1;
+            break;
+        default:
+            throw Exception("Corrupted UnQLite record");
+        }
+        return ptr;
+    }
+
+    static const char* skip(const char* ptr, const char* end) {
+        if(ptr >= end)
+            throw Exception("Corrupted UnQLite record");
+        char type = *ptr;
+        ptr += 1;
+        switch(type) {
+        case 23:
+        case 24:
+        case 25:
+            break;
+        case 10:
+            read_number<int64_t>(ptr, end);
+            break;
+        case 18:
+            {
+                uint16_t len = read_number<uint16_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                ptr += len;
+            }
+            break;
+        case 8:
+            {
+                uint32_t len = read_number<uint32_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                ptr += len;
+            }
+            break;
+        case 3:
+            while(true) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 4) break;
+                ptr = skip(ptr, end);
+            }
+            if(ptr < end) ptr += 1;
+            break;
+        case 1:
+            while(true) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 2) break;
+                ptr = skip(ptr, end);
+                if(ptr >= end || *ptr != 5)
+                    throw Exception("Corrupted UnQLite record");
+                ptr += 1;
+                ptr = skip(ptr, end);
+            }
+            if(ptr < end) ptr += 1;
+            break;
+        default:
+            throw Exception("Corrupted UnQLite record");
+        }
+        return ptr;
+    }
+
+    // Decodes the fields of an object (ptr pointing after its opening
+    // marker) that are requested at the given node of the projection.
+    static const char* do_decode(const char* ptr, const char* end, json& obj,
+                                 const JsonProjection& projection, size_t node) {
+        obj = json::object();
+        while(true) {
+            skip_commas(ptr, end);
+            if(ptr >= end || *ptr == 2) break;
+            json key;
+            ptr = do_decode(ptr, end, key);
+            if(ptr >= end || *ptr != 5)
+                throw Exception("Corrupted UnQLite record");
+            ptr += 1;
+            // Jx9 may store numeric keys as integers
+            std::string name = key.is_string() ? key.get<std::string>() : key.dump();
+            size_t child;
+            auto match = projection.match(node, name, child);
+            if(match == JsonProjection::Match::whole
+            || (node == JsonProjection::root && name == "__id")) {
+                ptr = do_decode(ptr, end, obj[name]);
+            } else if(match == JsonProjection::Match::partial && ptr < end && *ptr == 1) {
+                json sub;
+                ptr = do_decode(ptr + 1, end, sub, projection, child);
+                if(!sub.empty())
+                    obj[name] = std::move(sub);
+            } else {
+                ptr = skip(ptr, end);
+            }
+        }
+        if(ptr < end) ptr += 1;
+        return ptr;
+    }
+
+    static void append_string(std::string& out, const char* str, size_t len) {
+        static const char* hex = "0123456789abcdef";
+        out.push_back('"');
+        for(size_t i = 0; i < len; i++) {
+            char c = str[i];
+            switch(c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if((unsigned char)c < 0x20) {
+                    out += "\\u00";
+                    out.push_back(hex[(c >> 4) & 0xf]);
+                    out.push_back(hex[c & 0xf]);
+                } else {
+                    out.push_back(c);
+                }
+            }
+        }
+        out.push_back('"');
+    }
+
+    static const char* do_decode(const char* ptr, const char* end, std::string& out) {
+        if(ptr >= end)
+            throw Exception("Corrupted UnQLite record");
+        char type = *ptr;
+        ptr += 1;
+        switch(type) {
+        case 23:
+            out += "null";
+            break;
+        case 24:
+            out += "true";
+            break;
+        case 25:
+            out += "false";
+            break;
+        case 10:
+            out += std::to_string(read_number<int64_t>(ptr, end));
+            break;
+        case 18:
+            {
+                uint16_t len = read_number<uint16_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                // reals are stored in textual form already, but
+                // "inf" or "nan" are not valid JSON numbers
+                if(len > 0 && (std::isdigit((unsigned char)*ptr) || *ptr == '-'))
+                    out.append(ptr, len);
+                else
+                    out += "null";
+                ptr += len;
+            }
+            break;
+        case 8:
+            {
+                uint32_t len = read_number<uint32_t>(ptr, end);
+                if(end - ptr < len)
+                    throw Exception("Corrupted UnQLite record");
+                append_string(out, ptr, len);
+                ptr += len;
+            }
+            break;
+        case 3:
+            out.push_back('[');
+            for(bool first = true; ; first = false) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 4) break;
+                if(!first) out.push_back(',');
+                ptr = do_decode(ptr, end, out);
+            }
+            if(ptr < end) ptr += 1;
+            out.push_back(']');
+            break;
+        case 1:
+            out.push_back('{');
+            for(bool first = true; ; first = false) {
+                skip_commas(ptr, end);
+                if(ptr >= end || *ptr == 2) break;
+                if(!first) out.push_back(',');
+                // Jx9 may store numeric keys as integers
+                if(*ptr == 10) {
+                    ptr += 1;
+                    out.push_back('"');
+                    out += std::to_string(read_number<int64_t>(ptr, end));
+                    out.push_back('"');
+                } else if(*ptr == 8) {
+                    ptr = do_decode(ptr, end, out);
+                } else {
+                    throw Exception("Corrupted UnQLite record");
+                }
+                if(ptr >= end || *ptr != 5)
+                    throw Exception("Corrupted UnQLite record");
+                ptr += 1;
+                out.push_back(':');
+                ptr = do_decode(ptr, end, out);
+            }
+            if(ptr < end) ptr += 1;
+            out.push_back('}');
+            break;
+        default:
+            throw Exception("Corrupted UnQLite record");
+        }
+        return ptr;
+    }
+
+    public:
+
+    static json decode(const char* data, size_t size) {
+        json result;
+        do_decode(data, data+size, result);
+        return result;
+    }
+
+    static json decode(const std::vector<char>& buffer) {
+        return decode(buffer.data(), buffer.size());
+    }
+
+    static json decode(const char* data, size_t size, const JsonProjection& projection) {
+        // anything that is not an object is left untouched by a projection
+        if(projection.empty() || size == 0 || *data != 1)
+            return decode(data, size);
+        json result;
+        do_decode(data+1, data+size, result, projection, JsonProjection::root);
+        return result;
+    }
+
+    static json decode(const std::vector<char>& buffer, const JsonProjection& projection) {
+        return decode(buffer.data(), buffer.size(), projection);
+    }
+
+    static void decodeToString(const char* data, size_t size, std::string& out) {
+        do_decode(data, data+size, out);
+    }
+
+    static std::string decodeToString(const std::vector<char>& buffer) {
+        std::string result;
+        result.reserve(buffer.size());
+        decodeToString(buffer.data(), buffer.size(), result);
+        return result;
+    }
+
+};
+
+} // namespace sonata
+
+#endif
@@ -7,6 +7,7 @@
 #define __SONATA_UNQLITE_JSON_ENCODE_HPP
 
 #include <nlohmann/json.hpp>
+#include <cstdio>
 #include "Endian.hpp"
 
 namespace sonata {
@@ -68,7 +69,11 @@ class UnQLiteJsonEncoder {
         case json::value_t::number_float:
             buffer.push_back(18);
             {
-                auto str_val = std::to_string(obj.get<double>());
+                // same format as the one Jx9 uses for reals
+                // (std::to_string would truncate to 6 decimals)
+                char tmp[32];
+                int n = std::snprintf(tmp, sizeof(tmp), "%.15g", obj.get<double>());
+                std::string str_val(tmp, n);
                 uint16_t str_val_size = static_cast<uint16_t>(str_val.size());
                 if(Endian::little) str_val_size = Endian::swap(str_val_size);
                 buffer.resize(buffer.size()+sizeof(str_val_size));
@@ -47,12 +47,23 @@ public:
     execute();
   }
 
+  /**
+   * @brief Reset the VM so it can be executed again without being
+   * recompiled. Collections loaded by the previous execution are released
+   * so that their header and records are read again from the database.
+   *
+   * @return true if the VM can be reused, false otherwise.
+   */
+  bool reset() {
+    if (unqlite_vm_release_collections(m_vm) != UNQLITE_OK)
+      return false;
+    return unqlite_vm_reset(m_vm) == UNQLITE_OK;
+  }
+
   template <typename T> void set(const std::string &name, const T &value) {
     UnQLiteValue uvalue(value, m_vm);
-    m_encoded_names.emplace_back(std::make_unique<std::string>(name));
-    int ret =
-        unqlite_vm_config(m_vm, UNQLITE_VM_CONFIG_CREATE_VAR,
-                          m_encoded_names.back()->c_str(), uvalue.m_value);
+    int ret = unqlite_vm_config(m_vm, UNQLITE_VM_CONFIG_CREATE_VAR,
+                                encoded_name(name), uvalue.m_value);
     if (ret != UNQLITE_OK)
       parse_and_throw_error();
   }
@@ -133,6 +144,16 @@ private:
   UnQLiteBackend *m_backend = nullptr;
   std::vector<std::unique_ptr<std::string>> m_encoded_names;
 
+  // the VM does not copy variable names, so we keep them alive here,
+  // reusing existing ones when the VM is executed multiple times
+  const char *encoded_name(const std::string &name) {
+    for (auto &n : m_encoded_names)
+      if (*n == name)
+        return n->c_str();
+    m_encoded_names.emplace_back(std::make_unique<std::string>(name));
+    return m_encoded_names.back()->c_str();
+  }
+
   void compile() {
     int ret = unqlite_compile(m_db, m_code, strlen(m_code), &m_vm);
     if (ret != UNQLITE_OK)
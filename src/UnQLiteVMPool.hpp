@@ -0,0 +1,142 @@
+/*
+ * (C) 2020 The University of Chicago
+ *
+ * See COPYRIGHT in top-level directory.
+ */
+#ifndef __SONATA_UNQLITE_VM_POOL_HPP
+#define __SONATA_UNQLITE_VM_POOL_HPP
+
+#include "UnQLiteVM.hpp"
+#include <memory>
+#include <mutex>
+#include <thallium.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace sonata {
+
+namespace tl = thallium;
+
+class UnQLiteBackend;
+
+/**
+ * @brief The UnQLiteVMPool keeps compiled UnQLiteVM instances for the
+ * fixed (constexpr) scripts used by the UnQLiteBackend, so that running
+ * one of these scripts does not require compiling it again. Scripts are
+ * identified by the address of their text, hence only scripts with static
+ * storage duration should be requested from the pool.
+ *
+ * A VM is handed out to a single ULT at a time. When the VM is returned,
+ * it is reset (unqlite_vm_reset) and the collections it loaded are released
+ * so that its next execution sees the current content of the database.
+ */
+class UnQLiteVMPool {
+
+public:
+  /**
+   * @brief RAII handle on a VM borrowed from the pool.
+   * The VM is given back to the pool when the handle is destroyed.
+   */
+  class Handle {
+
+    friend class UnQLiteVMPool;
+
+  public:
+    Handle(Handle &&other)
+        : m_pool(other.m_pool), m_script(other.m_script),
+          m_vm(std::move(other.m_vm)) {}
+
+    Handle(const Handle &) = delete;
+    Handle &operator=(const Handle &) = delete;
+    Handle &operator=(Handle &&) = delete;
+
+    ~Handle() {
+      if (m_vm)
+        m_pool->release(m_script, std::move(m_vm));
+    }
+
+    UnQLiteVM *operator->() const { return m_vm.get(); }
+
+    UnQLiteVM &operator*() const { return *m_vm; }
+
+  private:
+    Handle(UnQLiteVMPool *pool, const char *script,
+           std::unique_ptr<UnQLiteVM> &&vm)
+        : m_pool(pool), m_script(script), m_vm(std::move(vm)) {}
+
+    UnQLiteVMPool *m_pool;
+    const char *m_script;
+    std::unique_ptr<UnQLiteVM> m_vm;
+  };
+
+  /**
+   * @brief Constructor.
+   *
+   * @param db UnQLite database the VMs are compiled against.
+   * @param backend Backend owning the pool.
+   * @param max_idle Maximum number of idle VMs kept per script
+   * (0 disables pooling, VMs are then compiled for every use).
+   */
+  UnQLiteVMPool(unqlite *db, UnQLiteBackend *backend, size_t max_idle)
+      : m_db(db), m_backend(backend), m_max_idle(max_idle) {}
+
+  UnQLiteVMPool(UnQLiteVMPool &&) = delete;
+  UnQLiteVMPool(const UnQLiteVMPool &) = delete;
+  UnQLiteVMPool &operator=(UnQLiteVMPool &&) = delete;
+  UnQLiteVMPool &operator=(const UnQLiteVMPool &) = delete;
+
+  ~UnQLiteVMPool() { clear(); }
+
+  /**
+   * @brief Get a compiled VM for the provided script, compiling
+   * a new one if no idle VM is available for this script.
+   * Throws an Exception if the script cannot be compiled.
+   *
+   * @param script Script with static storage duration.
+   *
+   * @return a Handle to the VM.
+   */
+  Handle acquire(const char *script) {
+    {
+      std::lock_guard<tl::mutex> lock(m_mutex);
+      auto it = m_idle.find(script);
+      if (it != m_idle.end() && !it->second.empty()) {
+        auto vm = std::move(it->second.back());
+        it->second.pop_back();
+        return Handle(this, script, std::move(vm));
+      }
+    }
+    return Handle(this, script,
+                  std::make_unique<UnQLiteVM>(m_db, script, m_backend));
+  }
+
+  /**
+   * @brief Release all the idle VMs. Must be called before
+   * the underlying database is closed.
+   */
+  void clear() {
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    m_idle.clear();
+  }
+
+private:
+  void release(const char *script, std::unique_ptr<UnQLiteVM> &&vm) {
+    if (m_max_idle == 0 || !vm->reset())
+      return;
+    std::lock_guard<tl::mutex> lock(m_mutex);
+    auto &idle = m_idle[script];
+    if (idle.size() < m_max_idle)
+      idle.push_back(std::move(vm));
+  }
+
+  unqlite *m_db;
+  UnQLiteBackend *m_backend;
+  size_t m_max_idle;
+  tl::mutex m_mutex;
+  std::unordered_map<const char *, std::vector<std::unique_ptr<UnQLiteVM>>>
+      m_idle;
+};
+
+} // namespace sonata
+
+#endif
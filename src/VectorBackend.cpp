@@ -18,6 +18,7 @@ std::unique_ptr<Backend> VectorBackend::create(const thallium::engine &engine,
   spdlog::trace("[vector] Creating Vector database");
   int ret;
   auto backend = std::make_unique<VectorBackend>();
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[vector] Successfully created database");
   return backend;
 }
@@ -28,6 +29,7 @@ std::unique_ptr<Backend> VectorBackend::attach(const thallium::engine &engine,
   spdlog::trace("[vector] Opening Vector database");
   int ret;
   auto backend = std::make_unique<VectorBackend>();
+  backend->m_scan = ParallelScan(pool, config);
   spdlog::trace("[vector] Successfully opened database");
   return backend;
 }
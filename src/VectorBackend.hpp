@@ -9,6 +9,10 @@
 #include "sonata/Admin.hpp"
 #include "sonata/Backend.hpp"
 #include "sonata/Client.hpp"
+#include "JsonAggregation.hpp"
+#include "JsonPredicate.hpp"
+#include "ParallelScan.hpp"
+#include "ReservedIds.hpp"
 
 #include <cstdio>
 #include <fstream>
@@ -83,6 +87,7 @@ public:
     if (m_collections.count(coll_name)) {
       m_collections.erase(coll_name);
       m_collection_size.erase(coll_name);
+      m_reserved.erase(coll_name);
       result.success() = true;
     } else {
       result.error() = "Collection does not exist";
@@ -103,8 +108,8 @@ public:
     }
     auto& collection = m_collections[coll_name];
     auto& coll_size  = m_collection_size[coll_name];
+    result.value() = collection.size();
     collection.push_back(record);
-    result.value() = coll_size;
     coll_size += 1;
     return result;
   }
@@ -168,6 +173,63 @@ public:
     return result;
   }
 
+  virtual RequestResult<uint64_t> reserveIds(const std::string &coll_name,
+                                             size_t count) override {
+    RequestResult<uint64_t> result;
+    std::lock_guard<tl::mutex> guard(m_mutex);
+    if (m_collections.count(coll_name) == 0) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    auto &collection = m_collections[coll_name];
+    // reserved ids are empty records, like erased ones
+    result.value() = collection.size();
+    collection.resize(collection.size() + count);
+    m_reserved[coll_name].add(result.value(), count);
+    return result;
+  }
+
+  virtual RequestResult<bool>
+  storeReserved(const std::string &coll_name,
+                const std::vector<uint64_t> &record_ids,
+                const JsonWrapper &records, bool commit) override {
+    RequestResult<bool> result;
+    if (!records->is_array() || records->size() != record_ids.size()) {
+      result.success() = false;
+      result.error() = "Invalid number of records";
+      return result;
+    }
+    std::vector<std::string> contents;
+    contents.reserve(record_ids.size());
+    for (auto &record : records.m_object)
+      contents.push_back(record.dump());
+    std::lock_guard<tl::mutex> guard(m_mutex);
+    if (m_collections.count(coll_name) == 0) {
+      result.success() = false;
+      result.error() = "Collection does not exist";
+      return result;
+    }
+    auto &collection = m_collections[coll_name];
+    // check all the ids before storing anything, on a copy of the
+    // reserved ids so that an id used twice in this call is rejected
+    auto reserved = m_reserved[coll_name];
+    for (auto id : record_ids) {
+      if (!reserved.contains(id)) {
+        result.success() = false;
+        result.error() = "Record id " + std::to_string(id) +
+                         " was not reserved";
+        return result;
+      }
+      reserved.remove(id);
+    }
+    for (size_t i = 0; i < record_ids.size(); i++)
+      collection[record_ids[i]] = std::move(contents[i]);
+    m_reserved[coll_name] = std::move(reserved);
+    m_collection_size[coll_name] += record_ids.size();
+    return result;
+  }
+
   virtual RequestResult<std::string> fetch(const std::string &coll_name,
                                            uint64_t record_id) override {
     RequestResult<std::string> result;
@@ -285,6 +347,96 @@ public:
     return result;
   }
 
+  virtual RequestResult<std::vector<std::string>>
+  filterPredicate(const std::string &coll_name,
+                  const JsonWrapper &predicate) override {
+    RequestResult<std::vector<std::string>> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      const auto &collection = m_collections[coll_name];
+      result.value() = m_scan.run<std::string>(
+          collection.size(),
+          [&collection, &pred](size_t begin, size_t end,
+                               std::vector<std::string> &records) {
+            for (size_t i = begin; i < end; i++) {
+              auto &r = collection[i];
+              if (!r.empty() && pred(json::parse(r)))
+                records.push_back(r);
+            }
+          });
+    } catch (const std::exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+      result.value().clear();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  filterPredicateJson(const std::string &coll_name,
+                      const JsonWrapper &predicate) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      JsonPredicate pred(predicate.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      const auto &collection = m_collections[coll_name];
+      auto records = m_scan.run<json>(
+          collection.size(),
+          [&collection, &pred](size_t begin, size_t end,
+                               std::vector<json> &records) {
+            for (size_t i = begin; i < end; i++) {
+              auto &r = collection[i];
+              if (r.empty())
+                continue;
+              json j = json::parse(r);
+              if (pred(j))
+                records.push_back(std::move(j));
+            }
+          });
+      result.value() = json(std::move(records));
+    } catch (const std::exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+      result.value()->clear();
+    }
+    return result;
+  }
+
+  virtual RequestResult<JsonWrapper>
+  aggregate(const std::string &coll_name,
+            const JsonWrapper &pipeline) override {
+    RequestResult<JsonWrapper> result;
+    try {
+      JsonAggregation aggregation(pipeline.m_object);
+      std::lock_guard<tl::mutex> guard(m_mutex);
+      if (m_collections.count(coll_name) == 0) {
+        result.success() = false;
+        result.error() = "Collection does not exist";
+        return result;
+      }
+      for (auto &r : m_collections[coll_name]) {
+        if (!r.empty())
+          aggregation.add(json::parse(r));
+      }
+      result.value() = aggregation.result();
+    } catch (const std::exception &e) {
+      result.success() = false;
+      result.error() = e.what();
+    }
+    return result;
+  }
+
   virtual RequestResult<bool> update(const std::string &coll_name,
                                      uint64_t record_id,
                                      const std::string &new_content,
@@ -512,6 +664,7 @@ public:
     result.value() = true;
     m_collections.clear();
     m_collection_size.clear();
+    m_reserved.clear();
     return result;
   }
 
@@ -520,7 +673,10 @@ public:
 private:
   std::unordered_map<std::string, collection_t> m_collections;
   std::unordered_map<std::string, size_t> m_collection_size;
+  // ids handed out by reserveIds and not used by storeReserved yet
+  std::unordered_map<std::string, ReservedIds> m_reserved;
   tl::mutex m_mutex;
+  ParallelScan m_scan; // used by filterPredicate(Json)
 };
 
 } // namespace sonata
@@ -892,6 +892,7 @@ UNQLITE_APIEXPORT int unqlite_compile_file(unqlite *pDb,const char *zPath,unqlit
 UNQLITE_APIEXPORT int unqlite_vm_config(unqlite_vm *pVm,int iOp,...);
 UNQLITE_APIEXPORT int unqlite_vm_exec(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_reset(unqlite_vm *pVm);
+UNQLITE_APIEXPORT int unqlite_vm_release_collections(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_release(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_dump(unqlite_vm *pVm, int (*xConsumer)(const void *, unsigned int, void *), void *pUserData);
 UNQLITE_APIEXPORT unqlite_value * unqlite_vm_extract_variable(unqlite_vm *pVm,const char *zVarname);
@@ -3464,6 +3465,7 @@ UNQLITE_PRIVATE int unqliteCollectionSetSchema(unqlite_col *pCol,jx9_value *pVal
 UNQLITE_PRIVATE int unqliteCollectionPut(unqlite_col *pCol,jx9_value *pValue,int iFlag);
 UNQLITE_PRIVATE int unqliteCollectionDropRecord(unqlite_col *pCol,jx9_int64 nId,int wr_header,int log_err);
 UNQLITE_PRIVATE int unqliteDropCollection(unqlite_col *pCol);
+UNQLITE_PRIVATE int unqliteVmReleaseCollections(unqlite_vm *pVm);
 /* unql_jx9.c */
 UNQLITE_PRIVATE int unqliteRegisterJx9Functions(unqlite_vm *pVm);
 /* fastjson.c */
@@ -4646,6 +4648,33 @@ int unqlite_vm_reset(unqlite_vm *pVm)
 #endif
 	return rc;
 }
+/*
+ * [CAPIREF: unqlite_vm_release_collections()]
+ * Discard the collections (headers and cached records) loaded by a VM so that
+ * the next execution after [unqlite_vm_reset()] reloads them from the
+ * underlying storage engine.
+ */
+int unqlite_vm_release_collections(unqlite_vm *pVm)
+{
+	int rc;
+	if( UNQLITE_VM_MISUSE(pVm) ){
+		return UNQLITE_CORRUPT;
+	}
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Acquire VM mutex */
+	 SyMutexEnter(sUnqlMPGlobal.pMutexMethods, pVm->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+	 if( sUnqlMPGlobal.nThreadingLevel > UNQLITE_THREAD_LEVEL_SINGLE && 
+		 UNQLITE_THRD_VM_RELEASE(pVm) ){
+			 return UNQLITE_ABORT; /* Another thread have released this instance */
+	 }
+#endif
+	 rc = unqliteVmReleaseCollections(pVm);
+#if defined(UNQLITE_ENABLE_THREADS)
+	 /* Leave VM mutex */
+	 SyMutexLeave(sUnqlMPGlobal.pMutexMethods,pVm->pMutex); /* NO-OP if sUnqlMPGlobal.nThreadingLevel != UNQLITE_THREAD_LEVEL_MULTI */
+#endif
+	return rc;
+}
 /*
  * [CAPIREF: unqlite_vm_dump()]
  * Please refer to the official documentation for function purpose and expected parameters.
@@ -59158,6 +59187,31 @@ UNQLITE_PRIVATE int unqliteDropCollection(unqlite_col *pCol)
 	SyMemBackendPoolFree(&pVm->sAlloc,pCol);
 	return UNQLITE_OK;
 }
+/*
+ * Release every collection loaded in memory by the given VM without
+ * touching the underlying KV storage engine.
+ */
+UNQLITE_PRIVATE int unqliteVmReleaseCollections(unqlite_vm *pVm)
+{
+	unqlite_col *pNext,*pCol = pVm->pCol;
+	sxu32 n;
+	for( n = 0 ; n < pVm->iCol ; ++n ){
+		pNext = pCol->pNext;
+		CollectionCacheRelease(pCol);
+		SyBlobRelease(&pCol->sHeader);
+		SyBlobRelease(&pCol->sWorker);
+		jx9MemObjRelease(&pCol->sSchema);
+		SyMemBackendFree(&pVm->sAlloc,(void *)SyStringData(&pCol->sName));
+		unqliteReleaseCursor(pVm->pDb,pCol->pCursor);
+		SyMemBackendPoolFree(&pVm->sAlloc,pCol);
+		/* Point to the next collection */
+		pCol = pNext;
+	}
+	SyZero((void *)pVm->apCol,pVm->iColSize * sizeof(unqlite_col *));
+	pVm->pCol = 0;
+	pVm->iCol = 0;
+	return UNQLITE_OK;
+}
 /*
  * ----------------------------------------------------------
  * File: unqlite_jx9.c
@@ -825,6 +825,7 @@ UNQLITE_APIEXPORT int unqlite_compile_file(unqlite *pDb,const char *zPath,unqlit
 UNQLITE_APIEXPORT int unqlite_vm_config(unqlite_vm *pVm,int iOp,...);
 UNQLITE_APIEXPORT int unqlite_vm_exec(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_reset(unqlite_vm *pVm);
+UNQLITE_APIEXPORT int unqlite_vm_release_collections(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_release(unqlite_vm *pVm);
 UNQLITE_APIEXPORT int unqlite_vm_dump(unqlite_vm *pVm, int (*xConsumer)(const void *, unsigned int, void *), void *pUserData);
 UNQLITE_APIEXPORT unqlite_value * unqlite_vm_extract_variable(unqlite_vm *pVm,const char *zVarname);
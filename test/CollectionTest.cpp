@@ -3,12 +3,15 @@
  *
  * See COPYRIGHT in top-level directory.
  */
+#include <chrono>
 #include <cppunit/extensions/HelperMacros.h>
 #include <sonata/Client.hpp>
 #include <sonata/Admin.hpp>
+#include <sonata/Provider.hpp>
 #include "CollectionTestBase.hpp"
 
 extern thallium::engine* engine;
+extern sonata::Provider* provider;
 extern std::string db_type;
 
 using nlohmann::json;
@@ -19,31 +22,61 @@ class CollectionTest : public CppUnit::TestFixture,
     CPPUNIT_TEST_SUITE( CollectionTest );
     CPPUNIT_TEST( testStore );
     CPPUNIT_TEST( testStoreAsync );
+    CPPUNIT_TEST( testBufferedWriter );
+    CPPUNIT_TEST( testAsyncWindow );
     CPPUNIT_TEST( testFetch );
+    CPPUNIT_TEST( testRecordView );
     CPPUNIT_TEST( testFilter );
+    CPPUNIT_TEST( testFilterPredicate );
+    CPPUNIT_TEST( testParallelFilter );
+    CPPUNIT_TEST( testAggregate );
     CPPUNIT_TEST( testUpdate );
     CPPUNIT_TEST( testAll );
+    CPPUNIT_TEST( testBulk );
+    CPPUNIT_TEST( testProjection );
+    CPPUNIT_TEST( testCursor );
+    CPPUNIT_TEST( testBatch );
+    CPPUNIT_TEST( testAggregatorFlush );
+    CPPUNIT_TEST( testAggregatorAsyncFlush );
+    CPPUNIT_TEST( testGroupCommit );
+    CPPUNIT_TEST( testCache );
     CPPUNIT_TEST( testLastRecordID );
     CPPUNIT_TEST( testSize );
     CPPUNIT_TEST( testErase );
+    CPPUNIT_TEST( testIndex );
     CPPUNIT_TEST_SUITE_END();
 
     static constexpr const char* db_config = "{ \"path\" : \"mydb\", \"mutex\" : \"posix\" }";
 
+    // Returns the "stats" reported by the backend of a database
+    static json databaseStats(const std::string& db_name) {
+        auto config = json::parse(provider->getConfig());
+        for(auto& db : config["databases"]) {
+            if(db["name"] == db_name)
+                return db["config"]["stats"];
+        }
+        return json();
+    }
+
     public:
 
     void setUp() {
         sonata::Admin admin(*engine);
         std::string addr = engine->self();
         std::string cfg;
-        if(db_type == "aggregator") {
+        std::string type = db_type;
+        if(db_type == "aggregator" || db_type == "cache") {
             cfg += "{ \"backend\" : \"unqlite\", \"config\" : ";
             cfg += db_config;
             cfg += "}";
+        } else if(db_type == "unqlite-bypass") {
+            type = "unqlite";
+            cfg = db_config;
+            cfg.insert(cfg.size()-1, ", \"bypass\" : true ");
         } else {
             cfg = db_config;
         }
-        admin.createDatabase(addr, 0, "mydb", db_type, cfg);
+        admin.createDatabase(addr, 0, "mydb", type, cfg);
 
         sonata::Client client(*engine);
         auto db = client.open(addr, 0, "mydb");
@@ -63,15 +96,12 @@ class CollectionTest : public CppUnit::TestFixture,
         sonata::Collection coll = mydb.open("mycollection");
 
         uint64_t ref_record_id = 0;
-        uint64_t max_record_id = std::numeric_limits<uint64_t>::max();
         // Strings can be stored
         for(const auto& r : records_str) {
             uint64_t record_id;
             CPPUNIT_ASSERT_NO_THROW_MESSAGE(
                     "coll.store should not throw.",
                     record_id = coll.store(r));
-            if(db_type == "aggregator")
-                ref_record_id = max_record_id;
             CPPUNIT_ASSERT_EQUAL_MESSAGE(
                     "record id should be correct.",
                     ref_record_id, record_id);
@@ -84,8 +114,6 @@ class CollectionTest : public CppUnit::TestFixture,
             CPPUNIT_ASSERT_NO_THROW_MESSAGE(
                     "coll.store should not throw.",
                     record_id = coll.store(r));
-            if(db_type == "aggregator")
-                ref_record_id = max_record_id;
             CPPUNIT_ASSERT_EQUAL_MESSAGE(
                     "record id should be correct.",
                     ref_record_id, record_id);
@@ -99,8 +127,6 @@ class CollectionTest : public CppUnit::TestFixture,
         sonata::Database mydb = client.open(addr, 0, "mydb");
         sonata::Collection coll = mydb.open("mycollection");
 
-        uint64_t ref_record_id = 0;
-        uint64_t max_record_id = std::numeric_limits<uint64_t>::max();
         std::vector<uint64_t> ids(records_str.size());
         std::vector<sonata::AsyncRequest> requests(records_str.size());
         // Strings can be stored
@@ -115,16 +141,130 @@ class CollectionTest : public CppUnit::TestFixture,
             CPPUNIT_ASSERT_NO_THROW_MESSAGE(
                     "request.wait should not throw.",
                     requests[j].wait());
-            if(db_type == "aggregator") {
-                CPPUNIT_ASSERT_EQUAL_MESSAGE(
-                    "record id should be correct.",
-                    max_record_id, ids[j]);
-            } else {
-                CPPUNIT_ASSERT_EQUAL_MESSAGE(
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "record id should be correct.",
+                (uint64_t)j, ids[j]);
+        }
+    }
+
+    void testBufferedWriter() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        std::vector<uint64_t> ids(records_str.size());
+        std::vector<sonata::AsyncRequest> requests(records_str.size());
+        size_t max_records = records_str.size() - 1;
+        sonata::BufferedWriter writer = coll.buffered_writer(max_records);
+        for(size_t i = 0; i < records_str.size(); i++) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "writer.store should not throw.",
+                    writer.store(records_str[i], &ids[i], &requests[i]));
+        }
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the last record should still be buffered.",
+                1, (int)writer.pending());
+        // Waiting on the request of a buffered record sends it
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "request.wait should not throw.",
+                requests.back().wait());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "no record should be buffered.",
+                0, (int)writer.pending());
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "writer.flush should not throw.",
+                writer.flush());
+        for(size_t j = 0; j < ids.size(); j++) {
+            CPPUNIT_ASSERT_MESSAGE(
+                    "request should have completed.",
+                    requests[j].completed());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
                     "record id should be correct.",
                     (uint64_t)j, ids[j]);
-            }
         }
+        // JSON records are buffered until flushed
+        writer.store(records_json[0]);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the record should be buffered.",
+                1, (int)writer.pending());
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "writer.flush should not throw.",
+                writer.flush());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "coll.size should be correct.",
+                (int)records_str.size() + 1, (int)coll.size());
+    }
+
+    void testAsyncWindow() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        // Store the records with at most 2 of them in flight
+        size_t stored = 0;
+        sonata::AsyncRequestWindow window(2);
+        for(const auto& r : records_str) {
+            sonata::AsyncRequest* req = nullptr;
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "window.next should not throw.",
+                    req = window.next());
+            CPPUNIT_ASSERT_MESSAGE(
+                    "window should not exceed its size.",
+                    window.size() <= 1);
+            coll.store(r, nullptr, false, req);
+            req->then([&stored]() { stored += 1; });
+        }
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "window.wait_all should not throw.",
+                window.wait_all());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "all the callbacks should have been called.",
+                records_str.size(), stored);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "window should be empty.",
+                0, (int)window.size());
+
+        // Fetch the records, callbacks see the fetched records
+        std::vector<json> results(records_str.size());
+        std::vector<sonata::AsyncRequest> requests(records_str.size());
+        std::vector<bool> checked(records_str.size(), false);
+        for(size_t i = 0; i < records_str.size(); i++) {
+            coll.fetch(i, &results[i], &requests[i]);
+            requests[i].then([&, i]() {
+                checked[i] = results[i]["name"] == records_json[i]["name"];
+            });
+        }
+        size_t i = 0;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "wait_any should not throw.",
+                i = sonata::AsyncRequest::wait_any(requests));
+        CPPUNIT_ASSERT_MESSAGE(
+                "the request returned by wait_any should have completed.",
+                requests[i].completed() && checked[i]);
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "wait_all should not throw.",
+                sonata::AsyncRequest::wait_all(requests));
+        for(size_t j = 0; j < checked.size(); j++) {
+            CPPUNIT_ASSERT_MESSAGE(
+                    "fetched record should be correct.",
+                    checked[j]);
+        }
+
+        // Errors are reported by wait_all and callbacks are not called
+        bool called = false;
+        json result;
+        requests.assign(1, sonata::AsyncRequest());
+        coll.fetch(records_str.size(), &result, &requests[0]);
+        requests[0].then([&called]() { called = true; });
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "wait_all should throw.",
+                sonata::AsyncRequest::wait_all(requests),
+                sonata::Exception);
+        CPPUNIT_ASSERT_MESSAGE(
+                "the callback should not have been called.",
+                !called);
     }
 
     void testFetch() {
@@ -158,8 +298,55 @@ class CollectionTest : public CppUnit::TestFixture,
                 sonata::Exception);
     }
 
+    void testRecordView() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        for(const auto& r : records_str) {
+            coll.store(r);
+        }
+
+        // Fetch a record as a view
+        sonata::RecordView view;
+        uint64_t id = records_str.size()/2;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch should not throw.",
+                coll.fetch(id, &view));
+        CPPUNIT_ASSERT_MESSAGE(
+                "view should be an object.",
+                view.is_object());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "view should contain correct data.",
+                records_json[id]["name"].get<std::string>(),
+                view["name"].get<std::string>());
+        CPPUNIT_ASSERT_MESSAGE(
+                "missing fields should not exist.",
+                !view["nonexistent_field"].exists());
+
+        // Fetch multiple records as views, with a projection
+        std::vector<uint64_t> ids = { 0, id };
+        std::vector<sonata::RecordView> views;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch_multi should not throw.",
+                coll.fetch_multi(ids.data(), ids.size(), {"name"}, &views));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "there should be one view per record.",
+                ids.size(), views.size());
+        for(unsigned i=0; i < ids.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "view should contain correct data.",
+                records_json[ids[i]]["name"],
+                views[i]["name"].to_json());
+            CPPUNIT_ASSERT_MESSAGE(
+                "projected fields only should be returned.",
+                !views[i].contains("city"));
+        }
+    }
+
     void testFilter() {
-        if(db_type != "unqlite")
+        if(db_type != "unqlite" && db_type != "unqlite-bypass")
             return;
 
         sonata::Client client(*engine);
@@ -212,6 +399,181 @@ class CollectionTest : public CppUnit::TestFixture,
                 2, (int)json_result.size());
     }
 
+    void testFilterPredicate() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        json predicate = {{"field", "papers"}, {"gt", 35}};
+        // Try to filter from an empty collection
+        std::vector<std::string> results;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "it should be possible to filter from an empty collection.",
+                coll.filter_predicate(predicate, &results));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have no records.",
+                0, (int)results.size());
+
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+        // Filter that returns half of the records
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.filter_predicate should not throw.",
+                coll.filter_predicate(predicate, &results));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have 2 records.",
+                2, (int)results.size());
+
+        // Compound predicate into a Json result
+        predicate = json::parse(R"({"or": [
+            {"and": [{"field": "papers", "ge": 2, "lt": 40},
+                     {"not": {"field": "city", "eq": "Rome"}}]},
+            {"field": "name", "in": ["Niel", "Nobody"]}]})");
+        json json_result;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.filter_predicate should not throw.",
+                coll.filter_predicate(predicate, &json_result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have 2 records.",
+                2, (int)json_result.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should contain the correct records.",
+                records_json[2]["name"].get<std::string>(),
+                json_result[1]["name"].get<std::string>());
+
+        // Malformed predicate
+        predicate = {{"field", "papers"}, {"between", 35}};
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "coll.filter_predicate should throw on an invalid predicate.",
+                coll.filter_predicate(predicate, &results),
+                sonata::Exception);
+    }
+
+    void testParallelFilter() {
+        if(db_type != "unqlite" && db_type != "unqlite-bypass")
+            return;
+        sonata::Admin admin(*engine);
+        std::string addr = engine->self();
+        std::string cfg = "{ \"path\" : \"scandb\", \"mutex\" : \"posix\", "
+                          "\"filter_ults\" : 4, \"filter_min_records_per_ult\" : 1 }";
+        if(db_type == "unqlite-bypass")
+            cfg.insert(cfg.size()-1, ", \"bypass\" : true ");
+        admin.createDatabase(addr, 0, "scandb", "unqlite", cfg);
+        sonata::Client client(*engine);
+        sonata::Database scandb = client.open(addr, 0, "scandb");
+        sonata::Collection coll = scandb.create("scancollection");
+
+        const int count = 64;
+        for(int i = 0; i < count; i++) {
+            json record = {{"index", i}, {"even", i % 2 == 0}};
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(record));
+        }
+        // The scan is split across 4 ULTs, records still come out in order
+        json predicate = {{"field", "even"}, {"eq", true}};
+        std::vector<std::string> results;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.filter_predicate should not throw.",
+                coll.filter_predicate(predicate, &results));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have half of the records.",
+                count/2, (int)results.size());
+        for(int i = 0; i < count/2; i++) {
+            auto record = json::parse(results[i]);
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "records should be in id order.",
+                    (uint64_t)(2*i), record["__id"].get<uint64_t>());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "records should be correct.",
+                    2*i, record["index"].get<int>());
+        }
+        json json_result;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.filter_predicate should not throw.",
+                coll.filter_predicate(predicate, &json_result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have half of the records.",
+                count/2, (int)json_result.size());
+        for(int i = 0; i < count/2; i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "records should be in id order.",
+                    (uint64_t)(2*i), json_result[i]["__id"].get<uint64_t>());
+        }
+
+        admin.destroyDatabase(addr, 0, "scandb");
+    }
+
+    void testAggregate() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        json pipeline = json::parse(R"({"reductions": [
+            {"op": "count"},
+            {"op": "sum", "field": "papers", "as": "total"},
+            {"op": "max", "field": "papers"}]})");
+        // Aggregate an empty collection
+        json result;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "it should be possible to aggregate an empty collection.",
+                coll.aggregate(pipeline, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have a single row.",
+                1, (int)result.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "count should be 0.",
+                0, result[0]["count"].get<int>());
+
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.aggregate should not throw.",
+                coll.aggregate(pipeline, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "count should be the number of records.",
+                (int)records_json.size(), result[0]["count"].get<int>());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "total should be the sum of papers.",
+                143, result[0]["total"].get<int>());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "max_papers should be the maximum of papers.",
+                64, result[0]["max_papers"].get<int>());
+
+        // Group by city, with a predicate
+        pipeline = json::parse(R"({
+            "predicate": {"field": "papers", "gt": 10},
+            "group_by": "city",
+            "reductions": [{"op": "avg", "field": "papers"}]})");
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.aggregate should not throw.",
+                coll.aggregate(pipeline, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have one row per matching city.",
+                3, (int)result.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "rows should be ordered by city.",
+                std::string("Berlin"), result[0]["city"].get<std::string>());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "avg_papers should be computed per city.",
+                32.0, result[0]["avg_papers"].get<double>());
+
+        // Malformed pipeline
+        pipeline = json::parse(R"({"reductions": [{"op": "median", "field": "papers"}]})");
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "coll.aggregate should throw on an invalid pipeline.",
+                coll.aggregate(pipeline, &result),
+                sonata::Exception);
+    }
+
     void testUpdate() {
         sonata::Client client(*engine);
         std::string addr = engine->self();
@@ -312,12 +674,557 @@ class CollectionTest : public CppUnit::TestFixture,
                 records_str.size(), result_str.size());
     }
 
+    void testBulk() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        // Use bulk transfers for any payload
+        client.setBulkThreshold(1);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "bulk threshold should be the one set.",
+                (size_t)1, client.getBulkThreshold());
+
+        size_t n = records_str.size();
+        std::vector<uint64_t> ids(n);
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.store_multi should not throw.",
+                coll.store_multi(records_str, ids.data()));
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.store_multi should not throw.",
+                coll.store_multi(records_json_all, ids.data()));
+
+        // Get all items as strings
+        std::vector<std::string> result_str;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.all should not throw.",
+                coll.all(&result_str));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "resulting vector should have the correct number of elements.",
+                2*n, result_str.size());
+        for(unsigned i=0; i < result_str.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "items should have the same name as stored.",
+                records_json[i % n]["name"],
+                json::parse(result_str[i])["name"]);
+        }
+
+        // Fetch the second half of the records
+        std::vector<uint64_t> fetch_ids(n);
+        for(unsigned i=0; i < n; i++)
+            fetch_ids[i] = n + i;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch_multi should not throw.",
+                coll.fetch_multi(fetch_ids.data(), n, &result_str));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "resulting vector should have the correct number of elements.",
+                n, result_str.size());
+        for(unsigned i=0; i < n; i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "items should have the same name as stored.",
+                records_json[i]["name"],
+                json::parse(result_str[i])["name"]);
+        }
+
+        // Disabling bulk transfers gives the same result
+        client.setBulkThreshold(0);
+        std::vector<std::string> result_inline;
+        coll.fetch_multi(fetch_ids.data(), n, &result_inline);
+        CPPUNIT_ASSERT_MESSAGE(
+                "inline and bulk transfers should return the same records.",
+                result_inline == result_str);
+    }
+
+    void testProjection() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+
+        std::vector<std::string> fields = { "name", "missing" };
+        json result;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch with projection should not throw.",
+                coll.fetch(1, fields, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "Projected record should contain the requested field.",
+                records_json[1]["name"].get<std::string>(),
+                result["name"].get<std::string>());
+        CPPUNIT_ASSERT_MESSAGE(
+                "Projected record should not contain other fields.",
+                !result.contains("city") && !result.contains("missing"));
+
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.all with projection should not throw.",
+                coll.all(fields, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "coll.all should return all the records.",
+                (int)records_json.size(), (int)result.size());
+        for(unsigned i = 0; i < records_json.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "Projected record should contain the requested field.",
+                    records_json[i]["name"].get<std::string>(),
+                    result[i]["name"].get<std::string>());
+            CPPUNIT_ASSERT_MESSAGE(
+                    "Projected record should not contain other fields.",
+                    !result[i].contains("papers"));
+        }
+
+        std::vector<uint64_t> ids = { 2, 0 };
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch_multi with projection should not throw.",
+                coll.fetch_multi(ids.data(), ids.size(), {"papers"}, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have 2 records.",
+                2, (int)result.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "Projected records should be returned in order.",
+                records_json[2]["papers"].get<int>(),
+                result[0]["papers"].get<int>());
+        CPPUNIT_ASSERT_MESSAGE(
+                "Projected record should not contain other fields.",
+                !result[1].contains("name") && !result[1].contains("city"));
+
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch without projection should not throw.",
+                coll.fetch(1, &result));
+        CPPUNIT_ASSERT_MESSAGE(
+                "Record fetched without projection should be complete.",
+                result.contains("name") && result.contains("city")
+                && result.contains("papers"));
+
+        json predicate = {{"field", "papers"}, {"gt", 35}};
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.filter_predicate with projection should not throw.",
+                coll.filter_predicate(predicate, {"papers"}, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "result should have 2 records.",
+                2, (int)result.size());
+        CPPUNIT_ASSERT_MESSAGE(
+                "Projected record should not contain other fields.",
+                result[0].contains("papers") && !result[0].contains("name"));
+    }
+
+    void testCursor() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        // Cursor on an empty collection
+        std::vector<std::string> page;
+        sonata::Cursor cursor;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.open_cursor should not throw.",
+                cursor = coll.open_cursor());
+        CPPUNIT_ASSERT_MESSAGE(
+                "cursor on an empty collection should be exhausted.",
+                !cursor.next(&page, 2));
+
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+
+        // Stream all the records, 3 at a time
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.open_cursor should not throw.",
+                cursor = coll.open_cursor());
+        std::vector<std::string> records;
+        while(cursor.next(&page, 3)) {
+            CPPUNIT_ASSERT_MESSAGE(
+                    "page should not exceed 3 records.",
+                    page.size() <= 3);
+            records.insert(records.end(), page.begin(), page.end());
+        }
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "cursor should return all the records.",
+                records_str.size(), records.size());
+        for(unsigned i = 0; i < records.size(); i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "records should be returned in order.",
+                    records_json[i]["name"].get<std::string>(),
+                    json::parse(records[i])["name"].get<std::string>());
+        }
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "cursor.close should not throw.",
+                cursor.close());
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "cursor.next should throw after close.",
+                cursor.next(&page, 3),
+                sonata::Exception);
+
+        // Stream filtered and projected records as JSON
+        json predicate = {{"field", "papers"}, {"gt", 35}};
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.open_cursor should not throw.",
+                cursor = coll.open_cursor(predicate, {"name"}));
+        json json_page;
+        int count = 0;
+        while(cursor.next(&json_page, 1)) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "page should have 1 record.",
+                    1, (int)json_page.size());
+            CPPUNIT_ASSERT_MESSAGE(
+                    "record should be projected.",
+                    json_page[0].contains("name")
+                    && !json_page[0].contains("papers"));
+            count += 1;
+        }
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "cursor should return 2 records.",
+                2, count);
+    }
+
+    void testBatch() {
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+        sonata::Collection other = mydb.create("othercollection");
+        sonata::Admin admin(*engine);
+        admin.createDatabase(addr, 0, "batchdb", "unqlite",
+                             "{ \"path\" : \"batchdb\", \"mutex\" : \"posix\" }");
+        sonata::Database batchdb = client.open(addr, 0, "batchdb");
+        sonata::Collection remote = batchdb.create("batchcollection");
+
+        // Operations on several collections and databases are sent together
+        json my_before = databaseStats("mydb");
+        json batch_before = databaseStats("batchdb");
+        sonata::Batch batch;
+        batch.store(coll, records_str[0]);
+        batch.store(other, records_json[1]);
+        batch.store(remote, records_json[3]);
+        batch.store(coll, records_json[2]);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "batch should have 4 operations.",
+                4, (int)batch.size());
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "batch.execute should not throw.",
+                batch.execute(true));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "batch should be empty after execution.",
+                0, (int)batch.size());
+        // Each database written to is committed once
+        json batch_after = databaseStats("batchdb");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "batchdb should have been committed once.",
+                (uint64_t)1, batch_after["commits"].get<uint64_t>()
+                           - batch_before["commits"].get<uint64_t>());
+        if(my_before.contains("commits")) {
+            json my_after = databaseStats("mydb");
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "mydb should have been committed once.",
+                    (uint64_t)1, my_after["commits"].get<uint64_t>()
+                               - my_before["commits"].get<uint64_t>());
+        }
+        json remote_record;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "remote.fetch should not throw.",
+                remote.fetch(0, &remote_record));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "record stored in batchdb should be correct.",
+                records_json[3]["name"].get<std::string>(),
+                remote_record["name"].get<std::string>());
+        admin.destroyDatabase(addr, 0, "batchdb");
+
+        std::string str_record;
+        json json_record;
+        bool updated = false;
+        batch.fetch(coll, 1, &json_record);
+        batch.fetch(other, 0, &str_record);
+        batch.update(coll, 0, records_json[3], &updated);
+        sonata::AsyncRequest req;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "batch.execute should not throw.",
+                batch.execute(false, &req));
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "req.wait should not throw.",
+                req.wait());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "fetched JSON record should be correct.",
+                records_json[2]["name"].get<std::string>(),
+                json_record["name"].get<std::string>());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "fetched record should be correct.",
+                records_json[1]["name"].get<std::string>(),
+                json::parse(str_record)["name"].get<std::string>());
+        CPPUNIT_ASSERT_MESSAGE("record should have been updated.", updated);
+
+        // A failed operation does not prevent the next ones
+        str_record.clear();
+        batch.erase(other, 0);
+        batch.fetch(other, 0, &json_record);
+        batch.fetch(coll, 0, &str_record);
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "batch.execute should throw if an operation failed.",
+                batch.execute(),
+                sonata::Exception);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "operations after the failed one should be executed.",
+                records_json[3]["name"].get<std::string>(),
+                json::parse(str_record)["name"].get<std::string>());
+
+        mydb.drop("othercollection");
+    }
+
+    void testAggregatorFlush() {
+        if(db_type != "aggregator")
+            return;
+        sonata::Admin admin(*engine);
+        std::string addr = engine->self();
+        std::string cfg = "{ \"backend\" : \"unqlite\", "
+                          "\"config\" : { \"path\" : \"aggdb\", \"mutex\" : \"posix\" }, "
+                          "\"flush_on_read\" : false, \"batch_size\" : 1000, "
+                          "\"batch_bytes\" : 4096, \"max_batch_age\" : 0.2 }";
+        admin.createDatabase(addr, 0, "aggdb", "aggregator", cfg);
+        sonata::Client client(*engine);
+        sonata::Database aggdb = client.open(addr, 0, "aggdb");
+        sonata::Collection coll = aggdb.create("aggcollection");
+
+        // A small record stays in the batch (its id is reserved)...
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "record id should be correct.",
+                (uint64_t)0, coll.store(records_str[0]));
+        std::vector<std::string> flushed;
+        coll.all(&flushed);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the record should not have been flushed yet.",
+                0, (int)flushed.size());
+        // ... but can be read from the batch
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "coll.size should count the pending record.",
+                1, (int)coll.size());
+        json record;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.fetch should find the pending record.",
+                coll.fetch(0, &record));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the pending record should be correct.",
+                records_json[0]["name"], record["name"]);
+        // ... until the batch is older than max_batch_age
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        do {
+            thallium::thread::sleep(*engine, 50);
+            coll.all(&flushed);
+        } while(flushed.empty() && std::chrono::steady_clock::now() < deadline);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the record should have been flushed.",
+                1, (int)flushed.size());
+
+        // A batch reaching batch_bytes is flushed immediately
+        json big_record = { { "data", std::string(5000, 'x') } };
+        coll.store(big_record);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the large record should have been flushed.",
+                2, (int)coll.size());
+
+        admin.destroyDatabase(addr, 0, "aggdb");
+    }
+
+    void testAggregatorAsyncFlush() {
+        if(db_type != "aggregator")
+            return;
+        sonata::Admin admin(*engine);
+        std::string addr = engine->self();
+        std::string cfg = "{ \"backend\" : \"unqlite\", "
+                          "\"config\" : { \"path\" : \"asyncdb\", \"mutex\" : \"posix\" }, "
+                          "\"flush_on_read\" : false, \"batch_size\" : 2, "
+                          "\"async_flush\" : true, \"flush_queue_size\" : 1 }";
+        admin.createDatabase(addr, 0, "asyncdb", "aggregator", cfg);
+        sonata::Client client(*engine);
+        sonata::Database asyncdb = client.open(addr, 0, "asyncdb");
+        sonata::Collection coll = asyncdb.create("asynccollection");
+
+        // Several batches go through a flush queue of a single task
+        size_t count = 4*records_str.size()+1;
+        for(size_t i = 0; i < count; i++) {
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "record id should be correct.",
+                    (uint64_t)i, coll.store(records_str[i % records_str.size()]));
+        }
+        // commit() waits for all of them to be written
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "asyncdb.commit should not throw.",
+                asyncdb.commit());
+        std::vector<std::string> flushed;
+        coll.all(&flushed);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "all the records should have been flushed.",
+                (int)count, (int)flushed.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "coll.size should be correct.",
+                (int)count, (int)coll.size());
+
+        // Dropping the collection waits for the pending records to be
+        // written, none of them is written to the new collection
+        for(size_t i = 0; i < count; i++)
+            coll.store(records_str[i % records_str.size()]);
+        asyncdb.drop("asynccollection");
+        coll = asyncdb.create("asynccollection");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "the new collection should be empty.",
+                0, (int)coll.size());
+        coll.all(&flushed);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "no record should have been flushed to the new collection.",
+                0, (int)flushed.size());
+
+        admin.destroyDatabase(addr, 0, "asyncdb");
+    }
+
+    void testGroupCommit() {
+        if(db_type != "unqlite" && db_type != "unqlite-bypass")
+            return;
+        sonata::Admin admin(*engine);
+        std::string addr = engine->self();
+        std::string cfg = "{ \"path\" : \"groupdb\", \"mutex\" : \"posix\", "
+                          "\"group_commit_window_ms\" : 100 }";
+        if(db_type == "unqlite-bypass")
+            cfg.insert(cfg.size()-1, ", \"bypass\" : true ");
+        admin.createDatabase(addr, 0, "groupdb", "unqlite", cfg);
+        sonata::Client client(*engine);
+        sonata::Database groupdb = client.open(addr, 0, "groupdb");
+        sonata::Collection coll = groupdb.create("groupcollection");
+
+        // Concurrent stores with commit=true share commits
+        json before = databaseStats("groupdb");
+        std::vector<uint64_t> ids(records_str.size());
+        std::vector<sonata::AsyncRequest> requests(records_str.size());
+        for(size_t i = 0; i < records_str.size(); i++) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(records_str[i], &ids[i], true, &requests[i]));
+        }
+        for(auto& req : requests) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "request.wait should not throw.",
+                    req.wait());
+        }
+        json after = databaseStats("groupdb");
+        uint64_t commit_requests = after["commit_requests"].get<uint64_t>()
+                                 - before["commit_requests"].get<uint64_t>();
+        uint64_t commits = after["commits"].get<uint64_t>()
+                         - before["commits"].get<uint64_t>();
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "each store should have requested a commit.",
+                (uint64_t)records_str.size(), commit_requests);
+        CPPUNIT_ASSERT_MESSAGE(
+                "concurrent stores should have shared commits.",
+                commits >= 1 && commits < commit_requests);
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "coll.size should be correct.",
+                (int)records_str.size(), (int)coll.size());
+
+        admin.destroyDatabase(addr, 0, "groupdb");
+    }
+
+    void testCache() {
+        if(db_type != "cache")
+            return;
+        sonata::Admin admin(*engine);
+        std::string addr = engine->self();
+        std::string cfg = "{ \"backend\" : \"unqlite\", "
+                          "\"config\" : { \"path\" : \"cachedb\", \"mutex\" : \"posix\" } }";
+        admin.createDatabase(addr, 0, "cachedb", "cache", cfg);
+        sonata::Client client(*engine);
+        sonata::Database cachedb = client.open(addr, 0, "cachedb");
+        sonata::Collection coll = cachedb.create("cachecollection");
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+        auto hits = [](const json& stats) { return stats["hits"].get<uint64_t>(); };
+        auto misses = [](const json& stats) { return stats["misses"].get<uint64_t>(); };
+
+        // The first fetch misses, the second one hits
+        json record;
+        json before = databaseStats("cachedb");
+        coll.fetch(0, &record);
+        json after = databaseStats("cachedb");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("first fetch should miss.",
+                (uint64_t)1, misses(after) - misses(before));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("first fetch should not hit.",
+                (uint64_t)0, hits(after) - hits(before));
+        before = after;
+        coll.fetch(0, &record);
+        after = databaseStats("cachedb");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("second fetch should hit.",
+                (uint64_t)1, hits(after) - hits(before));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("second fetch should not miss.",
+                (uint64_t)0, misses(after) - misses(before));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("cached record should be correct.",
+                records_json[0]["name"], record["name"]);
+
+        // An update invalidates the cached record
+        coll.update(0, records_json[1]);
+        before = databaseStats("cachedb");
+        coll.fetch(0, &record);
+        after = databaseStats("cachedb");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("fetch after update should miss.",
+                (uint64_t)1, misses(after) - misses(before));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("updated record should be returned.",
+                records_json[1]["name"], record["name"]);
+
+        // An erasure invalidates the cached record
+        coll.fetch(1, &record);
+        coll.erase(1);
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "erased record should not be returned from the cache.",
+                coll.fetch(1, &record),
+                sonata::Exception);
+
+        // Executing code invalidates every cached record
+        coll.fetch(2, &record);
+        std::string code =
+            "$rec = { \"name\" : \"Changed\" };"
+            "$rc = db_update_record('cachecollection', 2, $rec);";
+        std::unordered_set<std::string> vars = { "rc" };
+        std::unordered_map<std::string, std::string> results;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "cachedb.execute should not throw.",
+                cachedb.execute(code, vars, &results));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "rc should be true.",
+                std::string("true"), results["rc"]);
+        before = databaseStats("cachedb");
+        coll.fetch(2, &record);
+        after = databaseStats("cachedb");
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("fetch after execute should miss.",
+                (uint64_t)1, misses(after) - misses(before));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE("record updated by execute should be returned.",
+                std::string("Changed"), record["name"].get<std::string>());
+
+        admin.destroyDatabase(addr, 0, "cachedb");
+    }
+
     void testLastRecordID() {
         sonata::Client client(*engine);
         std::string addr = engine->self();
         sonata::Database mydb = client.open(addr, 0, "mydb");
         sonata::Collection coll = mydb.open("mycollection");
 
+        // UnQLite returns 0 for an empty collection (the in-memory
+        // backends report an error instead)
+        if(db_type != "jsoncpp" && db_type != "vector") {
+            uint64_t last_id = 1;
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.last_record_id should not throw on an empty collection.",
+                    last_id = coll.last_record_id());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                    "coll.last_record_id should be 0 for an empty collection.",
+                    (uint64_t)0, last_id);
+        }
+
         for(const auto& r : records_str) {
             CPPUNIT_ASSERT_NO_THROW_MESSAGE(
                     "coll.store should not throw.",
@@ -377,5 +1284,96 @@ class CollectionTest : public CppUnit::TestFixture,
                 (int)records_str.size()-1, (int)coll.size());
     }
 
+    void testIndex() {
+        if(db_type != "unqlite" && db_type != "unqlite-bypass"
+        && db_type != "aggregator" && db_type != "cache")
+            return;
+
+        sonata::Client client(*engine);
+        std::string addr = engine->self();
+        sonata::Database mydb = client.open(addr, 0, "mydb");
+        sonata::Collection coll = mydb.open("mycollection");
+
+        for(const auto& r : records_str) {
+            CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                    "coll.store should not throw.",
+                    coll.store(r));
+        }
+
+        // Querying a field that is not indexed should fail
+        std::vector<uint64_t> ids;
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "coll.query should throw on a field that is not indexed.",
+                coll.query("papers", 45, &ids),
+                sonata::Exception);
+
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.create_index should not throw.",
+                coll.create_index("papers"));
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "creating the same index twice should throw.",
+                coll.create_index("papers"),
+                sonata::Exception);
+
+        // Equality query
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.query should not throw.",
+                coll.query("papers", 45, &ids));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query should return 1 record.",
+                1, (int)ids.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query should return the correct id.",
+                (uint64_t)0, ids[0]);
+
+        // Range query, same as the "papers > 35" filter
+        json result;
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.query_range should not throw.",
+                coll.query_range("papers", 36, nullptr, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query_range should return 2 records.",
+                2, (int)result.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query_range should return the correct records.",
+                records_json[1]["name"].get<std::string>(),
+                result[1]["name"].get<std::string>());
+
+        // An open bound does not extend to values of other types
+        json other = {{"name", "Nobody"}, {"papers", "many"}};
+        coll.store(other);
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.query_range should not throw.",
+                coll.query_range("papers", 36, nullptr, &result));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query_range should not return strings.",
+                2, (int)result.size());
+
+        // The index should follow updates and erasures
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.update should not throw.",
+                coll.update(3, records_str[0]));
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.erase should not throw.",
+                coll.erase(0));
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.query should not throw.",
+                coll.query("papers", 45, &ids));
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query should return 1 record.",
+                1, (int)ids.size());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(
+                "query should return the updated record.",
+                (uint64_t)3, ids[0]);
+
+        CPPUNIT_ASSERT_NO_THROW_MESSAGE(
+                "coll.drop_index should not throw.",
+                coll.drop_index("papers"));
+        CPPUNIT_ASSERT_THROW_MESSAGE(
+                "coll.query should throw after the index is dropped.",
+                coll.query("papers", 45, &ids),
+                sonata::Exception);
+    }
+
 };
 CPPUNIT_TEST_SUITE_REGISTRATION( CollectionTest );
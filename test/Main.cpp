@@ -17,6 +17,7 @@
 namespace tl = thallium;
 
 tl::engine* engine = nullptr;
+sonata::Provider* provider = nullptr;
 std::string db_type = "unqlite";
 
 int main(int argc, char** argv) {
@@ -50,7 +51,8 @@ int main(int argc, char** argv) {
     engine = &theEngine;
 
     // Initialize the Sonata provider
-    sonata::Provider provider(theEngine);
+    sonata::Provider theProvider(theEngine);
+    provider = &theProvider;
 
     // Run the tests.
     bool wasSucessful = runner.run();